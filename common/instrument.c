@@ -0,0 +1,165 @@
+#define _GNU_SOURCE
+#include "instrument.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+long long get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+long long get_time_us(void) {
+    return get_time_ns() / 1000;
+}
+
+uint64_t tsc_read(void) {
+#if HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+double tsc_hz(void) {
+    static double hz = -1;
+    if (hz >= 0) {
+        return hz;
+    }
+#if HAVE_TSC
+    // Калибровка по CLOCK_MONOTONIC_RAW на интервале ~20 мс
+    long long t0 = get_time_ns();
+    uint64_t c0 = tsc_read();
+    struct timespec pause = { 0, 20000000 };
+    nanosleep(&pause, NULL);
+    long long t1 = get_time_ns();
+    uint64_t c1 = tsc_read();
+    hz = (double)(c1 - c0) / ((t1 - t0) / 1e9);
+#else
+    hz = 0;
+#endif
+    return hz;
+}
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+    const char *name;
+} perf_events[PERF_CNT_COUNT] = {
+    [PERF_CNT_CYCLES]        = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+    [PERF_CNT_INSTRUCTIONS]  = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+    [PERF_CNT_LLC_MISSES]    = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "LLC misses" },
+    [PERF_CNT_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch misses" },
+};
+
+static int perf_open_one(int idx, int inherit, int exclude_kernel) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perf_events[idx].type;
+    attr.config = perf_events[idx].config;
+    attr.disabled = 1;
+    attr.inherit = inherit ? 1 : 0;
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = 1;
+    // Счётчики открываются по отдельности: inherit несовместим с чтением
+    // группы через PERF_FORMAT_GROUP
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+int perf_counters_open(perf_counters_t *pc, int inherit) {
+    memset(pc, 0, sizeof(*pc));
+    for (int i = 0; i < PERF_CNT_COUNT; i++) {
+        pc->fd[i] = -1;
+    }
+
+    // Сначала пробуем считать и ядро (важно для I/O-нагрузки), при
+    // запрете perf_event_paranoid - только пользовательский режим
+    for (int user_only = 0; user_only <= 1 && pc->opened == 0; user_only++) {
+        pc->user_only = user_only;
+        for (int i = 0; i < PERF_CNT_COUNT; i++) {
+            pc->fd[i] = perf_open_one(i, inherit, user_only);
+            if (pc->fd[i] == -1) {
+                pc->open_errno = errno;
+            } else {
+                pc->opened++;
+            }
+        }
+    }
+    return pc->opened;
+}
+
+void perf_counters_start(perf_counters_t *pc) {
+    for (int i = 0; i < PERF_CNT_COUNT; i++) {
+        if (pc->fd[i] != -1) {
+            ioctl(pc->fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(pc->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    pc->tsc_start = tsc_read();
+}
+
+void perf_counters_stop(perf_counters_t *pc) {
+    pc->tsc_cycles = tsc_read() - pc->tsc_start;
+    for (int i = 0; i < PERF_CNT_COUNT; i++) {
+        pc->value[i] = 0;
+        if (pc->fd[i] == -1) {
+            continue;
+        }
+        ioctl(pc->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t value;
+        if (read(pc->fd[i], &value, sizeof(value)) == sizeof(value)) {
+            pc->value[i] = value;
+        }
+    }
+}
+
+void perf_counters_close(perf_counters_t *pc) {
+    for (int i = 0; i < PERF_CNT_COUNT; i++) {
+        if (pc->fd[i] != -1) {
+            close(pc->fd[i]);
+            pc->fd[i] = -1;
+        }
+    }
+}
+
+void perf_counters_report(const perf_counters_t *pc, unsigned long long bytes) {
+    if (pc->opened == 0) {
+        printf("Hardware counters: unavailable (perf_event_open: %s)\n", strerror(pc->open_errno));
+    } else {
+        printf("Hardware counters%s:\n", pc->user_only ? " (user space only)" : "");
+        for (int i = 0; i < PERF_CNT_COUNT; i++) {
+            if (pc->fd[i] == -1) {
+                printf("  %-14s n/a\n", perf_events[i].name);
+            } else {
+                printf("  %-14s %llu\n", perf_events[i].name, (unsigned long long)pc->value[i]);
+            }
+        }
+        uint64_t cycles = pc->value[PERF_CNT_CYCLES];
+        if (pc->fd[PERF_CNT_CYCLES] != -1 && pc->fd[PERF_CNT_INSTRUCTIONS] != -1 && cycles > 0) {
+            printf("IPC: %.2f\n", (double)pc->value[PERF_CNT_INSTRUCTIONS] / cycles);
+        }
+        if (pc->fd[PERF_CNT_CYCLES] != -1 && bytes > 0) {
+            printf("Cycles/byte: %.3f\n", (double)cycles / bytes);
+        }
+    }
+    // TSC считает опорные такты настенного времени и доступен всегда
+    if (pc->tsc_cycles > 0 && bytes > 0) {
+        printf("TSC cycles/byte: %.3f (TSC %.2f GHz)\n",
+               (double)pc->tsc_cycles / bytes, tsc_hz() / 1e9);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef COMMON_INSTRUMENT_H
+#define COMMON_INSTRUMENT_H
+
+#include <stdint.h>
+
+// Общий модуль измерений для cpu-calc-md5, cpu-calc-md5-mt и ema-replace-int.
+//
+// Время берётся из CLOCK_MONOTONIC_RAW: оно не прыгает при коррекции
+// часов NTP, в отличие от gettimeofday(). Для оценки тактов без
+// аппаратных счётчиков используется TSC.
+
+// Текущее время в микросекундах / наносекундах (CLOCK_MONOTONIC_RAW)
+long long get_time_us(void);
+long long get_time_ns(void);
+
+// Чтение TSC и его частота в Гц (калибруется один раз, 0 если TSC нет)
+uint64_t tsc_read(void);
+double tsc_hz(void);
+
+// Аппаратные счётчики perf_event_open
+enum {
+    PERF_CNT_CYCLES,
+    PERF_CNT_INSTRUCTIONS,
+    PERF_CNT_LLC_MISSES,
+    PERF_CNT_BRANCH_MISSES,
+    PERF_CNT_COUNT
+};
+
+typedef struct {
+    int fd[PERF_CNT_COUNT];
+    uint64_t value[PERF_CNT_COUNT];
+    int opened;             // сколько счётчиков удалось открыть
+    int user_only;          // ядро исключено (ограничение perf_event_paranoid)
+    int open_errno;
+    uint64_t tsc_start;
+    uint64_t tsc_cycles;    // такты TSC между start и stop
+} perf_counters_t;
+
+// Открывает счётчики для текущего процесса. inherit != 0 - учитывать
+// также потоки, созданные после открытия. Недоступные счётчики
+// пропускаются; возвращает число открытых.
+int perf_counters_open(perf_counters_t *pc, int inherit);
+void perf_counters_start(perf_counters_t *pc);
+void perf_counters_stop(perf_counters_t *pc);
+void perf_counters_close(perf_counters_t *pc);
+
+// Печать IPC, тактов на байт и промахов в блок Results
+void perf_counters_report(const perf_counters_t *pc, unsigned long long bytes);
+
+#endif
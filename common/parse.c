@@ -0,0 +1,22 @@
+#define _GNU_SOURCE
+#include "parse.h"
+
+#include <stdlib.h>
+
+long long parse_size(const char *str) {
+    char *end;
+    long long value = strtoll(str, &end, 10);
+    if (end == str || value <= 0) {
+        return -1;
+    }
+    switch (*end) {
+        case 'k': case 'K': value *= 1024LL; end++; break;
+        case 'm': case 'M': value *= 1024LL * 1024; end++; break;
+        case 'g': case 'G': value *= 1024LL * 1024 * 1024; end++; break;
+        default: break;
+    }
+    if (*end == 'B' || *end == 'b') {
+        end++;
+    }
+    return *end == '\0' ? value : -1;
+}
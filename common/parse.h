@@ -0,0 +1,8 @@
+#ifndef COMMON_PARSE_H
+#define COMMON_PARSE_H
+
+// Разбор размера с суффиксом K/M/G (степени 1024), необязательный B.
+// Возвращает -1 при ошибке или неположительном значении.
+long long parse_size(const char *str);
+
+#endif
@@ -2,83 +2,401 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <time.h>
+#include <getopt.h>
 #include <openssl/md5.h>
-#include <sys/time.h>
 #include <pthread.h>
 
+#include "instrument.h"
+#include "md5-workload.h"
+#include "pacer.h"
+
 // Multithreaded variant: simple example spawning worker threads that compute MD5
 // NOTE: This file mirrors the single-threaded generator but distributes
 // iterations across threads. Link with -lpthread -lcrypto.
+//
+// Thread t handles iterations t, t + threads, t + 2 * threads, ... Each
+// iteration's text depends only on (seed, iteration), so the digests are
+// identical to the single-threaded binary for the same seed.
+//
+// With --fingerprint the iterations run in windows of FINGERPRINT_WINDOW:
+// workers fill one shared window of digests, the last thread to reach the
+// barrier folds it in order, and the buffer is reused for the next window,
+// so memory does not grow with the iteration count.
+
+#define FINGERPRINT_WINDOW 65536   // iterations per window, 16 bytes each
 
 typedef struct {
     int id;
-    int iterations;
+    int threads;
+    int total_iterations;
+    int unlimited;         // run until the pacer's duration expires
+    int completed;
+    unsigned long long bytes;
     unsigned int seed;
+    const fragment_table_t *fragments;
+    unsigned char (*digests)[MD5_DIGEST_LENGTH];  // --fingerprint: digests of the current window
+    md5_fingerprint_t *fp;
+    pthread_barrier_t *barrier;
+    pacer_t pacer;
+    int pacing;
+    int status;            // -1 if the worker could not run its share
 } worker_arg_t;
 
-long long get_time_us() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+// Completion tracking so the reporter can stop as soon as workers finish
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond;
+static int done_workers = 0;
+
+// Start gate: workers wait until every thread has been created, so a
+// failed pthread_create never leaves the others at a barrier or the
+// reporter waiting for a worker that does not exist
+static pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+static int start_state = 0;    // 0 - waiting, 1 - go, -1 - abort
+
+static int wait_for_start(void) {
+    pthread_mutex_lock(&done_lock);
+    while (start_state == 0) {
+        pthread_cond_wait(&start_cond, &done_lock);
+    }
+    int state = start_state;
+    pthread_mutex_unlock(&done_lock);
+    return state;
+}
+
+static void open_start_gate(int state) {
+    pthread_mutex_lock(&done_lock);
+    start_state = state;
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&done_lock);
+}
+
+// Iterations first, first + threads, ... below end; digests are stored
+// relative to base. Returns 1 when the pacer's duration has expired.
+static int hash_range(worker_arg_t *w, char *buf, long long first, long long end, long long base) {
+    for (long long i = first; i < end; i += w->threads) {
+        unsigned int state = iteration_seed(w->seed, i);
+        int len = generate_text(buf, w->fragments, &state);
+        unsigned char md5[MD5_DIGEST_LENGTH];
+        calculate_md5(buf, len, md5);
+        if (w->digests != NULL) {
+            memcpy(w->digests[i - base], md5, MD5_DIGEST_LENGTH);
+        }
+        w->completed++;
+        w->bytes += len;
+
+        if (w->pacing && pacer_account(&w->pacer, len)) {
+            return 1;
+        }
+    }
+    return 0;
 }
 
 void *worker(void *arg) {
     worker_arg_t *w = (worker_arg_t *)arg;
-    unsigned int seed = w->seed + w->id;
-    srand(seed);
+    char *buf = malloc(MAX_TEXT_SIZE + 1);
 
-    for (int i = 0; i < w->iterations; i++) {
-        // Simple small payload per iteration
-        char buf[128];
-        int len = snprintf(buf, sizeof(buf), "thread-%d-iter-%d-%u", w->id, i, rand());
-        unsigned char md5[MD5_DIGEST_LENGTH];
-        MD5((unsigned char*)buf, len, md5);
+    w->completed = 0;
+    w->bytes = 0;
+    w->status = buf != NULL ? 0 : -1;
+    if (buf == NULL) {
+        perror("malloc");
     }
+    if (wait_for_start() == -1) {
+        // Another thread failed to start; the run is abandoned
+    } else if (w->fp == NULL) {
+        if (buf != NULL) {
+            hash_range(w, buf, w->id, w->unlimited ? LLONG_MAX : w->total_iterations, 0);
+        }
+    } else {
+        // Every worker passes both barriers of every window, even one that
+        // failed, or the others would wait forever
+        for (long long base = 0; base < w->total_iterations; base += FINGERPRINT_WINDOW) {
+            long long end = base + FINGERPRINT_WINDOW < w->total_iterations ? base + FINGERPRINT_WINDOW
+                                                                            : w->total_iterations;
+            long long first = base + ((w->id - base) % w->threads + w->threads) % w->threads;
+            if (buf != NULL) {
+                hash_range(w, buf, first, end, base);
+            }
+            if (pthread_barrier_wait(w->barrier) == PTHREAD_BARRIER_SERIAL_THREAD) {
+                for (long long i = 0; i < end - base; i++) {
+                    fingerprint_fold(w->fp, w->digests[i]);
+                }
+            }
+            pthread_barrier_wait(w->barrier);
+        }
+    }
+    free(buf);
 
+    pthread_mutex_lock(&done_lock);
+    done_workers++;
+    pthread_cond_signal(&done_cond);
+    pthread_mutex_unlock(&done_lock);
     return NULL;
 }
 
+// Periodically aggregate per-thread counters and print achieved vs target
+// rate until all workers have finished.
+void report_until_done(worker_arg_t *args, int threads, const pace_config_t *pace, long long start_ns) {
+    pace_report_t report;
+    pace_report_init(&report, start_ns);
+    long long next_ns = start_ns;
+
+    pthread_mutex_lock(&done_lock);
+    while (done_workers < threads) {
+        next_ns += (long long)(pace->interval_s * 1e9);
+        struct timespec deadline = { next_ns / 1000000000LL, next_ns % 1000000000LL };
+        while (done_workers < threads &&
+               pthread_cond_timedwait(&done_cond, &done_lock, &deadline) == 0) {
+        }
+
+        unsigned long long bytes = 0, busy_ns = 0;
+        for (int i = 0; i < threads; i++) {
+            unsigned long long b, t;
+            pacer_snapshot(&args[i].pacer, &b, &t);
+            bytes += b;
+            busy_ns += t;
+        }
+        pace_report(&report, pace, pace_now_ns(), start_ns, bytes, busy_ns, threads);
+    }
+    pthread_mutex_unlock(&done_lock);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <total_iterations> <threads> [seed]\n", prog);
+    fprintf(stderr, "       %s --verify\n", prog);
+    fprintf(stderr, "  total_iterations - 0 runs until --duration expires\n");
+    fprintf(stderr, "Options:\n");
+    fragment_config_usage();
+    fprintf(stderr, "  --duration <time>       run for <n>[s|m|h]\n");
+    fprintf(stderr, "  --target-mbps <rate>    pace total hashing rate to the given MB/s\n");
+    fprintf(stderr, "  --duty-cycle <frac>     busy share of each thread's core (0.4 or 40%%)\n");
+    fprintf(stderr, "  --report-interval <s>   progress report period when pacing (default: 1)\n");
+    fprintf(stderr, "  --verify                check MD5 against the RFC 1321 test vectors and exit\n");
+    fprintf(stderr, "  --fingerprint           print a digest of all iteration digests in order\n");
+    fprintf(stderr, "                          (folded in windows of %d iterations)\n", FINGERPRINT_WINDOW);
+    fprintf(stderr, "  --perf                  collect hardware counters across all worker threads\n");
+}
+
 int main(int argc, char *argv[]) {
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <total_iterations> <threads> [seed]\n", argv[0]);
+    fragment_config_t fragment_cfg = FRAGMENT_CONFIG_DEFAULT;
+    pace_config_t pace = { .duration_s = 0, .target_mbps = 0, .duty_cycle = 1.0, .interval_s = 1.0 };
+    int verify = 0;
+    int fingerprint = 0;
+    int use_perf = 0;
+
+    static const struct option long_options[] = {
+        FRAGMENT_LONG_OPTIONS,
+        {"duration",        required_argument, NULL, 'd'},
+        {"target-mbps",     required_argument, NULL, 'r'},
+        {"duty-cycle",      required_argument, NULL, 'u'},
+        {"report-interval", required_argument, NULL, 'i'},
+        {"verify",          no_argument,       NULL, 'V'},
+        {"fingerprint",     no_argument,       NULL, 'F'},
+        {"perf",            no_argument,       NULL, 'P'},
+        {"help",            no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        int handled = fragment_config_option(&fragment_cfg, opt, optarg);
+        if (handled == -1) {
+            return 1;
+        }
+        if (handled) {
+            continue;
+        }
+        switch (opt) {
+            case 'd': pace.duration_s = pace_parse_duration(optarg); break;
+            case 'r': pace.target_mbps = pace_parse_rate(optarg); break;
+            case 'u': pace.duty_cycle = pace_parse_fraction(optarg); break;
+            case 'i': pace.interval_s = pace_parse_duration(optarg); break;
+            case 'V': verify = 1; break;
+            case 'F': fingerprint = 1; break;
+            case 'P': use_perf = 1; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (verify) {
+        int failures = md5_self_test(1);
+        printf("RFC 1321 test vectors: %s\n", failures == 0 ? "all passed" : "FAILED");
+        return failures == 0 ? 0 : 1;
+    }
+
+    if (argc - optind < 2) {
+        usage(argv[0]);
         return 1;
     }
 
-    int total_iterations = atoi(argv[1]);
-    int threads = atoi(argv[2]);
-    unsigned int seed = (argc >= 4) ? atoi(argv[3]) : (unsigned int)time(NULL);
+    int total_iterations = atoi(argv[optind]);
+    int threads = atoi(argv[optind + 1]);
+    unsigned int seed = (optind + 2 < argc) ? atoi(argv[optind + 2]) : (unsigned int)time(NULL);
 
-    if (total_iterations <= 0 || threads <= 0) {
+    if (pace_config_check(&pace) == -1) {
+        return 1;
+    }
+    if (total_iterations < 0 || (total_iterations == 0 && pace.duration_s <= 0) || threads <= 0) {
         fprintf(stderr, "total_iterations and threads must be positive\n");
         return 1;
     }
+    if (fingerprint && (total_iterations == 0 || pace.duration_s > 0)) {
+        // With a time limit threads stop at different points of the sequence
+        fprintf(stderr, "--fingerprint needs a fixed total_iterations without --duration\n");
+        return 1;
+    }
+
+    // The fragment table is built once from rand() and shared read-only
+    srand(seed);
+    fragment_table_t fragments;
+    if (fragments_setup(&fragments, &fragment_cfg) == -1) {
+        return 1;
+    }
+
+    // Digests of one window; calloc so a failed worker's slots fold as zeros
+    // (the fingerprint is discarded then anyway)
+    unsigned char (*digests)[MD5_DIGEST_LENGTH] = NULL;
+    md5_fingerprint_t fp;
+    pthread_barrier_t barrier;
+    if (fingerprint) {
+        digests = calloc(FINGERPRINT_WINDOW, MD5_DIGEST_LENGTH);
+        if (digests == NULL) {
+            perror("calloc");
+            fragments_free(&fragments);
+            return 1;
+        }
+        fingerprint_init(&fp);
+        pthread_barrier_init(&barrier, NULL, threads);
+    }
 
     pthread_t *tids = malloc(sizeof(pthread_t) * threads);
     worker_arg_t *args = malloc(sizeof(worker_arg_t) * threads);
+    if (tids == NULL || args == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&done_cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
 
-    int per_thread = total_iterations / threads;
-    int remainder = total_iterations % threads;
+    int pacing = pace_config_active(&pace);
+
+    // Counters inherit into the worker threads; their counts are folded
+    // back into the parent's values when the threads exit
+    perf_counters_t counters;
+    if (use_perf) {
+        perf_counters_open(&counters, 1);
+        perf_counters_start(&counters);
+    }
 
     long long start = get_time_us();
+    long long start_ns = pace_now_ns();
 
+    int started = 0;
     for (int i = 0; i < threads; i++) {
         args[i].id = i;
-        args[i].iterations = per_thread + (i < remainder ? 1 : 0);
+        args[i].threads = threads;
+        args[i].total_iterations = total_iterations;
+        args[i].unlimited = (total_iterations == 0);
         args[i].seed = seed;
-        pthread_create(&tids[i], NULL, worker, &args[i]);
+        args[i].fragments = &fragments;
+        args[i].digests = digests;
+        args[i].fp = fingerprint ? &fp : NULL;
+        args[i].barrier = fingerprint ? &barrier : NULL;
+        args[i].pacing = pacing;
+        args[i].status = 0;
+        // Every worker paces its share of the rate against a common start
+        pacer_init(&args[i].pacer, &pace, 1.0 / threads);
+        pacer_start(&args[i].pacer, start_ns);
+        int err = pthread_create(&tids[i], NULL, worker, &args[i]);
+        if (err != 0) {
+            fprintf(stderr, "pthread_create: %s (%d of %d threads started)\n", strerror(err), started, threads);
+            break;
+        }
+        started++;
     }
+    open_start_gate(started == threads ? 1 : -1);
 
-    for (int i = 0; i < threads; i++) {
+    if (pacing && started == threads) {
+        report_until_done(args, started, &pace, start_ns);
+    }
+
+    for (int i = 0; i < started; i++) {
         pthread_join(tids[i], NULL);
     }
+    if (started < threads) {
+        if (use_perf) {
+            perf_counters_close(&counters);
+        }
+        fragments_free(&fragments);
+        free(digests);
+        free(tids);
+        free(args);
+        return 1;
+    }
 
     long long end = get_time_us();
     long long elapsed = end - start;
+    if (use_perf) {
+        perf_counters_stop(&counters);
+    }
+    int completed = 0;
+    int failed = 0;
+    unsigned long long total_bytes = 0;
+    for (int i = 0; i < threads; i++) {
+        completed += args[i].completed;
+        total_bytes += args[i].bytes;
+        failed += args[i].status == -1;
+    }
     printf("Completed %d iterations on %d threads in %lld.%06lld seconds\n",
-           total_iterations, threads, elapsed / 1000000, elapsed % 1000000);
+           completed, threads, elapsed / 1000000, elapsed % 1000000);
+    if (pacing) {
+        unsigned long long bytes = 0, busy_ns = 0;
+        for (int i = 0; i < threads; i++) {
+            bytes += args[i].pacer.bytes;
+            busy_ns += args[i].pacer.busy_ns;
+        }
+        printf("Throughput: %.2f MB/s", (double)bytes / (elapsed / 1000000.0) / (1024.0 * 1024.0));
+        if (pace.target_mbps > 0) {
+            printf(" (target %.2f MB/s)", pace.target_mbps);
+        }
+        printf(", busy %.2f%% per thread\n", (double)busy_ns / 1000.0 / elapsed / threads * 100.0);
+    }
 
+    int status = 0;
+    if (failed > 0) {
+        fprintf(stderr, "Error: %d of %d worker threads failed\n", failed, threads);
+        status = 1;
+    } else if (fingerprint && completed != total_iterations) {
+        fprintf(stderr, "Error: only %d of %d iterations completed, no fingerprint\n", completed, total_iterations);
+        status = 1;
+    }
+
+    if (fingerprint && status == 0) {
+        // Folded in iteration order, so the result matches cpu-calc-md5
+        char fp_string[33];
+        md5_to_string(fp.digest, fp_string);
+        printf("Fingerprint: %s (seed %u, %llu iterations)\n", fp_string, seed, fp.count);
+    }
+    if (use_perf) {
+        perf_counters_report(&counters, total_bytes);
+        perf_counters_close(&counters);
+    }
+
+    pthread_cond_destroy(&done_cond);
+    if (fingerprint) {
+        pthread_barrier_destroy(&barrier);
+    }
+    free(digests);
+    fragments_free(&fragments);
     free(tids);
     free(args);
-    return 0;
+    return status;
 }
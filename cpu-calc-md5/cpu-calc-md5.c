@@ -3,149 +3,218 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <getopt.h>
 #include <openssl/md5.h>
-#include <sys/time.h>
 
-#define FRAGMENTS_COUNT 1000
-#define FRAGMENT_SIZE 64
-#define MAX_TEXT_SIZE (FRAGMENTS_COUNT * FRAGMENT_SIZE)
+#include "instrument.h"
+#include "md5-workload.h"
+#include "pacer.h"
 
-// Набор текстовых фрагментов для генерации данных
-const char *text_fragments[FRAGMENTS_COUNT] = {
-    "Lorem ipsum dolor sit amet, consectetur adipiscing elit. Sed do",
-    "eiusmod tempor incididunt ut labore et dolore magna aliqua. Ut ",
-    "enim ad minim veniam, quis nostrud exercitation ullamco laboris",
-    "nisi ut aliquip ex ea commodo consequat. Duis aute irure dolor ",
-    "in reprehenderit in voluptate velit esse cillum dolore eu fugia",
-    "Excepteur sint occaecat cupidatat non proident, sunt in culpa q",
-    "officia deserunt mollit anim id est laborum. Sed ut perspiciati",
-    "unde omnis iste natus error sit voluptatem accusantium doloremq",
-    "laudantium totam rem aperiam eaque ipsa quae ab illo inventore ",
-    "veritatis et quasi architecto beatae vitae dicta sunt explicabo"
-    // ... остальные фрагменты будут генерироваться автоматически
-};
-
-// Инициализация текстовых фрагментов
-void init_fragments(char fragments[][FRAGMENT_SIZE + 1]) {
-    for (int i = 0; i < FRAGMENTS_COUNT; i++) {
-        if (i < 10) {
-            strncpy(fragments[i], text_fragments[i], FRAGMENT_SIZE);
-            fragments[i][FRAGMENT_SIZE] = '\0';
-        } else {
-            // Генерируем случайные фрагменты для остальных
-            for (int j = 0; j < FRAGMENT_SIZE; j++) {
-                fragments[i][j] = 'a' + (rand() % 26);
-            }
-            fragments[i][FRAGMENT_SIZE] = '\0';
-        }
-    }
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <iterations> [seed]\n", prog);
+    fprintf(stderr, "       %s --verify\n", prog);
+    fprintf(stderr, "  iterations - number of MD5 calculations to perform (0 = until --duration)\n");
+    fprintf(stderr, "  seed       - random seed (optional, default: current time)\n");
+    fprintf(stderr, "Options:\n");
+    fragment_config_usage();
+    fprintf(stderr, "  --duration <time>       run for <n>[s|m|h] instead of a fixed iteration count\n");
+    fprintf(stderr, "  --target-mbps <rate>    pace hashing to the given MB/s\n");
+    fprintf(stderr, "  --duty-cycle <frac>     keep the core busy only this share of time (0.4 or 40%%)\n");
+    fprintf(stderr, "  --report-interval <s>   progress report period when pacing (default: 1)\n");
+    fprintf(stderr, "  --verify                check MD5 against the RFC 1321 test vectors and exit\n");
+    fprintf(stderr, "  --fingerprint           print a digest of all iteration digests\n");
+    fprintf(stderr, "  --perf                  collect hardware counters (IPC, cycles/byte) for the main loop\n");
 }
 
-// Генерация текста из случайных фрагментов
-void generate_text(char *buffer, int length, char fragments[][FRAGMENT_SIZE + 1]) {
-    int pos = 0;
-    while (pos < length) {
-        int fragment_idx = rand() % FRAGMENTS_COUNT;
-        int to_copy = FRAGMENT_SIZE;
-        if (pos + to_copy > length) {
-            to_copy = length - pos;
-        }
-        memcpy(buffer + pos, fragments[fragment_idx], to_copy);
-        pos += to_copy;
-    }
-    buffer[length] = '\0';
-}
+int main(int argc, char *argv[]) {
+    fragment_config_t fragment_cfg = FRAGMENT_CONFIG_DEFAULT;
+    pace_config_t pace = { .duration_s = 0, .target_mbps = 0, .duty_cycle = 1.0, .interval_s = 1.0 };
+    int verify = 0;
+    int fingerprint = 0;
+    int use_perf = 0;
 
-// Вычисление MD5 хеша
-void calculate_md5(const char *text, unsigned char *result) {
-    MD5_CTX ctx;
-    MD5_Init(&ctx);
-    MD5_Update(&ctx, text, strlen(text));
-    MD5_Final(result, &ctx);
-}
+    static const struct option long_options[] = {
+        FRAGMENT_LONG_OPTIONS,
+        {"duration",        required_argument, NULL, 'd'},
+        {"target-mbps",     required_argument, NULL, 'r'},
+        {"duty-cycle",      required_argument, NULL, 'u'},
+        {"report-interval", required_argument, NULL, 'i'},
+        {"verify",          no_argument,       NULL, 'V'},
+        {"fingerprint",     no_argument,       NULL, 'F'},
+        {"perf",            no_argument,       NULL, 'P'},
+        {"help",            no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
 
-// Преобразование MD5 в строку
-void md5_to_string(unsigned char *md5, char *output) {
-    for (int i = 0; i < MD5_DIGEST_LENGTH; i++) {
-        sprintf(output + (i * 2), "%02x", md5[i]);
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        int handled = fragment_config_option(&fragment_cfg, opt, optarg);
+        if (handled == -1) {
+            return 1;
+        }
+        if (handled) {
+            continue;
+        }
+        switch (opt) {
+            case 'd':
+                pace.duration_s = pace_parse_duration(optarg);
+                break;
+            case 'r':
+                pace.target_mbps = pace_parse_rate(optarg);
+                break;
+            case 'u':
+                pace.duty_cycle = pace_parse_fraction(optarg);
+                break;
+            case 'i':
+                pace.interval_s = pace_parse_duration(optarg);
+                break;
+            case 'V':
+                verify = 1;
+                break;
+            case 'F':
+                fingerprint = 1;
+                break;
+            case 'P':
+                use_perf = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
     }
-    output[32] = '\0';
-}
 
-// Получение текущего времени в микросекундах
-long long get_time_us() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
-}
+    // Проверка реализации MD5 до запуска нагрузки
+    if (verify) {
+        int failures = md5_self_test(1);
+        printf("RFC 1321 test vectors: %s\n", failures == 0 ? "all passed" : "FAILED");
+        return failures == 0 ? 0 : 1;
+    }
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <iterations> [seed]\n", argv[0]);
-        fprintf(stderr, "  iterations - number of MD5 calculations to perform\n");
-        fprintf(stderr, "  seed       - random seed (optional, default: current time)\n");
+    if (optind >= argc) {
+        usage(argv[0]);
         return 1;
     }
     
-    int iterations = atoi(argv[1]);
-    if (iterations <= 0) {
-        fprintf(stderr, "Error: iterations must be positive\n");
+    int iterations = atoi(argv[optind]);
+    if (pace_config_check(&pace) == -1) {
+        return 1;
+    }
+    if (iterations < 0 || (iterations == 0 && pace.duration_s <= 0)) {
+        fprintf(stderr, "Error: iterations must be positive (or 0 with --duration)\n");
         return 1;
     }
     
     // Инициализация генератора случайных чисел
-    unsigned int seed = (argc >= 3) ? atoi(argv[2]) : (unsigned int)time(NULL);
+    unsigned int seed = (optind + 1 < argc) ? atoi(argv[optind + 1]) : (unsigned int)time(NULL);
     srand(seed);
+
+    // Инициализация фрагментов текста
+    fragment_table_t fragments;
+    if (fragments_setup(&fragments, &fragment_cfg) == -1) {
+        return 1;
+    }
     
     printf("CPU MD5 Calculator\n");
     printf("==================\n");
-    printf("Iterations: %d\n", iterations);
+    if (iterations > 0) {
+        printf("Iterations: %d\n", iterations);
+    } else {
+        printf("Iterations: unlimited\n");
+    }
+    if (pace.duration_s > 0) {
+        printf("Duration: %.2f seconds\n", pace.duration_s);
+    }
+    if (pace.target_mbps > 0) {
+        printf("Target rate: %.2f MB/s\n", pace.target_mbps);
+    }
+    if (pace.duty_cycle < 1.0) {
+        printf("Duty cycle: %.2f%%\n", pace.duty_cycle * 100.0);
+    }
     printf("Seed: %u\n", seed);
     printf("Text size: ~%d bytes per iteration\n", MAX_TEXT_SIZE);
+    printf("Fragments: %zu x %zu bytes (%s)\n", fragments.count, fragments.size,
+           fragment_cfg.corpus_path != NULL ? fragment_cfg.corpus_path : "built-in");
+    printf("Fragment table: %.2f KB (stride %zu bytes)\n",
+           (double)(fragments.count * fragments.stride) / 1024.0, fragments.stride);
     printf("\n");
     
-    // Инициализация фрагментов текста
-    char (*fragments)[FRAGMENT_SIZE + 1] = malloc(FRAGMENTS_COUNT * (FRAGMENT_SIZE + 1));
-    if (fragments == NULL) {
-        perror("malloc");
-        return 1;
-    }
-    init_fragments(fragments);
-    
     // Буфер для генерируемого текста
     char *text_buffer = malloc(MAX_TEXT_SIZE + 1);
     if (text_buffer == NULL) {
         perror("malloc");
-        free(fragments);
+        fragments_free(&fragments);
         return 1;
     }
     
+    perf_counters_t counters;
+    if (use_perf) {
+        perf_counters_open(&counters, 0);
+    }
+
     // Засекаем время
     long long start_time = get_time_us();
+
+    // Пейсинг включается только явными опциями, иначе цикл идёт
+    // на полной скорости как раньше
+    int pacing = pace_config_active(&pace);
+    pacer_t pacer;
+    pace_report_t report;
+    pacer_init(&pacer, &pace, 1.0);
+    pace_report_init(&report, pace_now_ns());
+    long long pace_start_ns = report.last_ns;
+    long long next_report_ns = pace_start_ns + (long long)(pace.interval_s * 1e9);
+
+    md5_fingerprint_t fp;
+    fingerprint_init(&fp);
+
+    if (use_perf) {
+        perf_counters_start(&counters);
+    }
     
     // Основной цикл вычислений
     unsigned long long total_bytes = 0;
-    for (int i = 0; i < iterations; i++) {
-        // Генерируем случайную длину текста
-        int text_length = (rand() % (MAX_TEXT_SIZE / 2)) + (MAX_TEXT_SIZE / 2);
-        
-        // Генерируем текст
-        generate_text(text_buffer, text_length, fragments);
+    int done = 0;
+    for (int i = 0; iterations == 0 || i < iterations; i++) {
+        // Генерируем текст; состояние генератора зависит только от
+        // seed и номера итерации, как и в многопоточной версии
+        unsigned int state = iteration_seed(seed, i);
+        int text_length = generate_text(text_buffer, &fragments, &state);
         total_bytes += text_length;
         
         // Вычисляем MD5
         unsigned char md5_result[MD5_DIGEST_LENGTH];
-        calculate_md5(text_buffer, md5_result);
+        calculate_md5(text_buffer, text_length, md5_result);
+        if (fingerprint) {
+            fingerprint_fold(&fp, md5_result);
+        }
+        
+        done = i + 1;
         
         // Периодически выводим прогресс
-        if ((i + 1) % (iterations / 10 == 0 ? 1 : iterations / 10) == 0 || i == 0) {
+        if (iterations > 0 && ((i + 1) % (iterations / 10 == 0 ? 1 : iterations / 10) == 0 || i == 0)) {
             char md5_string[33];
             md5_to_string(md5_result, md5_string);
             printf("Iteration %d/%d: MD5 = %s (text length: %d)\n", 
                    i + 1, iterations, md5_string, text_length);
         }
+
+        if (pacing) {
+            int expired = pacer_account(&pacer, text_length);
+            long long now_ns = pace_now_ns();
+            if (now_ns >= next_report_ns || expired) {
+                pace_report(&report, &pace, now_ns, pace_start_ns, pacer.bytes, pacer.busy_ns, 1);
+                next_report_ns += (long long)(pace.interval_s * 1e9);
+            }
+            if (expired) {
+                break;
+            }
+        }
     }
     
+    if (use_perf) {
+        perf_counters_stop(&counters);
+    }
+
     long long end_time = get_time_us();
     long long elapsed = end_time - start_time;
     
@@ -153,17 +222,33 @@ int main(int argc, char *argv[]) {
     printf("\n");
     printf("Results:\n");
     printf("========\n");
-    printf("Total iterations: %d\n", iterations);
+    printf("Total iterations: %d\n", done);
     printf("Total bytes processed: %llu\n", total_bytes);
     printf("Execution time: %lld.%06lld seconds\n", 
            elapsed / 1000000, elapsed % 1000000);
     printf("Average time per iteration: %.6f seconds\n", 
-           (double)elapsed / iterations / 1000000.0);
+           (double)elapsed / done / 1000000.0);
     printf("Throughput: %.2f MB/s\n", 
            (double)total_bytes / (elapsed / 1000000.0) / (1024.0 * 1024.0));
+    if (pacing) {
+        if (pace.target_mbps > 0) {
+            printf("Target throughput: %.2f MB/s\n", pace.target_mbps);
+        }
+        printf("Busy time: %.2f%% of one core\n",
+               (double)pacer.busy_ns / 1000.0 / elapsed * 100.0);
+    }
+    if (fingerprint) {
+        char fp_string[33];
+        md5_to_string(fp.digest, fp_string);
+        printf("Fingerprint: %s (seed %u, %llu iterations)\n", fp_string, seed, fp.count);
+    }
+    if (use_perf) {
+        perf_counters_report(&counters, total_bytes);
+        perf_counters_close(&counters);
+    }
     
     free(text_buffer);
-    free(fragments);
+    fragments_free(&fragments);
     
     return 0;
 }
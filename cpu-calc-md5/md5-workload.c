@@ -0,0 +1,324 @@
+#define _GNU_SOURCE
+#include "md5-workload.h"
+#include "parse.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Набор текстовых фрагментов для генерации данных
+static const char *text_fragments[BUILTIN_FRAGMENTS] = {
+    "Lorem ipsum dolor sit amet, consectetur adipiscing elit. Sed do",
+    "eiusmod tempor incididunt ut labore et dolore magna aliqua. Ut ",
+    "enim ad minim veniam, quis nostrud exercitation ullamco laboris",
+    "nisi ut aliquip ex ea commodo consequat. Duis aute irure dolor ",
+    "in reprehenderit in voluptate velit esse cillum dolore eu fugia",
+    "Excepteur sint occaecat cupidatat non proident, sunt in culpa q",
+    "officia deserunt mollit anim id est laborum. Sed ut perspiciati",
+    "unde omnis iste natus error sit voluptatem accusantium doloremq",
+    "laudantium totam rem aperiam eaque ipsa quae ab illo inventore ",
+    "veritatis et quasi architecto beatae vitae dicta sunt explicabo"
+    // ... остальные фрагменты будут генерироваться автоматически
+};
+
+// Выделение выровненной таблицы под count фрагментов размера size
+static int alloc_fragments(fragment_table_t *table, size_t count, size_t size) {
+    table->count = count;
+    table->size = size;
+    table->stride = (size + FRAGMENT_ALIGN - 1) / FRAGMENT_ALIGN * FRAGMENT_ALIGN;
+    if (count > SIZE_MAX / table->stride) {
+        fprintf(stderr, "Error: %zu fragments of %zu bytes do not fit in the address space\n", count, size);
+        table->data = NULL;
+        return -1;
+    }
+    table->data = aligned_alloc(FRAGMENT_ALIGN, table->count * table->stride);
+    if (table->data == NULL) {
+        perror("aligned_alloc");
+        return -1;
+    }
+    memset(table->data, 0, table->count * table->stride);
+    return 0;
+}
+
+char *fragment_at(const fragment_table_t *table, size_t idx) {
+    return table->data + idx * table->stride;
+}
+
+// Инициализация текстовых фрагментов
+static void init_fragments(fragment_table_t *table) {
+    for (size_t i = 0; i < table->count; i++) {
+        char *fragment = fragment_at(table, i);
+        if (i < BUILTIN_FRAGMENTS) {
+            // Циклически повторяем строку, чтобы фрагмент не содержал '\0'
+            size_t len = strlen(text_fragments[i]);
+            for (size_t j = 0; j < table->size; j++) {
+                fragment[j] = (j % (len + 1) == len) ? ' ' : text_fragments[i][j % (len + 1)];
+            }
+        } else {
+            // Генерируем случайные фрагменты для остальных
+            for (size_t j = 0; j < table->size; j++) {
+                fragment[j] = 'a' + (rand() % 26);
+            }
+        }
+    }
+}
+
+// Загрузка фрагментов из текстового корпуса через mmap.
+// Корпус нарезается подряд на куски по table->size байт; если корпус
+// короче таблицы, нарезка продолжается с начала файла.
+static int load_corpus(const char *path, fragment_table_t *table) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror("open corpus");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        fprintf(stderr, "Error: corpus file %s is empty\n", path);
+        close(fd);
+        return -1;
+    }
+
+    size_t corpus_len = st.st_size;
+    const char *corpus = mmap(NULL, corpus_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (corpus == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    madvise((void *)corpus, corpus_len, MADV_SEQUENTIAL);
+
+    size_t pos = 0;
+    for (size_t i = 0; i < table->count; i++) {
+        char *fragment = fragment_at(table, i);
+        size_t filled = 0;
+        while (filled < table->size) {
+            size_t chunk = table->size - filled;
+            if (chunk > corpus_len - pos) {
+                chunk = corpus_len - pos;
+            }
+            memcpy(fragment + filled, corpus + pos, chunk);
+            filled += chunk;
+            pos += chunk;
+            if (pos == corpus_len) {
+                pos = 0;
+            }
+        }
+    }
+
+    munmap((void *)corpus, corpus_len);
+    return 0;
+}
+
+// Размер кэша данных указанного уровня (sysconf, иначе типичное значение)
+static long long cache_size(int level) {
+    long value = -1;
+    long long fallback = 0;
+    switch (level) {
+        case 1: value = sysconf(_SC_LEVEL1_DCACHE_SIZE); fallback = 32LL * 1024; break;
+        case 2: value = sysconf(_SC_LEVEL2_CACHE_SIZE); fallback = 1024LL * 1024; break;
+        case 3: value = sysconf(_SC_LEVEL3_CACHE_SIZE); fallback = 32LL * 1024 * 1024; break;
+    }
+    return value > 0 ? value : fallback;
+}
+
+// Рабочий набор таблицы фрагментов в байтах: L1/L2/L3 - половина
+// соответствующего кэша (остальное занимают буфер текста и стек),
+// DRAM - заведомо больше LLC, иначе явный размер
+static long long parse_working_set(const char *str) {
+    if (strcasecmp(str, "L1") == 0) return cache_size(1) / 2;
+    if (strcasecmp(str, "L2") == 0) return cache_size(2) / 2;
+    if (strcasecmp(str, "L3") == 0) return cache_size(3) / 2;
+    if (strcasecmp(str, "DRAM") == 0) {
+        long long size = cache_size(3) * 4;
+        return size < 256LL * 1024 * 1024 ? 256LL * 1024 * 1024 : size;
+    }
+    return parse_size(str);
+}
+
+// Генерация текста из случайных фрагментов
+int generate_text(char *buffer, const fragment_table_t *table, unsigned int *state) {
+    // Генерируем случайную длину текста
+    int length = (rand_r(state) % (MAX_TEXT_SIZE / 2)) + (MAX_TEXT_SIZE / 2);
+    int pos = 0;
+    while (pos < length) {
+        int fragment_idx = rand_r(state) % table->count;
+        int to_copy = table->size;
+        if (pos + to_copy > length) {
+            to_copy = length - pos;
+        }
+        memcpy(buffer + pos, fragment_at(table, fragment_idx), to_copy);
+        pos += to_copy;
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+// Вычисление MD5 хеша
+void calculate_md5(const char *text, size_t length, unsigned char *result) {
+    MD5_CTX ctx;
+    MD5_Init(&ctx);
+    MD5_Update(&ctx, text, length);
+    MD5_Final(result, &ctx);
+}
+
+// Преобразование MD5 в строку
+void md5_to_string(unsigned char *md5, char *output) {
+    for (int i = 0; i < MD5_DIGEST_LENGTH; i++) {
+        sprintf(output + (i * 2), "%02x", md5[i]);
+    }
+    output[32] = '\0';
+}
+
+unsigned int iteration_seed(unsigned int seed, unsigned long long iteration) {
+    // splitmix64 от (seed, iteration): соседние итерации получают
+    // несвязанные состояния rand_r()
+    unsigned long long z = ((unsigned long long)seed << 32) + iteration + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return (unsigned int)(z ^ (z >> 32));
+}
+
+int fragment_config_option(fragment_config_t *cfg, int opt, const char *arg) {
+    switch (opt) {
+        case 'c':
+            cfg->corpus_path = arg;
+            return 1;
+        case 'f': {
+            char *end;
+            cfg->fragments_count = strtoll(arg, &end, 10);
+            if (end == arg || *end != '\0' || cfg->fragments_count <= 0) {
+                fprintf(stderr, "Error: invalid fragment count '%s'\n", arg);
+                return -1;
+            }
+            cfg->fragments_set = 1;
+            return 1;
+        }
+        case 's':
+            cfg->fragment_size = parse_size(arg);
+            return 1;
+        case 'w':
+            cfg->working_set = parse_working_set(arg);
+            if (cfg->working_set <= 0) {
+                fprintf(stderr, "Error: invalid working set '%s'\n", arg);
+                return -1;
+            }
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+void fragment_config_usage(void) {
+    fprintf(stderr, "  --corpus <file>         load fragments from a text file (mmap)\n");
+    fprintf(stderr, "  --fragments <n>         number of fragments (default: %d)\n", FRAGMENTS_COUNT);
+    fprintf(stderr, "  --fragment-size <n>     bytes per fragment (default: %d)\n", FRAGMENT_SIZE);
+    fprintf(stderr, "  --working-set <size>    size the fragment table to L1|L2|L3|DRAM or <n>[K|M|G]\n");
+}
+
+int fragments_setup(fragment_table_t *table, const fragment_config_t *cfg) {
+    if (cfg->fragment_size <= 0 || cfg->fragment_size > MAX_TEXT_SIZE) {
+        fprintf(stderr, "Error: fragment size must be in 1..%d\n", MAX_TEXT_SIZE);
+        return -1;
+    }
+    if (cfg->working_set > 0 && cfg->fragments_set) {
+        fprintf(stderr, "Error: --working-set and --fragments are mutually exclusive\n");
+        return -1;
+    }
+
+    long long count = cfg->fragments_count;
+    if (cfg->working_set > 0) {
+        size_t stride = (cfg->fragment_size + FRAGMENT_ALIGN - 1) / FRAGMENT_ALIGN * FRAGMENT_ALIGN;
+        count = cfg->working_set / stride;
+        if (count == 0) {
+            count = 1;
+        }
+    }
+    if (count <= 0) {
+        fprintf(stderr, "Error: fragments must be positive\n");
+        return -1;
+    }
+
+    if (alloc_fragments(table, count, cfg->fragment_size) == -1) {
+        return -1;
+    }
+    if (cfg->corpus_path != NULL) {
+        if (load_corpus(cfg->corpus_path, table) == -1) {
+            fragments_free(table);
+            return -1;
+        }
+    } else {
+        init_fragments(table);
+    }
+    return 0;
+}
+
+void fragments_free(fragment_table_t *table) {
+    free(table->data);
+    table->data = NULL;
+}
+
+void fingerprint_init(md5_fingerprint_t *fp) {
+    memset(fp->digest, 0, sizeof(fp->digest));
+    fp->count = 0;
+}
+
+void fingerprint_fold(md5_fingerprint_t *fp, const unsigned char *digest) {
+    unsigned char chain[2 * MD5_DIGEST_LENGTH];
+    memcpy(chain, fp->digest, MD5_DIGEST_LENGTH);
+    memcpy(chain + MD5_DIGEST_LENGTH, digest, MD5_DIGEST_LENGTH);
+    calculate_md5((const char *)chain, sizeof(chain), fp->digest);
+    fp->count++;
+}
+
+// Тестовые векторы из RFC 1321, раздел A.5
+static const struct {
+    const char *input;
+    const char *digest;
+} md5_test_vectors[] = {
+    {"", "d41d8cd98f00b204e9800998ecf8427e"},
+    {"a", "0cc175b9c0f1b6a831c399e269772661"},
+    {"abc", "900150983cd24fb0d6963f7d28e17f72"},
+    {"message digest", "f96b697d7cb7938d525a2f31aaf161d0"},
+    {"abcdefghijklmnopqrstuvwxyz", "c3fcd3d76192e4007dfb496cca67e13b"},
+    {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+     "d174ab98d277d9f5a5611c2c9f419d9f"},
+    {"12345678901234567890123456789012345678901234567890123456789012345678901234567890",
+     "57edf4a22be3c955ac49da2e2107b67a"},
+};
+
+int md5_self_test(int verbose) {
+    int failures = 0;
+    size_t count = sizeof(md5_test_vectors) / sizeof(md5_test_vectors[0]);
+    for (size_t i = 0; i < count; i++) {
+        unsigned char md5[MD5_DIGEST_LENGTH];
+        char md5_string[33];
+        calculate_md5(md5_test_vectors[i].input, strlen(md5_test_vectors[i].input), md5);
+        md5_to_string(md5, md5_string);
+        int ok = strcmp(md5_string, md5_test_vectors[i].digest) == 0;
+        if (!ok) {
+            failures++;
+        }
+        if (verbose || !ok) {
+            printf("%s MD5(\"%s\") = %s", ok ? "PASS" : "FAIL", md5_test_vectors[i].input, md5_string);
+            if (!ok) {
+                printf(" (expected %s)", md5_test_vectors[i].digest);
+            }
+            printf("\n");
+        }
+    }
+    return failures;
+}
@@ -0,0 +1,76 @@
+#ifndef CPU_CALC_MD5_WORKLOAD_H
+#define CPU_CALC_MD5_WORKLOAD_H
+
+#include <stddef.h>
+#include <getopt.h>
+#include <openssl/md5.h>
+
+#define FRAGMENTS_COUNT 1000
+#define FRAGMENT_SIZE 64
+#define FRAGMENT_ALIGN 64   // Выравнивание строк таблицы по кэш-линии
+#define MAX_TEXT_SIZE (FRAGMENTS_COUNT * FRAGMENT_SIZE)
+#define BUILTIN_FRAGMENTS 10
+
+// Таблица фрагментов: непрерывный массив, каждая строка начинается
+// с границы кэш-линии (stride кратен FRAGMENT_ALIGN)
+typedef struct {
+    char *data;
+    size_t count;
+    size_t size;    // полезных байт во фрагменте
+    size_t stride;  // шаг между фрагментами в таблице
+} fragment_table_t;
+
+// Параметры построения таблицы фрагментов из командной строки
+typedef struct {
+    const char *corpus_path;
+    long long fragments_count;
+    long long fragment_size;
+    long long working_set;
+    int fragments_set;
+} fragment_config_t;
+
+#define FRAGMENT_CONFIG_DEFAULT { NULL, FRAGMENTS_COUNT, FRAGMENT_SIZE, 0, 0 }
+
+// Общие для однопоточной и многопоточной версии опции таблицы фрагментов
+#define FRAGMENT_LONG_OPTIONS \
+    {"corpus",        required_argument, NULL, 'c'}, \
+    {"fragments",     required_argument, NULL, 'f'}, \
+    {"fragment-size", required_argument, NULL, 's'}, \
+    {"working-set",   required_argument, NULL, 'w'}
+
+// Обработка опции таблицы фрагментов: 1 - опция распознана,
+// 0 - не наша опция, -1 - ошибка в значении
+int fragment_config_option(fragment_config_t *cfg, int opt, const char *arg);
+void fragment_config_usage(void);
+
+// Построение таблицы по конфигурации. Случайные фрагменты берутся из
+// rand(), поэтому srand(seed) должен быть вызван заранее.
+int fragments_setup(fragment_table_t *table, const fragment_config_t *cfg);
+void fragments_free(fragment_table_t *table);
+char *fragment_at(const fragment_table_t *table, size_t idx);
+
+// Состояние генератора для итерации i: тексты итераций не зависят
+// друг от друга, поэтому их можно раздать потокам в любом порядке
+unsigned int iteration_seed(unsigned int seed, unsigned long long iteration);
+
+// Генерация текста итерации из случайных фрагментов. Возвращает длину
+// текста (от MAX_TEXT_SIZE / 2 до MAX_TEXT_SIZE - 1).
+int generate_text(char *buffer, const fragment_table_t *table, unsigned int *state);
+
+void calculate_md5(const char *text, size_t length, unsigned char *result);
+void md5_to_string(unsigned char *md5, char *output);
+
+// Дайджест дайджестов: fp = MD5(fp || digest) по всем итерациям по порядку
+typedef struct {
+    unsigned char digest[MD5_DIGEST_LENGTH];
+    unsigned long long count;
+} md5_fingerprint_t;
+
+void fingerprint_init(md5_fingerprint_t *fp);
+void fingerprint_fold(md5_fingerprint_t *fp, const unsigned char *digest);
+
+// Проверка calculate_md5() на тестовых векторах RFC 1321.
+// Возвращает число несовпадений.
+int md5_self_test(int verbose);
+
+#endif
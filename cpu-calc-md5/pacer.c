@@ -0,0 +1,192 @@
+#define _GNU_SOURCE
+#include "pacer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#define DUTY_PERIOD_NS 100000000LL  // период duty cycle: 100 мс
+
+static long long ts_to_ns(const struct timespec *ts) {
+    return (long long)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static struct timespec ns_to_ts(long long ns) {
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000LL;
+    ts.tv_nsec = ns % 1000000000LL;
+    return ts;
+}
+
+long long pace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts_to_ns(&ts);
+}
+
+// Сон до абсолютного момента времени: дедлайны не накапливают ошибку
+// от задержек пробуждения, в отличие от относительного nanosleep
+static void sleep_until_ns(long long deadline_ns) {
+    struct timespec ts = ns_to_ts(deadline_ns);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+double pace_parse_duration(const char *str) {
+    char *end;
+    double value = strtod(str, &end);
+    if (end == str || value < 0) {
+        return -1;
+    }
+    switch (*end) {
+        case '\0': return value;
+        case 's': break;
+        case 'm': value *= 60.0; break;
+        case 'h': value *= 3600.0; break;
+        default: return -1;
+    }
+    return end[1] == '\0' ? value : -1;
+}
+
+double pace_parse_rate(const char *str) {
+    char *end;
+    double value = strtod(str, &end);
+    if (end == str || *end != '\0' || value < 0) {
+        return -1;
+    }
+    return value;
+}
+
+double pace_parse_fraction(const char *str) {
+    char *end;
+    double value = strtod(str, &end);
+    if (end == str || value <= 0) {
+        return -1;
+    }
+    // Процент - только с '%': "1.5" без него неоднозначно и отвергается
+    if (*end == '%') {
+        end++;
+        value /= 100.0;
+    }
+    return *end == '\0' && value <= 1.0 ? value : -1;
+}
+
+int pace_config_active(const pace_config_t *cfg) {
+    return cfg->duration_s > 0 || cfg->target_mbps > 0 || cfg->duty_cycle < 1.0;
+}
+
+int pace_config_check(const pace_config_t *cfg) {
+    if (cfg->duration_s < 0 || cfg->target_mbps < 0) {
+        fprintf(stderr, "Error: --duration and --target-mbps must be non-negative numbers\n");
+        return -1;
+    }
+    if (cfg->duty_cycle <= 0 || cfg->duty_cycle > 1.0) {
+        fprintf(stderr, "Error: --duty-cycle must be in (0, 1] or (0%%, 100%%]\n");
+        return -1;
+    }
+    if (cfg->interval_s <= 0) {
+        fprintf(stderr, "Error: --report-interval must be positive\n");
+        return -1;
+    }
+    return 0;
+}
+
+void pacer_init(pacer_t *p, const pace_config_t *cfg, double share) {
+    p->cfg = *cfg;
+    p->rate_bps = cfg->target_mbps * 1024.0 * 1024.0 * share;
+    p->bytes = 0;
+    p->busy_ns = 0;
+    pacer_start(p, pace_now_ns());
+}
+
+void pacer_start(pacer_t *p, long long start_ns) {
+    p->start = ns_to_ts(start_ns);
+    p->period_start = p->start;
+    p->work_start_ns = start_ns;
+}
+
+int pacer_account(pacer_t *p, unsigned long long bytes) {
+    long long now = pace_now_ns();
+    long long start = ts_to_ns(&p->start);
+    long long wake = now;
+
+    __atomic_store_n(&p->bytes, p->bytes + bytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&p->busy_ns, p->busy_ns + (now - p->work_start_ns), __ATOMIC_RELAXED);
+
+    // Ограничение скорости: байт должно быть обработано не раньше, чем
+    // start + bytes / rate
+    if (p->rate_bps > 0) {
+        long long due = start + (long long)((double)p->bytes / p->rate_bps * 1e9);
+        if (due > wake) {
+            wake = due;
+        }
+    }
+
+    // Duty cycle: после duty * период работы спим до конца периода
+    if (p->cfg.duty_cycle < 1.0) {
+        long long period = ts_to_ns(&p->period_start);
+        if (now - period >= (long long)(p->cfg.duty_cycle * DUTY_PERIOD_NS)) {
+            long long period_end = period + DUTY_PERIOD_NS;
+            if (period_end > wake) {
+                wake = period_end;
+            }
+            // Если сильно отстали (длинная итерация), начинаем период заново
+            p->period_start = ns_to_ts(wake > period_end ? wake : period_end);
+        }
+    }
+
+    if (p->cfg.duration_s > 0) {
+        long long end = start + (long long)(p->cfg.duration_s * 1e9);
+        if (wake >= end) {
+            if (wake > now && end > now) {
+                sleep_until_ns(end);
+            }
+            return 1;
+        }
+    }
+
+    if (wake > now) {
+        sleep_until_ns(wake);
+        p->work_start_ns = pace_now_ns();
+    } else {
+        p->work_start_ns = now;
+    }
+    return 0;
+}
+
+void pacer_snapshot(const pacer_t *p, unsigned long long *bytes, unsigned long long *busy_ns) {
+    *bytes = __atomic_load_n(&p->bytes, __ATOMIC_RELAXED);
+    *busy_ns = __atomic_load_n(&p->busy_ns, __ATOMIC_RELAXED);
+}
+
+void pace_report_init(pace_report_t *r, long long start_ns) {
+    r->last_ns = start_ns;
+    r->last_bytes = 0;
+    r->last_busy_ns = 0;
+}
+
+void pace_report(pace_report_t *r, const pace_config_t *cfg, long long now_ns, long long start_ns,
+                 unsigned long long bytes, unsigned long long busy_ns, int cores) {
+    double dt = (now_ns - r->last_ns) / 1e9;
+    // Хвост короче десятой части интервала даёт шумную оценку скорости
+    if (dt < cfg->interval_s / 10.0) {
+        return;
+    }
+    double mbps = (double)(bytes - r->last_bytes) / dt / (1024.0 * 1024.0);
+    double duty = (double)(busy_ns - r->last_busy_ns) / 1e9 / dt / cores;
+
+    printf("[%8.2fs] rate %9.2f MB/s", (now_ns - start_ns) / 1e9, mbps);
+    if (cfg->target_mbps > 0) {
+        printf(" (target %.2f MB/s, %6.2f%%)", cfg->target_mbps, mbps / cfg->target_mbps * 100.0);
+    }
+    printf(", busy %6.2f%%", duty * 100.0);
+    if (cfg->duty_cycle < 1.0) {
+        printf(" (target %.2f%%)", cfg->duty_cycle * 100.0);
+    }
+    printf("\n");
+    fflush(stdout);
+
+    r->last_ns = now_ns;
+    r->last_bytes = bytes;
+    r->last_busy_ns = busy_ns;
+}
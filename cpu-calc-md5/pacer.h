@@ -0,0 +1,61 @@
+#ifndef CPU_CALC_MD5_PACER_H
+#define CPU_CALC_MD5_PACER_H
+
+#include <time.h>
+
+// Параметры режима генерации нагрузки
+typedef struct {
+    double duration_s;   // длительность прогона, 0 - по числу итераций
+    double target_mbps;  // целевая скорость хеширования, 0 - без ограничения
+    double duty_cycle;   // доля времени под нагрузкой (0..1], 1 - без пауз
+    double interval_s;   // период вывода отчёта
+} pace_config_t;
+
+// Состояние пейсинга одного рабочего потока. Счётчики bytes/busy_ns
+// пишет только владелец, читать их из другого потока можно через
+// pacer_snapshot().
+typedef struct {
+    pace_config_t cfg;
+    double rate_bps;                 // доля целевой скорости на этот поток
+    struct timespec start;
+    struct timespec period_start;    // начало текущего периода duty cycle
+    long long work_start_ns;         // начало текущего отрезка работы
+    unsigned long long bytes;
+    unsigned long long busy_ns;
+} pacer_t;
+
+// Интервальный отчёт: снимок счётчиков на момент предыдущего вывода
+typedef struct {
+    long long last_ns;
+    unsigned long long last_bytes;
+    unsigned long long last_busy_ns;
+} pace_report_t;
+
+// Разбор "10", "10s", "5m", "1h" в секунды; -1 при ошибке
+double pace_parse_duration(const char *str);
+// Разбор скорости в MB/s без суффиксов; -1 при ошибке
+double pace_parse_rate(const char *str);
+// Разбор доли: "0.4" или "40%" (проценты только с '%'); -1 при ошибке
+double pace_parse_fraction(const char *str);
+
+int pace_config_active(const pace_config_t *cfg);
+int pace_config_check(const pace_config_t *cfg);
+
+long long pace_now_ns(void);
+
+// share - доля target_mbps, которую должен выдать этот пейсер
+void pacer_init(pacer_t *p, const pace_config_t *cfg, double share);
+void pacer_start(pacer_t *p, long long start_ns);
+
+// Учёт выполненной работы и, при необходимости, сон до абсолютного
+// дедлайна. Возвращает 1, когда истекла заданная длительность.
+int pacer_account(pacer_t *p, unsigned long long bytes);
+
+void pacer_snapshot(const pacer_t *p, unsigned long long *bytes, unsigned long long *busy_ns);
+
+void pace_report_init(pace_report_t *r, long long start_ns);
+// Печатает строку отчёта за прошедший интервал; cores - число потоков
+void pace_report(pace_report_t *r, const pace_config_t *cfg, long long now_ns, long long start_ns,
+                 unsigned long long bytes, unsigned long long busy_ns, int cores);
+
+#endif
@@ -0,0 +1,576 @@
+#define _GNU_SOURCE
+#include "ema.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Анализ без изменения файла: файл открывается только на чтение
+// (O_RDONLY, отображение PROT_READ) и за один проход либо считает
+// вхождения заданных значений, либо строит распределение значений.
+//
+// count: каждый прочитанный блок, пока он в кэше, прогоняется векторным
+// ядром подсчёта по каждому значению - файл читается один раз при любом
+// числе значений.
+//
+// histogram: самые частые значения ищутся алгоритмом Misra-Gries - у
+// потока не больше capacity счётчиков, а когда новому значению места нет,
+// все счётчики уменьшаются на единицу. Пока различных значений меньше
+// capacity, счётчики точные; иначе каждый занижен не больше чем на число
+// таких уменьшений, и любое значение с частотой выше elements / capacity
+// гарантированно попадает в итог. Сводки потоков складываются, их
+// погрешности тоже. Распределение по порядку величины точное.
+//
+// Перестроение таблицы при уменьшении стоит O(capacity), но уменьшений
+// не больше elements / (capacity + 1) - в среднем это O(1) на элемент.
+// Проход остаётся скалярным и в разы медленнее count: проба хэш-таблицы
+// на каждый элемент не векторизуется, а векторное ядро корзин упирается
+// в приращение счётчика по каждой дорожке и на замерах не обогнало
+// скалярный цикл. Поэтому и корзина, и проба считаются прямо в цикле
+// блока, без вызова функции на элемент.
+
+#define ANALYZE_CHUNK (64 * 1024)     // mmap и буфер в памяти: байт на вызов ядер
+#define HEAVY_MIN_COUNTERS 4096
+#define HEAVY_COUNTERS_PER_TOP 64
+
+// Таблица Misra-Gries с открытой адресацией; пустой слот - нулевой счётчик
+typedef struct {
+    ema_value_t *keys;
+    unsigned long long *counts;
+    ema_value_count_t *spare;   // выжившие счётчики при уменьшении всех
+    size_t mask;
+    unsigned shift;
+    size_t capacity;
+    size_t used;
+    unsigned long long decrements;
+} heavy_t;
+
+typedef struct {
+    const ema_config_t *cfg;
+    const ema_analysis_t *request;
+    int fd;                     // rw: общий дескриптор
+    const char *map;            // mmap, буфер в памяти
+    off_t start;
+    off_t end;
+    ema_count_fn count;
+    unsigned long long counts[EMA_COUNT_MAX_VALUES];
+    unsigned long long buckets[EMA_VALUE_BUCKETS];
+    unsigned long long elements;
+    heavy_t heavy;
+    ema_stats_t stats;
+    int status;
+} analyze_job_t;
+
+static int heavy_init(heavy_t *h, int top_k) {
+    memset(h, 0, sizeof(*h));
+    h->capacity = (size_t)top_k * HEAVY_COUNTERS_PER_TOP;
+    if (h->capacity < HEAVY_MIN_COUNTERS) {
+        h->capacity = HEAVY_MIN_COUNTERS;
+    }
+    // Заполнение таблицы не выше половины
+    size_t slots = 1;
+    unsigned bits = 0;
+    while (slots < h->capacity * 2) {
+        slots <<= 1;
+        bits++;
+    }
+    h->mask = slots - 1;
+    h->shift = 64 - bits;
+    h->keys = malloc(slots * sizeof(*h->keys));
+    h->counts = calloc(slots, sizeof(*h->counts));
+    h->spare = malloc(h->capacity * sizeof(*h->spare));
+    if (h->keys == NULL || h->counts == NULL || h->spare == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    return 0;
+}
+
+static void heavy_free(heavy_t *h) {
+    free(h->keys);
+    free(h->counts);
+    free(h->spare);
+    memset(h, 0, sizeof(*h));
+}
+
+#define HEAVY_HASH(key, shift) ((size_t)(((ema_value_t)(key) * 0x9E3779B97F4A7C15ULL) >> (shift)))
+
+static inline size_t heavy_slot(const heavy_t *h, ema_value_t key) {
+    return HEAVY_HASH(key, h->shift);
+}
+
+static void heavy_put(heavy_t *h, ema_value_t key, unsigned long long count) {
+    size_t i = heavy_slot(h, key);
+    while (h->counts[i] != 0) {
+        i = (i + 1) & h->mask;
+    }
+    h->keys[i] = key;
+    h->counts[i] = count;
+    h->used++;
+}
+
+// Уменьшение всех счётчиков: обнулившиеся освобождают место, остальные
+// перекладываются заново, чтобы цепочки проб не рвались
+static void heavy_decrement(heavy_t *h) {
+    size_t n = 0;
+    for (size_t i = 0; i <= h->mask; i++) {
+        if (h->counts[i] > 1) {
+            h->spare[n].value = h->keys[i];
+            h->spare[n].count = h->counts[i] - 1;
+            n++;
+        }
+    }
+    memset(h->counts, 0, (h->mask + 1) * sizeof(*h->counts));
+    h->used = 0;
+    for (size_t i = 0; i < n; i++) {
+        heavy_put(h, h->spare[i].value, h->spare[i].count);
+    }
+    h->decrements++;
+}
+
+// Промах пробы: i - пустой слот, на котором она остановилась
+static void heavy_insert(heavy_t *h, size_t i, ema_value_t key) {
+    if (h->used < h->capacity) {
+        h->keys[i] = key;
+        h->counts[i] = 1;
+        h->used++;
+        return;
+    }
+    // Новое значение тоже теряет единицу - его счётчик просто не заводится
+    heavy_decrement(h);
+}
+
+// Корзина порядка e: положительные - BUCKET_POSITIVE + e, отрицательные -
+// BUCKET_NEGATIVE - e
+#define BUCKET_POSITIVE (EMA_BUCKET_ZERO + 1 + EMA_MAGNITUDE_EXPONENTS / 2)
+#define BUCKET_NEGATIVE (EMA_MAGNITUDE_EXPONENTS / 2 - 1)
+#define EXPONENT_MIN (-EMA_MAGNITUDE_EXPONENTS / 2)
+#define EXPONENT_MAX (EMA_MAGNITUDE_EXPONENTS / 2 - 1)
+
+#define BSWAP8(x) (x)
+#define BSWAP16(x) __builtin_bswap16(x)
+#define BSWAP32(x) __builtin_bswap32(x)
+#define BSWAP64(x) __builtin_bswap64(x)
+
+// Попадание в таблицу - проба прямо в цикле блока, с таблицей в локальных
+// переменных: вызов функции на каждый элемент стоил бы дороже самой пробы.
+// Таблица при уменьшении перекладывается на месте, так что указатели
+// остаются верными.
+#define HEAVY_LOCALS(job)                                                                          \
+    heavy_t *h = &(job)->heavy;                                                                    \
+    ema_value_t *keys = h->keys;                                                                   \
+    unsigned long long *counts = h->counts;                                                        \
+    size_t mask = h->mask;                                                                         \
+    unsigned shift = h->shift
+
+#define HEAVY_ADD(key)                                                                             \
+    do {                                                                                           \
+        size_t slot = HEAVY_HASH(key, shift);                                                      \
+        while (counts[slot] != 0 && keys[slot] != (key)) {                                         \
+            slot = (slot + 1) & mask;                                                              \
+        }                                                                                          \
+        if (counts[slot] != 0) {                                                                   \
+            counts[slot]++;                                                                        \
+        } else {                                                                                   \
+            heavy_insert(h, slot, (key));                                                          \
+        }                                                                                          \
+    } while (0)
+
+// Ключ top - биты значения в порядке CPU, корзина - по его величине.
+// Порядок считается прямо в цикле: у целых - номер старшего единичного
+// бита модуля, у плавающих - поле экспоненты (у денормализованных и
+// бесконечностей он за пределами -64..63 и прижимается к краю).
+#define HISTOGRAM_INT(NAME, W, SIGNED)                                                             \
+static void histogram_##NAME(analyze_job_t *job, const void *data, size_t count, int swap) {       \
+    const uint##W##_t *p = data;                                                                   \
+    unsigned long long *buckets = job->buckets;                                                    \
+    HEAVY_LOCALS(job);                                                                             \
+    for (size_t i = 0; i < count; i++) {                                                           \
+        uint##W##_t raw = swap ? BSWAP##W(p[i]) : p[i];                                            \
+        HEAVY_ADD(raw);                                                                            \
+        if (raw == 0) {                                                                            \
+            buckets[EMA_BUCKET_ZERO]++;                                                            \
+        } else if (SIGNED && raw >> (W - 1)) {                                                     \
+            uint##W##_t m = -raw;                                                                  \
+            buckets[BUCKET_NEGATIVE - (63 - __builtin_clzll(m))]++;                                \
+        } else {                                                                                   \
+            buckets[BUCKET_POSITIVE + (63 - __builtin_clzll(raw))]++;                              \
+        }                                                                                          \
+    }                                                                                              \
+}
+
+#define HISTOGRAM_FLOAT(NAME, W, MANT_BITS, EXP_MASK, BIAS)                                        \
+static void histogram_##NAME(analyze_job_t *job, const void *data, size_t count, int swap) {       \
+    const uint##W##_t *p = data;                                                                   \
+    const uint##W##_t sign = (uint##W##_t)1 << (W - 1);                                            \
+    const uint##W##_t inf = (uint##W##_t)EXP_MASK << MANT_BITS;                                    \
+    unsigned long long *buckets = job->buckets;                                                    \
+    HEAVY_LOCALS(job);                                                                             \
+    for (size_t i = 0; i < count; i++) {                                                           \
+        uint##W##_t raw = swap ? BSWAP##W(p[i]) : p[i];                                            \
+        uint##W##_t abs = raw & ~sign;                                                             \
+        HEAVY_ADD(raw);                                                                            \
+        if (abs == 0) {                                                                            \
+            buckets[EMA_BUCKET_ZERO]++;                                                            \
+            continue;                                                                              \
+        }                                                                                          \
+        if (abs > inf) {                                                                           \
+            buckets[EMA_BUCKET_NAN]++;                                                             \
+            continue;                                                                              \
+        }                                                                                          \
+        int e = (int)(abs >> MANT_BITS) - BIAS;                                                    \
+        e = e < EXPONENT_MIN ? EXPONENT_MIN : e > EXPONENT_MAX ? EXPONENT_MAX : e;                 \
+        buckets[raw & sign ? BUCKET_NEGATIVE - e : BUCKET_POSITIVE + e]++;                         \
+    }                                                                                              \
+}
+
+HISTOGRAM_INT(i8, 8, 1)
+HISTOGRAM_INT(i16, 16, 1)
+HISTOGRAM_INT(i32, 32, 1)
+HISTOGRAM_INT(i64, 64, 1)
+HISTOGRAM_INT(u8, 8, 0)
+HISTOGRAM_INT(u16, 16, 0)
+HISTOGRAM_INT(u32, 32, 0)
+HISTOGRAM_INT(u64, 64, 0)
+HISTOGRAM_FLOAT(f32, 32, 23, 0xff, 127)
+HISTOGRAM_FLOAT(f64, 64, 52, 0x7ff, 1023)
+
+typedef void (*histogram_fn)(analyze_job_t *job, const void *data, size_t count, int swap);
+
+static const histogram_fn histogram_fns[EMA_TYPE_COUNT] = {
+    [EMA_TYPE_I8] = histogram_i8,
+    [EMA_TYPE_I16] = histogram_i16,
+    [EMA_TYPE_I32] = histogram_i32,
+    [EMA_TYPE_I64] = histogram_i64,
+    [EMA_TYPE_U8] = histogram_u8,
+    [EMA_TYPE_U16] = histogram_u16,
+    [EMA_TYPE_U32] = histogram_u32,
+    [EMA_TYPE_U64] = histogram_u64,
+    [EMA_TYPE_F32] = histogram_f32,
+    [EMA_TYPE_F64] = histogram_f64,
+};
+
+static void analyze_block(analyze_job_t *job, const void *data, size_t count) {
+    const ema_analysis_t *request = job->request;
+    if (request->mode == EMA_ANALYZE_COUNT) {
+        for (int v = 0; v < request->n_values; v++) {
+            job->counts[v] += job->count(data, count, request->values[v]);
+        }
+    } else {
+        histogram_fns[job->cfg->type](job, data, count, job->cfg->swap);
+    }
+    job->elements += count;
+}
+
+static int analyze_rw(analyze_job_t *job) {
+    const ema_config_t *cfg = job->cfg;
+    size_t block = cfg->block_size ? cfg->block_size : BUFFER_SIZE;
+    size_t elem = ema_type_size(cfg->type);
+    void *buffer = ema_alloc_block(block);
+    if (buffer == NULL) {
+        return -1;
+    }
+    int status = 0;
+    for (off_t offset = job->start; offset < job->end; offset += block) {
+        size_t len = (size_t)(job->end - offset) < block ? (size_t)(job->end - offset) : block;
+        ssize_t bytes = pread(job->fd, buffer, ema_io_length(len, cfg), offset);
+        job->stats.read_calls++;
+        if (bytes == -1) {
+            perror("pread");
+            status = -1;
+            break;
+        }
+        if ((size_t)bytes < len) {
+            len = bytes;  // файл укоротили во время прохода
+        }
+        job->stats.bytes_read += len;
+        analyze_block(job, buffer, len / elem);
+        if (len < block) {
+            break;
+        }
+    }
+    free(buffer);
+    return status;
+}
+
+static void analyze_map(analyze_job_t *job) {
+    size_t elem = ema_type_size(job->cfg->type);
+    for (off_t offset = job->start; offset < job->end; offset += ANALYZE_CHUNK) {
+        size_t len = job->end - offset < ANALYZE_CHUNK ? (size_t)(job->end - offset) : ANALYZE_CHUNK;
+        job->stats.bytes_read += len;
+        analyze_block(job, job->map + offset, len / elem);
+    }
+}
+
+static void *analyze_worker(void *arg) {
+    analyze_job_t *job = (analyze_job_t *)arg;
+    if (job->request->mode == EMA_ANALYZE_HISTOGRAM && heavy_init(&job->heavy, job->request->top_k) == -1) {
+        job->status = -1;
+        return NULL;
+    }
+    if (job->map != NULL) {
+        analyze_map(job);
+    } else {
+        job->status = analyze_rw(job);
+    }
+    return NULL;
+}
+
+static int compare_by_value(const void *a, const void *b) {
+    ema_value_t x = ((const ema_value_count_t *)a)->value;
+    ema_value_t y = ((const ema_value_count_t *)b)->value;
+    return x < y ? -1 : x > y;
+}
+
+// Чаще - раньше; при равенстве по значению, чтобы итог не зависел от потоков
+static int compare_by_count(const void *a, const void *b) {
+    const ema_value_count_t *x = a;
+    const ema_value_count_t *y = b;
+    if (x->count != y->count) {
+        return x->count > y->count ? -1 : 1;
+    }
+    return compare_by_value(a, b);
+}
+
+// Сложение сводок потоков и выбор top_k самых частых
+static int merge_top(analyze_job_t *jobs, int threads, ema_analysis_t *analysis) {
+    size_t total = 0;
+    for (int t = 0; t < threads; t++) {
+        total += jobs[t].heavy.used;
+        analysis->max_error += jobs[t].heavy.decrements;
+    }
+    ema_value_count_t *all = malloc((total ? total : 1) * sizeof(*all));
+    if (all == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    size_t n = 0;
+    for (int t = 0; t < threads; t++) {
+        const heavy_t *h = &jobs[t].heavy;
+        for (size_t i = 0; h->counts != NULL && i <= h->mask; i++) {
+            if (h->counts[i] != 0) {
+                all[n].value = h->keys[i];
+                all[n].count = h->counts[i];
+                n++;
+            }
+        }
+    }
+    qsort(all, n, sizeof(*all), compare_by_value);
+    size_t distinct = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (distinct > 0 && all[distinct - 1].value == all[i].value) {
+            all[distinct - 1].count += all[i].count;
+        } else {
+            all[distinct++] = all[i];
+        }
+    }
+    qsort(all, distinct, sizeof(*all), compare_by_count);
+    analysis->n_top = distinct < (size_t)analysis->top_k ? (int)distinct : analysis->top_k;
+    memcpy(analysis->top, all, analysis->n_top * sizeof(*all));
+    free(all);
+    return 0;
+}
+
+int ema_analyze_pass(const char *filename, const ema_config_t *cfg, ema_analysis_t *analysis, ema_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    memset(analysis->counts, 0, sizeof(analysis->counts));
+    memset(analysis->buckets, 0, sizeof(analysis->buckets));
+    analysis->elements = 0;
+    analysis->n_top = 0;
+    analysis->max_error = 0;
+
+    int threads = cfg->threads > 0 ? cfg->threads : 1;
+    int fd = -1;
+    char *map = NULL;
+    size_t size = 0;
+    size_t align = sysconf(_SC_PAGESIZE);
+
+    if (cfg->memory != NULL) {
+        map = (char *)cfg->memory->data;
+        size = cfg->memory->size;
+    } else {
+        fd = open(filename, O_RDONLY | (cfg->direct ? O_DIRECT : 0));
+        stats->other_calls++;
+        if (fd == -1) {
+            if (cfg->direct && errno == EINVAL) {
+                fprintf(stderr, "open: O_DIRECT is not supported by the filesystem of %s\n", filename);
+            } else {
+                perror("open");
+            }
+            return -1;
+        }
+        struct stat st;
+        stats->other_calls++;
+        if (fstat(fd, &st) == -1) {
+            perror("fstat");
+            close(fd);
+            return -1;
+        }
+        size = st.st_size;
+        if (cfg->engine == EMA_ENGINE_MMAP && size > 0) {
+            map = mmap(NULL, size, PROT_READ, MAP_SHARED | (cfg->mmap_populate ? MAP_POPULATE : 0), fd, 0);
+            stats->other_calls++;
+            if (map == MAP_FAILED) {
+                perror("mmap");
+                close(fd);
+                return -1;
+            }
+            madvise(map, size, MADV_SEQUENTIAL);
+            stats->other_calls++;
+        } else if (cfg->engine != EMA_ENGINE_MMAP) {
+            align = cfg->block_size ? cfg->block_size : BUFFER_SIZE;
+        }
+    }
+
+    // Диапазоны потоков выровнены по блоку или странице, поэтому элементы
+    // не разрезаются границами
+    size_t chunk = (size + threads - 1) / threads;
+    chunk = (chunk + align - 1) / align * align;
+
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    analyze_job_t *jobs = calloc(threads, sizeof(analyze_job_t));
+    int status = 0;
+    if (tids == NULL || jobs == NULL) {
+        perror("malloc");
+        status = -1;
+        goto out;
+    }
+
+    ema_count_fn count = ema_count_kernel_fn(cfg->kernel, cfg->type, cfg->swap);
+    int started = 0;
+    for (int t = 0; t < threads; t++) {
+        jobs[t].cfg = cfg;
+        jobs[t].request = analysis;
+        jobs[t].fd = fd;
+        jobs[t].map = map;
+        jobs[t].count = count;
+        jobs[t].start = (off_t)t * (off_t)chunk < (off_t)size ? (off_t)t * (off_t)chunk : (off_t)size;
+        jobs[t].end = jobs[t].start + (off_t)chunk < (off_t)size ? jobs[t].start + (off_t)chunk : (off_t)size;
+        if (pthread_create(&tids[t], NULL, analyze_worker, &jobs[t]) != 0) {
+            perror("pthread_create");
+            status = -1;
+            break;
+        }
+        started++;
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+        ema_stats_add(stats, &jobs[t].stats);
+        if (jobs[t].status == -1) {
+            status = -1;
+        }
+        for (int v = 0; v < analysis->n_values; v++) {
+            analysis->counts[v] += jobs[t].counts[v];
+            stats->matches += jobs[t].counts[v];
+        }
+        for (int b = 0; b < EMA_VALUE_BUCKETS; b++) {
+            analysis->buckets[b] += jobs[t].buckets[b];
+        }
+        analysis->elements += jobs[t].elements;
+    }
+    if (status == 0 && analysis->mode == EMA_ANALYZE_HISTOGRAM) {
+        status = merge_top(jobs, started, analysis);
+    }
+    for (int t = 0; jobs != NULL && t < threads; t++) {
+        heavy_free(&jobs[t].heavy);
+    }
+
+out:
+    free(tids);
+    free(jobs);
+    if (cfg->memory != NULL) {
+        return status;
+    }
+    if (map != NULL) {
+        munmap(map, size);
+        stats->other_calls++;
+    }
+    close(fd);
+    stats->other_calls++;
+    return status;
+}
+
+int ema_analysis_equal(const ema_analysis_t *a, const ema_analysis_t *b) {
+    if (a->elements != b->elements || memcmp(a->counts, b->counts, sizeof(a->counts)) != 0 ||
+        memcmp(a->buckets, b->buckets, sizeof(a->buckets)) != 0) {
+        return 0;
+    }
+    // Приближённые счётчики зависят от разбиения на потоки
+    if (a->max_error != 0 || b->max_error != 0) {
+        return 1;
+    }
+    return a->n_top == b->n_top && memcmp(a->top, b->top, a->n_top * sizeof(a->top[0])) == 0;
+}
+
+static double percent(unsigned long long part, unsigned long long total) {
+    return total > 0 ? 100.0 * part / total : 0.0;
+}
+
+// Границы корзины порядка e: [2^e, 2^(e+1)) по модулю
+static void print_bucket(unsigned b, unsigned long long count, unsigned long long total, const ema_config_t *cfg) {
+    char range[96];
+    int is_float = cfg->type == EMA_TYPE_F32 || cfg->type == EMA_TYPE_F64;
+    if (b == EMA_BUCKET_ZERO) {
+        snprintf(range, sizeof(range), "0");
+    } else if (b == EMA_BUCKET_NAN) {
+        snprintf(range, sizeof(range), "NaN");
+    } else {
+        int negative = b < EMA_BUCKET_ZERO;
+        int index = negative ? EMA_MAGNITUDE_EXPONENTS - 1 - (int)b : (int)b - EMA_BUCKET_ZERO - 1;
+        int e = index - EMA_MAGNITUDE_EXPONENTS / 2;
+        if (is_float) {
+            const char *low_str = e == -EMA_MAGNITUDE_EXPONENTS / 2 ? "0" : NULL;
+            char low[32], high[32];
+            snprintf(low, sizeof(low), "%g", ldexp(1.0, e));
+            snprintf(high, sizeof(high), e == EMA_MAGNITUDE_EXPONENTS / 2 - 1 ? "inf]" : "%g)",
+                     ldexp(1.0, e + 1));
+            snprintf(range, sizeof(range), "%s[%s, %s", negative ? "-" : "",
+                     low_str != NULL ? low_str : low, high);
+        } else if (negative) {
+            long long high = e == 63 ? INT64_MIN : -(long long)((1ULL << (e + 1)) - 1);
+            snprintf(range, sizeof(range), "%lld..%lld", high, -(long long)(1ULL << e));
+        } else {
+            unsigned long long high = e == 63 ? UINT64_MAX : (1ULL << (e + 1)) - 1;
+            snprintf(range, sizeof(range), "%llu..%llu", 1ULL << e, high);
+        }
+    }
+    printf("  %-44s %14llu %7.3f%%\n", range, count, percent(count, total));
+}
+
+void ema_analysis_print(const ema_analysis_t *analysis, const ema_config_t *cfg) {
+    char value[64];
+    if (analysis->mode == EMA_ANALYZE_COUNT) {
+        printf("Value counts (%llu elements):\n", analysis->elements);
+        for (int v = 0; v < analysis->n_values; v++) {
+            ema_value_format(analysis->values[v], cfg->type, value, sizeof(value));
+            printf("  %-24s %14llu %7.3f%%\n", value, analysis->counts[v],
+                   percent(analysis->counts[v], analysis->elements));
+        }
+        return;
+    }
+
+    printf("Top %d values (%llu elements, ", analysis->top_k, analysis->elements);
+    if (analysis->max_error == 0) {
+        printf("exact counts):\n");
+    } else {
+        printf("approximate: each count may be low by up to %llu):\n", analysis->max_error);
+    }
+    for (int i = 0; i < analysis->n_top; i++) {
+        ema_value_format(analysis->top[i].value, cfg->type, value, sizeof(value));
+        printf("  %4d. %-24s %14llu %7.3f%%\n", i + 1, value, analysis->top[i].count,
+               percent(analysis->top[i].count, analysis->elements));
+    }
+    printf("Distribution by magnitude (power-of-two buckets):\n");
+    for (unsigned b = 0; b < EMA_VALUE_BUCKETS; b++) {
+        if (analysis->buckets[b] != 0) {
+            print_bucket(b, analysis->buckets[b], analysis->elements, cfg);
+        }
+    }
+}
@@ -0,0 +1,287 @@
+#define _GNU_SOURCE
+#include "ema.h"
+#include "instrument.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <glob.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+// Пакетный режим: много файлов в одном процессе. Пул из workers потоков
+// разбирает файлы из общей очереди (атомарный индекс), каждый файл целиком
+// проходится одним потоком. Состояние движка живёт в потоке и
+// переиспользуется: буфер блока rw, кольцо uring с зарегистрированными
+// буферами (меняется только зарегистрированный файл). Отображение mmap
+// привязано к файлу и создаётся заново.
+// Ошибка в одном файле отмечается в его итогах и не останавливает пакет.
+
+typedef struct {
+    ema_batch_t *batch;
+    const ema_config_t *cfg;
+    int iterations;
+    size_t *next;               // следующий необработанный файл
+    void *buffer;               // rw
+    ema_uring_t *ring;          // uring: создаётся при первом файле
+} batch_worker_t;
+
+static int add_file(ema_batch_t *batch, size_t *capacity, const char *path) {
+    struct stat st;
+    if (stat(path, &st) == -1) {
+        perror(path);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        return 0;
+    }
+    if (batch->count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 64;
+        ema_batch_file_t *files = realloc(batch->files, grown * sizeof(*files));
+        if (files == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        batch->files = files;
+        *capacity = grown;
+    }
+    ema_batch_file_t *file = &batch->files[batch->count];
+    memset(file, 0, sizeof(*file));
+    file->path = strdup(path);
+    if (file->path == NULL) {
+        perror("strdup");
+        return -1;
+    }
+    file->size = st.st_size;
+    batch->count++;
+    return 0;
+}
+
+static int collect_list(const char *list, ema_batch_t *batch, size_t *capacity) {
+    FILE *f = fopen(list, "r");
+    if (f == NULL) {
+        perror(list);
+        return -1;
+    }
+    char *line = NULL;
+    size_t len = 0;
+    int status = 0;
+    while (status == 0 && getline(&line, &len, f) != -1) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0' && line[0] != '#') {
+            status = add_file(batch, capacity, line);
+        }
+    }
+    free(line);
+    fclose(f);
+    return status;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(((const ema_batch_file_t *)a)->path, ((const ema_batch_file_t *)b)->path);
+}
+
+static int collect_dir(const char *dir, ema_batch_t *batch, size_t *capacity) {
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        perror(dir);
+        return -1;
+    }
+    int status = 0;
+    struct dirent *entry;
+    while (status == 0 && (entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        char path[4096];
+        if (snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name) >= (int)sizeof(path)) {
+            fprintf(stderr, "Error: path too long in %s\n", dir);
+            status = -1;
+            break;
+        }
+        status = add_file(batch, capacity, path);
+    }
+    closedir(d);
+    qsort(batch->files, batch->count, sizeof(*batch->files), compare_paths);
+    return status;
+}
+
+static int collect_glob(const char *pattern, ema_batch_t *batch, size_t *capacity) {
+    glob_t g;
+    int err = glob(pattern, 0, NULL, &g);
+    if (err == GLOB_NOMATCH) {
+        return 0;
+    }
+    if (err != 0) {
+        fprintf(stderr, "glob: cannot expand '%s'\n", pattern);
+        return -1;
+    }
+    int status = 0;
+    for (size_t i = 0; i < g.gl_pathc && status == 0; i++) {
+        status = add_file(batch, capacity, g.gl_pathv[i]);
+    }
+    globfree(&g);
+    return status;
+}
+
+int ema_batch_collect(const char *source, ema_batch_t *batch) {
+    memset(batch, 0, sizeof(*batch));
+    size_t capacity = 0;
+    struct stat st;
+    int status;
+    if (source[0] == '@') {
+        status = collect_list(source + 1, batch, &capacity);
+    } else if (stat(source, &st) == 0 && S_ISDIR(st.st_mode)) {
+        status = collect_dir(source, batch, &capacity);
+    } else {
+        status = collect_glob(source, batch, &capacity);
+    }
+    if (status == 0 && batch->count == 0) {
+        fprintf(stderr, "Error: no regular files in '%s'\n", source);
+        status = -1;
+    }
+    if (status == -1) {
+        ema_batch_free(batch);
+    }
+    return status;
+}
+
+void ema_batch_free(ema_batch_t *batch) {
+    for (size_t i = 0; i < batch->count; i++) {
+        free(batch->files[i].path);
+    }
+    free(batch->files);
+    batch->files = NULL;
+    batch->count = 0;
+}
+
+// Один проход по файлу с состоянием потока
+static int batch_pass(batch_worker_t *w, const char *path, const ema_config_t *cfg, ema_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (cfg->engine == EMA_ENGINE_MMAP) {
+        return replace_in_file_mmap(path, cfg, stats);
+    }
+    int fd = ema_open_data(path, cfg, stats);
+    if (fd == -1) {
+        return -1;
+    }
+    int status;
+    if (cfg->engine == EMA_ENGINE_URING) {
+        struct stat st;
+        stats->other_calls++;
+        if (fstat(fd, &st) == -1) {
+            perror("fstat");
+            status = -1;
+        } else {
+            if (w->ring == NULL) {
+                w->ring = ema_uring_create(cfg, stats);
+            }
+            status = w->ring == NULL ? -1 : ema_uring_attach(w->ring, fd, stats);
+            if (status == 0) {
+                status = ema_uring_run(w->ring, fd, 0, st.st_size, cfg, stats);
+            }
+            if (status == -1 && w->ring != NULL) {
+                // В кольце могли остаться операции - следующему файлу новое
+                ema_uring_destroy(w->ring, stats);
+                w->ring = NULL;
+            }
+        }
+    } else {
+        status = ema_rw_range(fd, 0, -1, w->buffer, cfg, stats);
+    }
+    close(fd);
+    stats->other_calls++;
+    return status;
+}
+
+static void *batch_worker(void *arg) {
+    batch_worker_t *w = (batch_worker_t *)arg;
+    ema_batch_t *batch = w->batch;
+    while (1) {
+        size_t idx = __atomic_fetch_add(w->next, 1, __ATOMIC_RELAXED);
+        if (idx >= batch->count) {
+            break;
+        }
+        ema_batch_file_t *file = &batch->files[idx];
+        ema_config_t cfg = *w->cfg;
+        unsigned long long start = get_time_ns();
+        for (int i = 0; i < w->iterations; i++) {
+            ema_stats_t stats;
+            file->status = batch_pass(w, file->path, &cfg, &stats);
+            if (file->status == 0) {
+                file->status = ema_sync_pass_end(file->path, &cfg, &stats);
+            }
+            ema_stats_add(&file->stats, &stats);
+            if (file->status == -1) {
+                break;
+            }
+            // Как и в серии итераций одного файла: дальше замена в обе стороны
+            if (i == 0 && cfg.rules == NULL) {
+                ema_value_t temp = cfg.search_value;
+                cfg.search_value = cfg.replace_value;
+                cfg.replace_value = temp;
+            }
+        }
+        file->elapsed_ns = get_time_ns() - start;
+        ema_histogram_record(&batch->latency, file->elapsed_ns);
+    }
+    return NULL;
+}
+
+int ema_batch_run(ema_batch_t *batch, const ema_config_t *cfg, int workers, int iterations) {
+    if ((size_t)workers > batch->count) {
+        workers = (int)batch->count;
+    }
+    memset(&batch->latency, 0, sizeof(batch->latency));
+    pthread_t *tids = malloc(sizeof(pthread_t) * workers);
+    batch_worker_t *pool = calloc(workers, sizeof(batch_worker_t));
+    if (tids == NULL || pool == NULL) {
+        perror("malloc");
+        free(tids);
+        free(pool);
+        return -1;
+    }
+
+    size_t next = 0;
+    int status = 0;
+    int started = 0;
+    for (int t = 0; t < workers; t++) {
+        pool[t].batch = batch;
+        pool[t].cfg = cfg;
+        pool[t].iterations = iterations;
+        pool[t].next = &next;
+        if (cfg->engine != EMA_ENGINE_MMAP) {
+            pool[t].buffer = ema_alloc_block(cfg->block_size ? cfg->block_size : BUFFER_SIZE);
+            if (pool[t].buffer == NULL) {
+                status = -1;
+                break;
+            }
+        }
+        if (pthread_create(&tids[t], NULL, batch_worker, &pool[t]) != 0) {
+            perror("pthread_create");
+            free(pool[t].buffer);
+            status = -1;
+            break;
+        }
+        started++;
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+        free(pool[t].buffer);
+        ema_stats_t teardown;
+        memset(&teardown, 0, sizeof(teardown));
+        ema_uring_destroy(pool[t].ring, &teardown);
+    }
+    free(tids);
+    free(pool);
+
+    for (size_t i = 0; i < batch->count && status == 0; i++) {
+        if (batch->files[i].status == -1) {
+            status = -1;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,57 @@
+#define _GNU_SOURCE
+#include "ema.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Холодный старт: грязные страницы сначала сбрасываются на диск, иначе
+// POSIX_FADV_DONTNEED их не вытеснит и следующая итерация прочитает
+// файл из памяти.
+int ema_drop_cache(const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        perror("open");
+        return -1;
+    }
+    int status = 0;
+    if (fdatasync(fd) == -1) {
+        perror("fdatasync");
+        status = -1;
+    }
+    int err = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    if (err != 0) {
+        fprintf(stderr, "posix_fadvise: %s\n", strerror(err));
+        status = -1;
+    }
+    close(fd);
+    return status;
+}
+
+// Тёплый старт: файл целиком читается в page cache до замера
+int ema_warm_cache(const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        perror("open");
+        return -1;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    size_t size = MAX_BLOCK_SIZE / 16;
+    void *buffer = ema_alloc_block(size);
+    int status = buffer != NULL ? 0 : -1;
+    while (buffer != NULL) {
+        ssize_t bytes = read(fd, buffer, size);
+        if (bytes <= 0) {
+            if (bytes == -1) {
+                perror("read");
+                status = -1;
+            }
+            break;
+        }
+    }
+    free(buffer);
+    close(fd);
+    return status;
+}
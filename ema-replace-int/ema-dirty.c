@@ -0,0 +1,88 @@
+#define _GNU_SOURCE
+#include "ema.h"
+
+#include <string.h>
+
+// Учёт изменённых участков блока, чтобы записывать обратно не весь блок,
+// а только грязные страницы или элементы.
+//
+// Блок сканируется по страницам. Для гранулярности int (элемента любого
+// типа) страница перед сканированием копируется, и изменённые элементы
+// находятся сравнением с копией: ядра (и набор правил) возвращают только
+// число замен.
+
+static const char *dirty_names[EMA_DIRTY_COUNT] = {
+    [EMA_DIRTY_BLOCK] = "block",
+    [EMA_DIRTY_PAGE] = "page",
+    [EMA_DIRTY_INT] = "int",
+};
+
+const char *ema_dirty_name(ema_dirty_t dirty) {
+    return dirty < EMA_DIRTY_COUNT ? dirty_names[dirty] : "?";
+}
+
+int ema_dirty_parse(const char *name, ema_dirty_t *dirty) {
+    for (int i = 0; i < EMA_DIRTY_COUNT; i++) {
+        if (strcmp(name, dirty_names[i]) == 0) {
+            *dirty = (ema_dirty_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Добавление участка со слиянием смежных. Когда массив заполнен,
+// последний участок растягивается до нового: пишется больше, но ни одно
+// изменение не теряется.
+static void add_range(ema_range_t *ranges, size_t max_ranges, size_t *n, size_t begin, size_t end) {
+    if (*n > 0 && (ranges[*n - 1].end == begin || *n == max_ranges)) {
+        ranges[*n - 1].end = end;
+        return;
+    }
+    ranges[*n].begin = begin;
+    ranges[*n].end = end;
+    (*n)++;
+}
+
+size_t ema_scan_dirty(const ema_config_t *cfg, ema_scan_fn scan, void *data, size_t len, off_t offset,
+                      ema_range_t *ranges, size_t max_ranges, size_t *n_ranges) {
+    size_t elem = ema_type_size(cfg->type);
+    size_t count = len / elem;
+    char *bytes = data;
+    *n_ranges = 0;
+    if (cfg->dirty == EMA_DIRTY_BLOCK) {
+        size_t found = ema_scan_block(cfg, scan, data, count, offset);
+        if (found > 0) {
+            add_range(ranges, max_ranges, n_ranges, 0, len);
+        }
+        return found;
+    }
+
+    const size_t page_elems = EMA_DIRTY_PAGE_SIZE / elem;
+    char before[EMA_DIRTY_PAGE_SIZE];
+    size_t matches = 0;
+    for (size_t i = 0; i < count; i += page_elems) {
+        size_t n = count - i < page_elems ? count - i : page_elems;
+        char *page = bytes + i * elem;
+        if (cfg->dirty == EMA_DIRTY_INT) {
+            memcpy(before, page, n * elem);
+        }
+        size_t found = ema_scan_block(cfg, scan, page, n, offset + (off_t)(i * elem));
+        if (found == 0) {
+            continue;
+        }
+        matches += found;
+        if (cfg->dirty == EMA_DIRTY_PAGE) {
+            // Последняя страница блока забирает и обрывок элемента в хвосте
+            size_t end = (i + n == count) ? len : (i + n) * elem;
+            add_range(ranges, max_ranges, n_ranges, i * elem, end);
+            continue;
+        }
+        for (size_t j = 0; j < n; j++) {
+            if (memcmp(page + j * elem, before + j * elem, elem) != 0) {
+                add_range(ranges, max_ranges, n_ranges, (i + j) * elem, (i + j + 1) * elem);
+            }
+        }
+    }
+    return matches;
+}
@@ -0,0 +1,104 @@
+#define _GNU_SOURCE
+#include "ema.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char *engine_names[EMA_ENGINE_COUNT] = {
+    [EMA_ENGINE_RW] = "rw",
+    [EMA_ENGINE_MMAP] = "mmap",
+    [EMA_ENGINE_URING] = "uring",
+};
+
+const char *ema_engine_name(ema_engine_t engine) {
+    return engine < EMA_ENGINE_COUNT ? engine_names[engine] : "?";
+}
+
+unsigned long long ema_stats_syscalls(const ema_stats_t *stats) {
+    return stats->read_calls + stats->write_calls + stats->other_calls;
+}
+
+void ema_stats_add(ema_stats_t *total, const ema_stats_t *part) {
+    total->matches += part->matches;
+    total->bytes_read += part->bytes_read;
+    total->bytes_written += part->bytes_written;
+    total->read_calls += part->read_calls;
+    total->write_calls += part->write_calls;
+    total->other_calls += part->other_calls;
+    total->ops += part->ops;
+    total->rmw_ops += part->rmw_ops;
+    total->read_matches += part->read_matches;
+    total->write_ns += part->write_ns;
+    total->sync_ns += part->sync_ns;
+    total->bytes_skipped += part->bytes_skipped;
+    total->bytes_pruned += part->bytes_pruned;
+}
+
+void *ema_alloc_block(size_t size) {
+    void *block = NULL;
+    int err = posix_memalign(&block, sysconf(_SC_PAGESIZE), size);
+    if (err != 0) {
+        fprintf(stderr, "posix_memalign: %s\n", strerror(err));
+        return NULL;
+    }
+    return block;
+}
+
+int ema_open_data(const char *filename, const ema_config_t *cfg, ema_stats_t *stats) {
+    int fd = open(filename, O_RDWR | (cfg->direct ? O_DIRECT : 0) | ema_sync_open_flags(cfg));
+    stats->other_calls++;
+    if (fd == -1) {
+        if (cfg->direct && errno == EINVAL) {
+            fprintf(stderr, "open: O_DIRECT is not supported by the filesystem of %s\n", filename);
+        } else {
+            perror("open");
+        }
+    }
+    return fd;
+}
+
+// O_DIRECT требует длину, кратную логическому блоку устройства. Хвост
+// файла читается целым выровненным блоком (ядро вернёт короткое чтение),
+// а пишется с дополнением и последующим ftruncate до прежнего размера.
+size_t ema_io_length(size_t len, const ema_config_t *cfg) {
+    if (!cfg->direct) {
+        return len;
+    }
+    return (len + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+}
+
+int ema_engine_parse(const char *name, ema_engine_t *engine) {
+    for (int i = 0; i < EMA_ENGINE_COUNT; i++) {
+        if (strcmp(name, engine_names[i]) == 0) {
+            *engine = (ema_engine_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int ema_run_pass(const char *filename, const ema_config_t *cfg, ema_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (cfg->memory != NULL) {
+        return ema_memory_pass(cfg, stats);
+    }
+    if (cfg->pattern != EMA_PATTERN_NONE) {
+        return ema_pattern_pass(filename, cfg, stats);
+    }
+    if (cfg->threads > 1) {
+        return ema_run_parallel(filename, cfg, stats);
+    }
+    switch (cfg->engine) {
+        case EMA_ENGINE_MMAP:
+            return replace_in_file_mmap(filename, cfg, stats);
+        case EMA_ENGINE_URING:
+            return replace_in_file_uring(filename, cfg, stats);
+        case EMA_ENGINE_RW:
+        default:
+            return replace_in_file(filename, cfg, stats);
+    }
+}
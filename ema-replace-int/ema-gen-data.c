@@ -1,64 +1,166 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
-#include <fcntl.h>
-#include <unistd.h>
-#include <time.h>
+#include <string.h>
+#include <getopt.h>
 
-#define BUFFER_SIZE (4096)
+#include "instrument.h"
+#include "parse.h"
+#include "ema.h"
+#include "ema-gen.h"
+
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <file> <size_mb> <seed>\n", prog);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --block-size <size>     write block size, 4K..64M, multiple of 4K (default: 4M)\n");
+    fprintf(stderr, "  --threads <n>           generator threads; output does not depend on it (default: 1)\n");
+    fprintf(stderr, "  --density <f>[%%]        fraction of ints set to the planted value (default: 0)\n");
+    fprintf(stderr, "  --value <v>             planted value (default: 0)\n");
+    fprintf(stderr, "  --distribution <name>   background values (default: uniform):\n");
+    fprintf(stderr, "                          uniform - uniform over 0..2^31-1\n");
+    fprintf(stderr, "                          zipf - 0..distinct-1, value k has weight 1/(k+1)^s\n");
+    fprintf(stderr, "                          few - uniform over 0..distinct-1\n");
+    fprintf(stderr, "  --distinct <n>          zipf/few: number of distinct background values (default: 1000)\n");
+    fprintf(stderr, "  --zipf-exponent <s>     zipf: exponent s (default: 1.0)\n");
+    fprintf(stderr, "  --sparse <f>[%%]         fraction of hole-size extents left as holes (default: 0)\n");
+    fprintf(stderr, "  --hole-size <size>      sparse: extent size, multiple of 4K (default: 1M)\n");
+}
+
+// Доля "0.01" или процент "1%"
+static int parse_density(const char *str, double *density) {
+    char *end;
+    double value = strtod(str, &end);
+    if (end == str) {
+        return -1;
+    }
+    if (*end == '%') {
+        value /= 100.0;
+        end++;
+    }
+    if (*end != '\0' || value < 0.0 || value > 1.0) {
+        return -1;
+    }
+    *density = value;
+    return 0;
+}
 
 int main(int argc, char *argv[]) {
-    if (argc < 4) {
-        fprintf(stderr, "Usage: %s <file> <size_mb> <seed>\n", argv[0]);
+    ema_gen_config_t cfg = EMA_GEN_CONFIG_DEFAULT;
+
+    static const struct option long_options[] = {
+        {"block-size",    required_argument, NULL, 'b'},
+        {"threads",       required_argument, NULL, 't'},
+        {"density",       required_argument, NULL, 'd'},
+        {"value",         required_argument, NULL, 'v'},
+        {"distribution",  required_argument, NULL, 'D'},
+        {"distinct",      required_argument, NULL, 'n'},
+        {"zipf-exponent", required_argument, NULL, 'z'},
+        {"sparse",        required_argument, NULL, 's'},
+        {"hole-size",     required_argument, NULL, 'H'},
+        {"help",          no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'b': {
+                long long size = parse_size(optarg);
+                if (size < MIN_BLOCK_SIZE || size > MAX_BLOCK_SIZE || size % MIN_BLOCK_SIZE != 0) {
+                    fprintf(stderr, "block size must be a multiple of 4K in 4K..64M\n");
+                    return 1;
+                }
+                cfg.block_size = size;
+                break;
+            }
+            case 't':
+                cfg.threads = atoi(optarg);
+                if (cfg.threads <= 0 || cfg.threads > 1024) {
+                    fprintf(stderr, "threads must be in 1..1024\n");
+                    return 1;
+                }
+                break;
+            case 'd':
+                if (parse_density(optarg, &cfg.density) == -1) {
+                    fprintf(stderr, "density must be a fraction in 0..1 or a percentage\n");
+                    return 1;
+                }
+                break;
+            case 'v':
+                cfg.planted_value = atoi(optarg);
+                break;
+            case 'D':
+                if (ema_dist_parse(optarg, &cfg.dist) == -1) {
+                    fprintf(stderr, "unknown distribution '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'n':
+                cfg.distinct = atoi(optarg);
+                if (cfg.distinct <= 0 || cfg.distinct > 64 * 1024 * 1024) {
+                    fprintf(stderr, "distinct must be in 1..64M\n");
+                    return 1;
+                }
+                break;
+            case 'z':
+                cfg.zipf_exponent = atof(optarg);
+                if (cfg.zipf_exponent <= 0.0) {
+                    fprintf(stderr, "zipf exponent must be positive\n");
+                    return 1;
+                }
+                break;
+            case 's':
+                if (parse_density(optarg, &cfg.sparse) == -1) {
+                    fprintf(stderr, "sparse must be a fraction in 0..1 or a percentage\n");
+                    return 1;
+                }
+                break;
+            case 'H': {
+                long long size = parse_size(optarg);
+                if (size < MIN_BLOCK_SIZE || size % MIN_BLOCK_SIZE != 0) {
+                    fprintf(stderr, "hole size must be a positive multiple of 4K\n");
+                    return 1;
+                }
+                cfg.hole_size = size;
+                break;
+            }
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (argc - optind < 3) {
+        usage(argv[0]);
         return 1;
     }
 
-    const char *filename = argv[1];
-    int size_mb = atoi(argv[2]);
-    unsigned int seed = (unsigned int)atoi(argv[3]);
+    const char *filename = argv[optind];
+    int size_mb = atoi(argv[optind + 1]);
+    cfg.seed = strtoull(argv[optind + 2], NULL, 10);
 
     if (size_mb <= 0) {
         fprintf(stderr, "size_mb must be positive\n");
         return 1;
     }
 
-    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd == -1) {
-        perror("open");
+    unsigned long long total_bytes = (unsigned long long)size_mb * 1024 * 1024;
+    unsigned long long planted = 0;
+    long long start = get_time_us();
+    if (ema_gen_file(filename, total_bytes, &cfg, &planted) == -1) {
         return 1;
     }
+    long long elapsed = get_time_us() - start;
 
-    int *buffer = malloc(BUFFER_SIZE);
-    if (!buffer) {
-        perror("malloc");
-        close(fd);
-        return 1;
+    printf("Generated %llu bytes into %s (%s", total_bytes, filename, ema_dist_name(cfg.dist));
+    if (cfg.dist != EMA_DIST_UNIFORM) {
+        printf(", %d distinct", cfg.distinct);
     }
-
-    srand(seed);
-    unsigned long long total_bytes = (unsigned long long)size_mb * 1024 * 1024;
-    unsigned long long written = 0;
-
-    while (written < total_bytes) {
-        int num_ints = BUFFER_SIZE / sizeof(int);
-        for (int i = 0; i < num_ints; i++) {
-            buffer[i] = rand();
-        }
-
-        ssize_t to_write = BUFFER_SIZE;
-        if (written + to_write > total_bytes) to_write = total_bytes - written;
-        ssize_t res = write(fd, buffer, to_write);
-        if (res == -1) {
-            perror("write");
-            free(buffer);
-            close(fd);
-            return 1;
-        }
-        written += res;
+    if (cfg.sparse > 0.0) {
+        printf(", %.1f%% of %zu-byte extents sparse", cfg.sparse * 100.0, cfg.hole_size);
     }
-
-    free(buffer);
-    close(fd);
-    printf("Generated %llu bytes into %s\n", (unsigned long long)written, filename);
+    printf(", %llu planted %d) in %.3f s, %.2f MB/s, %d thread(s)\n", planted, cfg.planted_value,
+           elapsed / 1000000.0, (double)total_bytes / (1024.0 * 1024.0) / (elapsed > 0 ? elapsed / 1000000.0 : 1),
+           cfg.threads);
     return 0;
 }
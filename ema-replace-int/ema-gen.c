@@ -0,0 +1,292 @@
+#define _GNU_SOURCE
+#include "ema-gen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// Генератор файлов данных.
+//
+// Значение int номер i - функция только от (seed, i): 64-битный счётчик
+// прогоняется через финализатор splitmix64. Поэтому блоки можно строить в
+// любом порядке и любым числом потоков, а файл для одного seed получается
+// побайтно одинаковым. Старшие 32 бита решают, подсаживать ли значение,
+// младшие дают фоновое значение. Zipf выбирается методом алиасов за O(1)
+// независимо от числа различных значений. Так же от (seed, k) зависит,
+// останется ли участок k размером hole_size дырой разреженного файла.
+
+// Таблица алиасов (метод Vose) для весов 1/(k+1)^s, k = 0..n-1
+int ema_zipf_init(ema_zipf_t *zipf, int n, double exponent) {
+    double *scaled = malloc(sizeof(double) * n);
+    int *small = malloc(sizeof(int) * n);
+    int *large = malloc(sizeof(int) * n);
+    zipf->n = n;
+    zipf->prob = malloc(sizeof(uint32_t) * n);
+    zipf->alias = malloc(sizeof(int) * n);
+    int status = -1;
+    if (scaled == NULL || small == NULL || large == NULL || zipf->prob == NULL || zipf->alias == NULL) {
+        perror("malloc");
+        ema_zipf_free(zipf);
+        goto out;
+    }
+
+    double sum = 0;
+    for (int k = 0; k < n; k++) {
+        scaled[k] = 1.0 / pow(k + 1, exponent);
+        sum += scaled[k];
+    }
+    int n_small = 0, n_large = 0;
+    for (int k = 0; k < n; k++) {
+        scaled[k] *= n / sum;
+        if (scaled[k] < 1.0) {
+            small[n_small++] = k;
+        } else {
+            large[n_large++] = k;
+        }
+    }
+    while (n_small > 0 && n_large > 0) {
+        int s = small[--n_small];
+        int l = large[--n_large];
+        zipf->prob[s] = (uint32_t)(scaled[s] * 4294967295.0);
+        zipf->alias[s] = l;
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0) {
+            small[n_small++] = l;
+        } else {
+            large[n_large++] = l;
+        }
+    }
+    // Остатки из-за погрешности округления забирают ячейку целиком
+    while (n_large > 0) {
+        int l = large[--n_large];
+        zipf->prob[l] = UINT32_MAX;
+        zipf->alias[l] = l;
+    }
+    while (n_small > 0) {
+        int s = small[--n_small];
+        zipf->prob[s] = UINT32_MAX;
+        zipf->alias[s] = s;
+    }
+    status = 0;
+
+out:
+    free(scaled);
+    free(small);
+    free(large);
+    return status;
+}
+
+void ema_zipf_free(ema_zipf_t *zipf) {
+    free(zipf->prob);
+    free(zipf->alias);
+    memset(zipf, 0, sizeof(*zipf));
+}
+
+static const char *dist_names[EMA_DIST_COUNT] = {
+    [EMA_DIST_UNIFORM] = "uniform",
+    [EMA_DIST_ZIPF] = "zipf",
+    [EMA_DIST_FEW] = "few",
+};
+
+const char *ema_dist_name(ema_dist_t dist) {
+    return dist < EMA_DIST_COUNT ? dist_names[dist] : "?";
+}
+
+int ema_dist_parse(const char *name, ema_dist_t *dist) {
+    for (int i = 0; i < EMA_DIST_COUNT; i++) {
+        if (strcmp(name, dist_names[i]) == 0) {
+            *dist = (ema_dist_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+typedef struct {
+    const ema_gen_config_t *cfg;
+    int fd;
+    unsigned long long size;
+    uint64_t key;               // seed, перемешанный один раз
+    uint64_t plant_threshold;   // подсадка, если старшие 32 бита меньше
+    uint64_t hole_threshold;    // участок - дыра, если старшие 32 бита меньше
+    ema_zipf_t zipf;
+    unsigned long long next_block;  // следующий свободный блок (атомарно)
+    unsigned long long planted;
+    int failed;
+} gen_job_t;
+
+static unsigned long long gen_block(const gen_job_t *job, int *buffer, uint64_t first, size_t count) {
+    const ema_gen_config_t *cfg = job->cfg;
+    unsigned long long planted = 0;
+    for (size_t j = 0; j < count; j++) {
+        uint64_t r = ema_mix64(job->key + (first + j) * 0x9E3779B97F4A7C15ULL);
+        if ((r >> 32) < job->plant_threshold) {
+            buffer[j] = cfg->planted_value;
+            planted++;
+            continue;
+        }
+        uint32_t low = (uint32_t)r;
+        switch (cfg->dist) {
+            case EMA_DIST_FEW:
+                buffer[j] = (int)(((uint64_t)low * (uint32_t)cfg->distinct) >> 32);
+                break;
+            case EMA_DIST_ZIPF:
+                buffer[j] = ema_zipf_sample(&job->zipf, ema_mix64(r));
+                break;
+            case EMA_DIST_UNIFORM:
+            default:
+                buffer[j] = (int)(low & 0x7fffffff);
+                break;
+        }
+    }
+    return planted;
+}
+
+static int gen_is_hole(const gen_job_t *job, unsigned long long extent) {
+    uint64_t r = ema_mix64((job->key ^ 0xBB67AE8584CAA73BULL) + extent * 0x9E3779B97F4A7C15ULL);
+    return (r >> 32) < job->hole_threshold;
+}
+
+static int gen_write(gen_job_t *job, const int *buffer, size_t from, size_t to, unsigned long long offset) {
+    while (from < to) {
+        ssize_t res = pwrite(job->fd, (const char *)buffer + from, to - from, offset + from);
+        if (res == -1) {
+            perror("pwrite");
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            return -1;
+        }
+        from += res;
+    }
+    return 0;
+}
+
+static void *gen_worker(void *arg) {
+    gen_job_t *job = (gen_job_t *)arg;
+    size_t block_size = job->cfg->block_size;
+    int *buffer = NULL;
+    int err = posix_memalign((void **)&buffer, sysconf(_SC_PAGESIZE), block_size);
+    if (err != 0) {
+        fprintf(stderr, "posix_memalign: %s\n", strerror(err));
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    unsigned long long planted = 0;
+    while (!__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+        unsigned long long block = __atomic_fetch_add(&job->next_block, 1, __ATOMIC_RELAXED);
+        unsigned long long offset = block * block_size;
+        if (offset >= job->size) {
+            break;
+        }
+        size_t len = job->size - offset < block_size ? job->size - offset : block_size;
+        // Хвост короче int заполняется нулями
+        if (len % sizeof(int) != 0) {
+            buffer[len / sizeof(int)] = 0;
+        }
+
+        // Блок делится на участки hole_size; подряд идущие участки данных
+        // пишутся одним pwrite, дыры пропускаются
+        size_t run = 0;
+        size_t pos = 0;
+        while (pos < len) {
+            size_t extent_end = job->cfg->hole_size - (offset + pos) % job->cfg->hole_size;
+            size_t seg = len - pos < extent_end ? len - pos : extent_end;
+            if (gen_is_hole(job, (offset + pos) / job->cfg->hole_size)) {
+                if (gen_write(job, buffer, run, pos, offset) == -1) {
+                    break;
+                }
+                run = pos + seg;
+            } else {
+                planted += gen_block(job, buffer + pos / sizeof(int), (offset + pos) / sizeof(int), seg / sizeof(int));
+            }
+            pos += seg;
+        }
+        if (pos == len) {
+            gen_write(job, buffer, run, len, offset);
+        }
+    }
+    __atomic_fetch_add(&job->planted, planted, __ATOMIC_RELAXED);
+    free(buffer);
+    return NULL;
+}
+
+int ema_gen_file(const char *filename, unsigned long long size, const ema_gen_config_t *cfg,
+                 unsigned long long *planted) {
+    gen_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.cfg = cfg;
+    job.size = size;
+    job.key = ema_mix64(cfg->seed ^ 0x6A09E667F3BCC909ULL);
+    double density = cfg->density < 0 ? 0 : cfg->density > 1 ? 1 : cfg->density;
+    job.plant_threshold = (uint64_t)(density * 4294967296.0);
+    double sparse = cfg->sparse < 0 ? 0 : cfg->sparse > 1 ? 1 : cfg->sparse;
+    job.hole_threshold = (uint64_t)(sparse * 4294967296.0);
+
+    job.fd = -1;
+    if (cfg->dist == EMA_DIST_ZIPF && ema_zipf_init(&job.zipf, cfg->distinct, cfg->zipf_exponent) == -1) {
+        goto fail;
+    }
+
+    job.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (job.fd == -1) {
+        perror("open");
+        goto fail;
+    }
+
+    // Место выделяется заранее одним экстентом, где ФС это умеет:
+    // параллельные pwrite не дробят файл и не упираются в ENOSPC посередине.
+    // Разреженному файлу только задаётся размер - дыры не выделяются.
+    if (job.hole_threshold > 0) {
+        if (ftruncate(job.fd, size) == -1) {
+            perror("ftruncate");
+            goto fail;
+        }
+    } else if (size > 0 && fallocate(job.fd, 0, 0, size) == -1 && errno != EOPNOTSUPP) {
+        perror("fallocate");
+        goto fail;
+    }
+
+    int threads = cfg->threads > 0 ? cfg->threads : 1;
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    if (tids == NULL) {
+        perror("malloc");
+        job.failed = 1;
+        threads = 0;
+    }
+    int started = 0;
+    for (int t = 0; t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, gen_worker, &job) != 0) {
+            perror("pthread_create");
+            __atomic_store_n(&job.failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        started++;
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    free(tids);
+    ema_zipf_free(&job.zipf);
+
+    if (close(job.fd) == -1) {
+        perror("close");
+        job.failed = 1;
+    }
+    if (planted != NULL) {
+        *planted = job.planted;
+    }
+    return job.failed ? -1 : 0;
+
+fail:
+    if (job.fd != -1) {
+        close(job.fd);
+    }
+    ema_zipf_free(&job.zipf);
+    return -1;
+}
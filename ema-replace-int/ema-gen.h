@@ -0,0 +1,69 @@
+#ifndef EMA_REPLACE_INT_EMA_GEN_H
+#define EMA_REPLACE_INT_EMA_GEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EMA_GEN_BLOCK_SIZE (4LL * 1024 * 1024)  // блок записи генератора по умолчанию
+#define EMA_GEN_HOLE_SIZE (1024LL * 1024)       // участок, целиком данные или дыра
+
+// Распределение фоновых (не подсаженных) значений
+typedef enum {
+    EMA_DIST_UNIFORM,   // равномерно по 0..2^31-1, как rand()
+    EMA_DIST_ZIPF,      // значение k из 0..distinct-1 с весом 1/(k+1)^s
+    EMA_DIST_FEW,       // равномерно по немногим значениям 0..distinct-1
+    EMA_DIST_COUNT
+} ema_dist_t;
+
+// Параметры генерации файла данных
+typedef struct {
+    unsigned long long seed;
+    double density;         // доля int, заменённых planted_value
+    int planted_value;
+    ema_dist_t dist;
+    int distinct;           // zipf, few: число различных фоновых значений
+    double zipf_exponent;
+    size_t block_size;
+    int threads;
+    double sparse;          // доля участков hole_size, оставленных дырами
+    size_t hole_size;
+} ema_gen_config_t;
+
+#define EMA_GEN_CONFIG_DEFAULT { \
+    .seed = 1, .density = 0.0, .planted_value = 0, .dist = EMA_DIST_UNIFORM, \
+    .distinct = 1000, .zipf_exponent = 1.0, .block_size = EMA_GEN_BLOCK_SIZE, .threads = 1, \
+    .sparse = 0.0, .hole_size = EMA_GEN_HOLE_SIZE }
+
+// Финализатор splitmix64: счётчик -> псевдослучайное 64-битное число
+static inline uint64_t ema_mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Выборка k из 0..n-1 с весом 1/(k+1)^s за O(1) (таблица алиасов)
+typedef struct {
+    int n;
+    uint32_t *prob;     // порог остаться в ячейке, из 2^32
+    int *alias;         // значение, если порог не пройден
+} ema_zipf_t;
+
+int ema_zipf_init(ema_zipf_t *zipf, int n, double exponent);
+void ema_zipf_free(ema_zipf_t *zipf);
+
+static inline int ema_zipf_sample(const ema_zipf_t *zipf, uint64_t r) {
+    int k = (int)(((r >> 32) * (uint32_t)zipf->n) >> 32);
+    return (uint32_t)r <= zipf->prob[k] ? k : zipf->alias[k];
+}
+
+const char *ema_dist_name(ema_dist_t dist);
+int ema_dist_parse(const char *name, ema_dist_t *dist);
+
+// Создание (с усечением) файла из size байт. Содержимое зависит только
+// от seed и параметров распределения, но не от block_size и threads.
+// При sparse > 0 часть участков не пишется и остаётся дырами (нулями).
+// В *planted возвращается число подсаженных значений.
+int ema_gen_file(const char *filename, unsigned long long size, const ema_gen_config_t *cfg,
+                 unsigned long long *planted);
+
+#endif
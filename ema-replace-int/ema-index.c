@@ -0,0 +1,409 @@
+#define _GNU_SOURCE
+#include "ema.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Индекс смещений горячих значений, хранимый рядом с файлом (<file>.idx).
+//
+// Полный проход записывает смещения всех int, равных одному из горячих
+// значений, в состоянии после замены. Следующая замена одного горячего
+// значения на другое не сканирует файл, а пишет только по известным
+// смещениям. Индекс действителен, пока размер и mtime файла совпадают
+// с сохранёнными; после своей записи индекс перезаписывается с новым mtime.
+//
+// Формат: заголовок ema_index_header_t, затем для каждого значения
+// int32 value, uint64 count и count смещений uint64 по возрастанию.
+
+#define INDEX_MAGIC "EMAIDX1"
+#define INDEX_RECORD_BATCH 256
+
+typedef struct {
+    char magic[8];
+    uint64_t file_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint32_t n_values;
+    uint32_t reserved;
+} ema_index_header_t;
+
+int ema_index_init(ema_index_t *index, const int *values, int n_values) {
+    memset(index, 0, sizeof(*index));
+    if (n_values > EMA_INDEX_MAX_VALUES) {
+        fprintf(stderr, "Error: at most %d indexed values\n", EMA_INDEX_MAX_VALUES);
+        return -1;
+    }
+    // Повторы схлопываются: у каждого значения один список
+    for (int i = 0; i < n_values; i++) {
+        if (ema_index_find(index, values[i]) < 0) {
+            index->values[index->n_values++] = values[i];
+        }
+    }
+    pthread_mutex_init(&index->lock, NULL);
+    return 0;
+}
+
+void ema_index_free(ema_index_t *index) {
+    for (int i = 0; i < index->n_values; i++) {
+        free(index->offsets[i]);
+    }
+    pthread_mutex_destroy(&index->lock);
+    memset(index, 0, sizeof(*index));
+}
+
+int ema_index_find(const ema_index_t *index, int value) {
+    for (int i = 0; i < index->n_values; i++) {
+        if (index->values[i] == value) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void ema_index_reset(ema_index_t *index) {
+    for (int i = 0; i < index->n_values; i++) {
+        index->count[i] = 0;
+    }
+    index->valid = 0;
+}
+
+static int index_append(ema_index_t *index, int k, off_t offset) {
+    if (index->count[k] == index->allocated[k]) {
+        size_t allocated = index->allocated[k] ? index->allocated[k] * 2 : 1024;
+        off_t *grown = realloc(index->offsets[k], allocated * sizeof(off_t));
+        if (grown == NULL) {
+            return -1;
+        }
+        index->offsets[k] = grown;
+        index->allocated[k] = allocated;
+    }
+    index->offsets[k][index->count[k]++] = offset;
+    return 0;
+}
+
+static void index_flush(ema_index_t *index, const int *keys, const off_t *offsets, int n) {
+    pthread_mutex_lock(&index->lock);
+    for (int i = 0; i < n; i++) {
+        if (index_append(index, keys[i], offsets[i]) == -1) {
+            index->failed = 1;
+        }
+    }
+    pthread_mutex_unlock(&index->lock);
+}
+
+// Запись смещений горячих значений блока data[0..count), лежащего в
+// файле по смещению offset. Находки копятся локально, поэтому лок берётся
+// только на блоках с совпадениями.
+void ema_index_record(ema_index_t *index, const int *data, size_t count, off_t offset) {
+    int keys[INDEX_RECORD_BATCH];
+    off_t offsets[INDEX_RECORD_BATCH];
+    int n = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (int k = 0; k < index->n_values; k++) {
+            if (data[i] != index->values[k]) {
+                continue;
+            }
+            keys[n] = k;
+            offsets[n] = offset + (off_t)(i * sizeof(int));
+            if (++n == INDEX_RECORD_BATCH) {
+                index_flush(index, keys, offsets, n);
+                n = 0;
+            }
+            break;
+        }
+    }
+    if (n > 0) {
+        index_flush(index, keys, offsets, n);
+    }
+}
+
+static int compare_offsets(const void *a, const void *b) {
+    off_t x = *(const off_t *)a;
+    off_t y = *(const off_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int index_stat(const char *filename, ema_index_t *index) {
+    struct stat st;
+    if (stat(filename, &st) == -1) {
+        perror("stat");
+        return -1;
+    }
+    index->file_size = st.st_size;
+    index->mtime_sec = st.st_mtim.tv_sec;
+    index->mtime_nsec = st.st_mtim.tv_nsec;
+    return 0;
+}
+
+// Завершение построения: потоки дописывали смещения в произвольном
+// порядке, списки сортируются
+int ema_index_finish(ema_index_t *index, const char *filename) {
+    if (index->failed) {
+        fprintf(stderr, "Error: out of memory while building index\n");
+        ema_index_reset(index);
+        index->failed = 0;
+        return -1;
+    }
+    for (int k = 0; k < index->n_values; k++) {
+        qsort(index->offsets[k], index->count[k], sizeof(off_t), compare_offsets);
+    }
+    if (index_stat(filename, index) == -1) {
+        return -1;
+    }
+    index->valid = 1;
+    return 0;
+}
+
+// Индекс соответствует файлу, если не изменились размер и mtime
+int ema_index_current(const ema_index_t *index, const char *filename) {
+    struct stat st;
+    if (!index->valid || stat(filename, &st) == -1) {
+        return 0;
+    }
+    return (off_t)index->file_size == st.st_size && index->mtime_sec == st.st_mtim.tv_sec &&
+           index->mtime_nsec == st.st_mtim.tv_nsec;
+}
+
+static int write_all(FILE *f, const void *data, size_t size) {
+    return fwrite(data, 1, size, f) == size ? 0 : -1;
+}
+
+int ema_index_save(const ema_index_t *index, const char *path) {
+    // Пишем во временный файл и переименовываем, чтобы оборванная запись
+    // не оставила полуготовый индекс
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL) {
+        perror(tmp);
+        return -1;
+    }
+
+    ema_index_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.file_size = index->file_size;
+    header.mtime_sec = index->mtime_sec;
+    header.mtime_nsec = index->mtime_nsec;
+    header.n_values = index->n_values;
+    int status = write_all(f, &header, sizeof(header));
+    for (int k = 0; k < index->n_values && status == 0; k++) {
+        int32_t value = index->values[k];
+        uint64_t count = index->count[k];
+        status = write_all(f, &value, sizeof(value));
+        if (status == 0) {
+            status = write_all(f, &count, sizeof(count));
+        }
+        for (size_t i = 0; i < index->count[k] && status == 0; i++) {
+            uint64_t offset = index->offsets[k][i];
+            status = write_all(f, &offset, sizeof(offset));
+        }
+    }
+    if (fclose(f) != 0) {
+        status = -1;
+    }
+    if (status == 0 && rename(tmp, path) == -1) {
+        status = -1;
+    }
+    if (status == -1) {
+        perror(path);
+        unlink(tmp);
+    }
+    return status;
+}
+
+// Загрузка индекса с диска. 0 - индекс годен для файла, 1 - его нет,
+// он устарел или построен для других значений (нужен полный проход),
+// -1 - ошибка.
+int ema_index_load(ema_index_t *index, const char *path, const char *filename) {
+    ema_index_reset(index);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        if (errno == ENOENT) {
+            return 1;
+        }
+        perror(path);
+        return -1;
+    }
+
+    int status = 1;
+    ema_index_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "%s: not an index file, rebuilding\n", path);
+        goto out;
+    }
+    if (header.n_values != (uint32_t)index->n_values) {
+        goto out;
+    }
+    for (int k = 0; k < index->n_values; k++) {
+        int32_t value;
+        uint64_t count;
+        if (fread(&value, sizeof(value), 1, f) != 1 || fread(&count, sizeof(count), 1, f) != 1) {
+            fprintf(stderr, "%s: truncated index, rebuilding\n", path);
+            goto out;
+        }
+        int slot = ema_index_find(index, value);
+        if (slot < 0) {
+            goto out;
+        }
+        for (uint64_t i = 0; i < count; i++) {
+            uint64_t offset;
+            if (fread(&offset, sizeof(offset), 1, f) != 1) {
+                fprintf(stderr, "%s: truncated index, rebuilding\n", path);
+                goto out;
+            }
+            if (index_append(index, slot, (off_t)offset) == -1) {
+                perror("realloc");
+                status = -1;
+                goto out;
+            }
+        }
+    }
+    index->file_size = header.file_size;
+    index->mtime_sec = header.mtime_sec;
+    index->mtime_nsec = header.mtime_nsec;
+    index->valid = 1;
+    if (ema_index_current(index, filename)) {
+        status = 0;
+    } else {
+        fprintf(stderr, "%s: file size or mtime changed, rebuilding\n", path);
+    }
+
+out:
+    fclose(f);
+    if (status != 0) {
+        ema_index_reset(index);
+    }
+    return status;
+}
+
+// Запись replace_value по смещениям из списка: подряд идущие int
+// объединяются в один pwrite
+static int patch_pwrite(const char *filename, const off_t *offsets, size_t count,
+                        const ema_config_t *cfg, ema_stats_t *stats) {
+    int fd = open(filename, O_WRONLY);
+    stats->other_calls++;
+    if (fd == -1) {
+        perror("open");
+        return -1;
+    }
+    size_t block_ints = (cfg->block_size ? cfg->block_size : BUFFER_SIZE) / sizeof(int);
+    int *run = ema_alloc_block(block_ints * sizeof(int));
+    if (run == NULL) {
+        close(fd);
+        return -1;
+    }
+    for (size_t i = 0; i < block_ints; i++) {
+        run[i] = (int)cfg->replace_value;
+    }
+
+    int status = 0;
+    size_t i = 0;
+    while (i < count) {
+        size_t n = 1;
+        while (i + n < count && n < block_ints && offsets[i + n] == offsets[i] + (off_t)(n * sizeof(int))) {
+            n++;
+        }
+        ssize_t written = pwrite(fd, run, n * sizeof(int), offsets[i]);
+        stats->write_calls++;
+        if (written != (ssize_t)(n * sizeof(int))) {
+            perror("pwrite");
+            status = -1;
+            break;
+        }
+        stats->bytes_written += written;
+        i += n;
+    }
+    free(run);
+    close(fd);
+    stats->other_calls++;
+    return status;
+}
+
+// Запись по смещениям прямо в MAP_SHARED отображение файла
+static int patch_mmap(const char *filename, const off_t *offsets, size_t count,
+                      const ema_config_t *cfg, ema_stats_t *stats) {
+    size_t size;
+    int *data = ema_map_file(filename, cfg, &size, stats);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    if (data == NULL) {
+        return 0;
+    }
+    // Случайный доступ: последовательное чтение вперёд только мешает
+    madvise(data, size, MADV_RANDOM);
+    stats->other_calls++;
+    long page = sysconf(_SC_PAGESIZE);
+    off_t last_page = -1;
+    for (size_t i = 0; i < count; i++) {
+        data[offsets[i] / sizeof(int)] = (int)cfg->replace_value;
+        if (offsets[i] / page != last_page) {
+            last_page = offsets[i] / page;
+            stats->bytes_written += page;
+        }
+    }
+    return ema_unmap_file(data, size, cfg, stats);
+}
+
+// Замена search_value на replace_value по индексу. 1 - индекс не
+// применим (не годен или search_value не индексируется) и нужен
+// полный проход. После замены смещения переходят в список replace_value,
+// если оно тоже индексируется.
+int ema_index_patch(ema_index_t *index, const char *filename, const ema_config_t *cfg, ema_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    int from = ema_index_find(index, (int)cfg->search_value);
+    int to = ema_index_find(index, (int)cfg->replace_value);
+    stats->other_calls++;
+    if (from < 0 || cfg->rules != NULL || !ema_index_current(index, filename)) {
+        return 1;
+    }
+
+    const off_t *offsets = index->offsets[from];
+    size_t count = index->count[from];
+    int status = 0;
+    if (count > 0) {
+        status = (cfg->engine == EMA_ENGINE_MMAP)
+            ? patch_mmap(filename, offsets, count, cfg, stats)
+            : patch_pwrite(filename, offsets, count, cfg, stats);
+    }
+    if (status == -1) {
+        ema_index_reset(index);
+        return -1;
+    }
+    stats->matches = count;
+
+    if (to >= 0 && to != from) {
+        // Слияние двух отсортированных списков
+        size_t merged_count = index->count[to] + count;
+        off_t *merged = malloc((merged_count ? merged_count : 1) * sizeof(off_t));
+        if (merged == NULL) {
+            perror("malloc");
+            ema_index_reset(index);
+            return -1;
+        }
+        size_t a = 0, b = 0, m = 0;
+        while (a < index->count[to] || b < count) {
+            if (b == count || (a < index->count[to] && index->offsets[to][a] < offsets[b])) {
+                merged[m++] = index->offsets[to][a++];
+            } else {
+                merged[m++] = offsets[b++];
+            }
+        }
+        free(index->offsets[to]);
+        index->offsets[to] = merged;
+        index->count[to] = merged_count;
+        index->allocated[to] = merged_count;
+    }
+    if (to != from) {
+        index->count[from] = 0;
+    }
+    return index_stat(filename, index);
+}
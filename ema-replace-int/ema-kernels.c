@@ -0,0 +1,621 @@
+#define _GNU_SOURCE
+#include "ema.h"
+
+#include <string.h>
+#include <strings.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EMA_HAVE_X86 1
+#else
+#define EMA_HAVE_X86 0
+#endif
+
+// Ядра поиска и замены элементов в буфере. Каждое возвращает число замен.
+// Скалярное ядро - эталон: векторные обязаны давать тот же результат.
+//
+// Ядра порождаются макросами для каждого класса элементов во время
+// компиляции, без ветвления по типу во внутреннем цикле. Целые сравниваются
+// побитно, поэтому знаковые и беззнаковые одной ширины делят ядро, а чужой
+// порядок байтов сводится к перестановке байтов искомого и нового значения
+// один раз на вызов. Плавающие сравниваются как числа (-0.0 == 0.0, NaN не
+// равен ничему): при чужом порядке байтов элементы переставляются в
+// регистре перед сравнением, а записывается исходный вектор со вставленным
+// новым значением в порядке файла.
+
+// Класс элементов: ширина и способ сравнения
+enum { CLASS_U8, CLASS_U16, CLASS_U32, CLASS_U64, CLASS_F32, CLASS_F64, CLASS_COUNT };
+
+#define SCALAR_INT(W)                                                                              \
+static size_t scan_scalar_u##W(void *data, size_t count, ema_value_t search_value,                 \
+                               ema_value_t replace_value) {                                        \
+    uint##W##_t *p = data;                                                                         \
+    uint##W##_t search = (uint##W##_t)search_value;                                                \
+    uint##W##_t replace = (uint##W##_t)replace_value;                                              \
+    size_t matches = 0;                                                                            \
+    for (size_t i = 0; i < count; i++) {                                                           \
+        if (p[i] == search) {                                                                      \
+            p[i] = replace;                                                                        \
+            matches++;                                                                             \
+        }                                                                                          \
+    }                                                                                              \
+    return matches;                                                                                \
+}
+
+#define SCALAR_FLOAT(W, F, SWAP, NAME)                                                             \
+static size_t scan_scalar_##NAME(void *data, size_t count, ema_value_t search_value,               \
+                                 ema_value_t replace_value) {                                      \
+    uint##W##_t *p = data;                                                                         \
+    uint##W##_t bits = (uint##W##_t)search_value;                                                  \
+    F search;                                                                                      \
+    memcpy(&search, &bits, sizeof(search));                                                        \
+    uint##W##_t replace = SWAP ? __builtin_bswap##W((uint##W##_t)replace_value)                    \
+                               : (uint##W##_t)replace_value;                                       \
+    size_t matches = 0;                                                                            \
+    for (size_t i = 0; i < count; i++) {                                                           \
+        uint##W##_t raw = SWAP ? __builtin_bswap##W(p[i]) : p[i];                                  \
+        F v;                                                                                       \
+        memcpy(&v, &raw, sizeof(v));                                                               \
+        if (v == search) {                                                                         \
+            p[i] = replace;                                                                        \
+            matches++;                                                                             \
+        }                                                                                          \
+    }                                                                                              \
+    return matches;                                                                                \
+}
+
+// Целые с чужим порядком байтов: то же ядро с переставленными значениями
+#define SWAPPED_INT(ISA, W)                                                                        \
+static size_t scan_##ISA##_u##W##_swap(void *data, size_t count, ema_value_t search_value,         \
+                                       ema_value_t replace_value) {                                \
+    return scan_##ISA##_u##W(data, count, __builtin_bswap##W((uint##W##_t)search_value),           \
+                             __builtin_bswap##W((uint##W##_t)replace_value));                      \
+}
+
+// Ядра подсчёта для режима count: то же сравнение, но без записи
+#define COUNT_SCALAR_INT(W)                                                                        \
+static size_t count_scalar_u##W(const void *data, size_t count, ema_value_t value) {               \
+    const uint##W##_t *p = data;                                                                   \
+    uint##W##_t search = (uint##W##_t)value;                                                       \
+    size_t matches = 0;                                                                            \
+    for (size_t i = 0; i < count; i++) {                                                           \
+        matches += p[i] == search;                                                                 \
+    }                                                                                              \
+    return matches;                                                                                \
+}
+
+#define COUNT_SCALAR_FLOAT(W, F, SWAP, NAME)                                                       \
+static size_t count_scalar_##NAME(const void *data, size_t count, ema_value_t value) {             \
+    const uint##W##_t *p = data;                                                                   \
+    uint##W##_t bits = (uint##W##_t)value;                                                         \
+    F search;                                                                                      \
+    memcpy(&search, &bits, sizeof(search));                                                        \
+    size_t matches = 0;                                                                            \
+    for (size_t i = 0; i < count; i++) {                                                           \
+        uint##W##_t raw = SWAP ? __builtin_bswap##W(p[i]) : p[i];                                  \
+        F v;                                                                                       \
+        memcpy(&v, &raw, sizeof(v));                                                               \
+        matches += v == search;                                                                    \
+    }                                                                                              \
+    return matches;                                                                                \
+}
+
+#define SWAPPED_COUNT_INT(ISA, W)                                                                  \
+static size_t count_##ISA##_u##W##_swap(const void *data, size_t count, ema_value_t value) {       \
+    return count_##ISA##_u##W(data, count, __builtin_bswap##W((uint##W##_t)value));                \
+}
+
+SCALAR_INT(8)
+SCALAR_INT(16)
+SCALAR_INT(32)
+SCALAR_INT(64)
+SCALAR_FLOAT(32, float, 0, f32)
+SCALAR_FLOAT(64, double, 0, f64)
+SCALAR_FLOAT(32, float, 1, f32_swap)
+SCALAR_FLOAT(64, double, 1, f64_swap)
+SWAPPED_INT(scalar, 16)
+SWAPPED_INT(scalar, 32)
+SWAPPED_INT(scalar, 64)
+COUNT_SCALAR_INT(8)
+COUNT_SCALAR_INT(16)
+COUNT_SCALAR_INT(32)
+COUNT_SCALAR_INT(64)
+COUNT_SCALAR_FLOAT(32, float, 0, f32)
+COUNT_SCALAR_FLOAT(64, double, 0, f64)
+COUNT_SCALAR_FLOAT(32, float, 1, f32_swap)
+COUNT_SCALAR_FLOAT(64, double, 1, f64_swap)
+SWAPPED_COUNT_INT(scalar, 16)
+SWAPPED_COUNT_INT(scalar, 32)
+SWAPPED_COUNT_INT(scalar, 64)
+
+#if EMA_HAVE_X86
+
+// Маски перестановки байтов внутри 4- и 8-байтных элементов для pshufb;
+// pshufb работает по 128-битным дорожкам, поэтому шаблон повторяется
+#define REV32_LANE 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+#define REV64_LANE 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8
+static const uint8_t rev32_mask[64] = { REV32_LANE, REV32_LANE, REV32_LANE, REV32_LANE };
+static const uint8_t rev64_mask[64] = { REV64_LANE, REV64_LANE, REV64_LANE, REV64_LANE };
+
+// SSE4.1: 16 байт за сравнение. Чистые векторы отсеиваются по movemask,
+// в грязных замена делается blendv, число совпадений - popcount маски.
+#define SSE41_INT(W, EPI, SET)                                                                     \
+__attribute__((target("sse4.1,popcnt")))                                                           \
+static size_t scan_sse41_u##W(void *data, size_t count, ema_value_t search_value,                  \
+                              ema_value_t replace_value) {                                         \
+    uint##W##_t *p = data;                                                                         \
+    const size_t lanes = 16 / sizeof(uint##W##_t);                                                 \
+    size_t matches = 0;                                                                            \
+    size_t i = 0;                                                                                  \
+    __m128i search = _mm_set1_##SET((int##W##_t)search_value);                                     \
+    __m128i replace = _mm_set1_##SET((int##W##_t)replace_value);                                   \
+    for (; i + lanes <= count; i += lanes) {                                                       \
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));                                     \
+        __m128i eq = _mm_cmpeq_##EPI(v, search);                                                   \
+        int mask = _mm_movemask_epi8(eq);                                                          \
+        if (mask == 0) {                                                                           \
+            continue;                                                                              \
+        }                                                                                          \
+        _mm_storeu_si128((__m128i *)(p + i), _mm_blendv_epi8(v, replace, eq));                     \
+        matches += __builtin_popcount(mask) / sizeof(uint##W##_t);                                 \
+    }                                                                                              \
+    return matches + scan_scalar_u##W(p + i, count - i, search_value, replace_value);              \
+}
+
+// AVX2: 32 байта, два вектора за итерацию, чтобы чаще пропускать чистые пары
+#define AVX2_INT(W, EPI, SET)                                                                      \
+__attribute__((target("avx2,popcnt")))                                                             \
+static size_t scan_avx2_u##W(void *data, size_t count, ema_value_t search_value,                   \
+                             ema_value_t replace_value) {                                          \
+    uint##W##_t *p = data;                                                                         \
+    const size_t lanes = 32 / sizeof(uint##W##_t);                                                 \
+    size_t matches = 0;                                                                            \
+    size_t i = 0;                                                                                  \
+    __m256i search = _mm256_set1_##SET((int##W##_t)search_value);                                  \
+    __m256i replace = _mm256_set1_##SET((int##W##_t)replace_value);                                \
+    for (; i + 2 * lanes <= count; i += 2 * lanes) {                                               \
+        __m256i v0 = _mm256_loadu_si256((const __m256i *)(p + i));                                 \
+        __m256i v1 = _mm256_loadu_si256((const __m256i *)(p + i + lanes));                         \
+        __m256i eq0 = _mm256_cmpeq_##EPI(v0, search);                                              \
+        __m256i eq1 = _mm256_cmpeq_##EPI(v1, search);                                              \
+        if (_mm256_testz_si256(_mm256_or_si256(eq0, eq1), _mm256_or_si256(eq0, eq1))) {            \
+            continue;                                                                              \
+        }                                                                                          \
+        unsigned mask0 = (unsigned)_mm256_movemask_epi8(eq0);                                      \
+        unsigned mask1 = (unsigned)_mm256_movemask_epi8(eq1);                                      \
+        if (mask0) {                                                                               \
+            _mm256_storeu_si256((__m256i *)(p + i), _mm256_blendv_epi8(v0, replace, eq0));         \
+        }                                                                                          \
+        if (mask1) {                                                                               \
+            _mm256_storeu_si256((__m256i *)(p + i + lanes), _mm256_blendv_epi8(v1, replace, eq1)); \
+        }                                                                                          \
+        matches += (__builtin_popcount(mask0) + __builtin_popcount(mask1)) / sizeof(uint##W##_t);  \
+    }                                                                                              \
+    return matches + scan_scalar_u##W(p + i, count - i, search_value, replace_value);              \
+}
+
+// AVX-512: 64 байта, сравнение сразу в маску, замена маскированной
+// записью; 8- и 16-битным элементам нужен AVX-512BW
+#define AVX512_INT(W, EPI, SET, MASK, TARGET)                                                      \
+__attribute__((target(TARGET)))                                                                    \
+static size_t scan_avx512_u##W(void *data, size_t count, ema_value_t search_value,                 \
+                               ema_value_t replace_value) {                                        \
+    uint##W##_t *p = data;                                                                         \
+    const size_t lanes = 64 / sizeof(uint##W##_t);                                                 \
+    size_t matches = 0;                                                                            \
+    size_t i = 0;                                                                                  \
+    __m512i search = _mm512_set1_##SET((int##W##_t)search_value);                                  \
+    __m512i replace = _mm512_set1_##SET((int##W##_t)replace_value);                                \
+    for (; i + lanes <= count; i += lanes) {                                                       \
+        __m512i v = _mm512_loadu_si512((const void *)(p + i));                                     \
+        MASK mask = _mm512_cmpeq_##EPI##_mask(v, search);                                          \
+        if (mask == 0) {                                                                           \
+            continue;                                                                              \
+        }                                                                                          \
+        _mm512_mask_storeu_##EPI(p + i, mask, replace);                                            \
+        matches += __builtin_popcountll(mask);                                                     \
+    }                                                                                              \
+    /* Хвост короче вектора тоже маскированно: без скалярного цикла */                             \
+    if (i < count) {                                                                               \
+        MASK tail = (MASK)((1ULL << (count - i)) - 1);                                             \
+        __m512i v = _mm512_maskz_loadu_##EPI(tail, p + i);                                         \
+        MASK mask = _mm512_mask_cmpeq_##EPI##_mask(tail, v, search);                               \
+        _mm512_mask_storeu_##EPI(p + i, mask, replace);                                            \
+        matches += __builtin_popcountll(mask);                                                     \
+    }                                                                                              \
+    return matches;                                                                                \
+}
+
+// Плавающие: сравнение упорядоченным равенством, запись - смешиванием
+// исходных байтов с новым значением по маске совпадений
+#define SSE41_FLOAT(W, F, PS, VEC, SWAP, NAME)                                                     \
+__attribute__((target("sse4.1,popcnt")))                                                           \
+static size_t scan_sse41_##NAME(void *data, size_t count, ema_value_t search_value,                \
+                                ema_value_t replace_value) {                                       \
+    uint##W##_t *p = data;                                                                         \
+    const size_t lanes = 16 / sizeof(F);                                                           \
+    uint##W##_t sbits = (uint##W##_t)search_value;                                                 \
+    uint##W##_t rbits = SWAP ? __builtin_bswap##W((uint##W##_t)replace_value)                      \
+                             : (uint##W##_t)replace_value;                                         \
+    F s, r;                                                                                        \
+    memcpy(&s, &sbits, sizeof(s));                                                                 \
+    memcpy(&r, &rbits, sizeof(r));                                                                 \
+    VEC search = _mm_set1_##PS(s);                                                                 \
+    __m128i replace = _mm_cast##PS##_si128(_mm_set1_##PS(r));                                      \
+    __m128i rev = _mm_loadu_si128((const __m128i *)rev##W##_mask);                                 \
+    size_t matches = 0;                                                                            \
+    size_t i = 0;                                                                                  \
+    for (; i + lanes <= count; i += lanes) {                                                       \
+        __m128i raw = _mm_loadu_si128((const __m128i *)(p + i));                                   \
+        VEC v = _mm_castsi128_##PS(SWAP ? _mm_shuffle_epi8(raw, rev) : raw);                       \
+        VEC eq = _mm_cmpeq_##PS(v, search);                                                        \
+        int mask = _mm_movemask_##PS(eq);                                                          \
+        if (mask == 0) {                                                                           \
+            continue;                                                                              \
+        }                                                                                          \
+        _mm_storeu_si128((__m128i *)(p + i), _mm_blendv_epi8(raw, replace, _mm_cast##PS##_si128(eq))); \
+        matches += __builtin_popcount(mask);                                                       \
+    }                                                                                              \
+    return matches + scan_scalar_##NAME(p + i, count - i, search_value, replace_value);            \
+}
+
+#define AVX2_FLOAT(W, F, PS, VEC, SWAP, NAME)                                                      \
+__attribute__((target("avx2,popcnt")))                                                             \
+static size_t scan_avx2_##NAME(void *data, size_t count, ema_value_t search_value,                 \
+                               ema_value_t replace_value) {                                        \
+    uint##W##_t *p = data;                                                                         \
+    const size_t lanes = 32 / sizeof(F);                                                           \
+    uint##W##_t sbits = (uint##W##_t)search_value;                                                 \
+    uint##W##_t rbits = SWAP ? __builtin_bswap##W((uint##W##_t)replace_value)                      \
+                             : (uint##W##_t)replace_value;                                         \
+    F s, r;                                                                                        \
+    memcpy(&s, &sbits, sizeof(s));                                                                 \
+    memcpy(&r, &rbits, sizeof(r));                                                                 \
+    VEC search = _mm256_set1_##PS(s);                                                              \
+    __m256i replace = _mm256_cast##PS##_si256(_mm256_set1_##PS(r));                                \
+    __m256i rev = _mm256_loadu_si256((const __m256i *)rev##W##_mask);                              \
+    size_t matches = 0;                                                                            \
+    size_t i = 0;                                                                                  \
+    for (; i + lanes <= count; i += lanes) {                                                       \
+        __m256i raw = _mm256_loadu_si256((const __m256i *)(p + i));                                \
+        VEC v = _mm256_castsi256_##PS(SWAP ? _mm256_shuffle_epi8(raw, rev) : raw);                 \
+        VEC eq = _mm256_cmp_##PS(v, search, _CMP_EQ_OQ);                                           \
+        int mask = _mm256_movemask_##PS(eq);                                                       \
+        if (mask == 0) {                                                                           \
+            continue;                                                                              \
+        }                                                                                          \
+        _mm256_storeu_si256((__m256i *)(p + i),                                                    \
+                            _mm256_blendv_epi8(raw, replace, _mm256_cast##PS##_si256(eq)));        \
+        matches += __builtin_popcount(mask);                                                       \
+    }                                                                                              \
+    return matches + scan_scalar_##NAME(p + i, count - i, search_value, replace_value);            \
+}
+
+#define AVX512_FLOAT(W, F, PS, VEC, EPI, MASK, SWAP, NAME, TARGET)                                 \
+__attribute__((target(TARGET)))                                                                    \
+static size_t scan_avx512_##NAME(void *data, size_t count, ema_value_t search_value,               \
+                                 ema_value_t replace_value) {                                      \
+    uint##W##_t *p = data;                                                                         \
+    const size_t lanes = 64 / sizeof(F);                                                           \
+    uint##W##_t sbits = (uint##W##_t)search_value;                                                 \
+    uint##W##_t rbits = SWAP ? __builtin_bswap##W((uint##W##_t)replace_value)                      \
+                             : (uint##W##_t)replace_value;                                         \
+    F s, r;                                                                                        \
+    memcpy(&s, &sbits, sizeof(s));                                                                 \
+    memcpy(&r, &rbits, sizeof(r));                                                                 \
+    VEC search = _mm512_set1_##PS(s);                                                              \
+    __m512i replace = _mm512_cast##PS##_si512(_mm512_set1_##PS(r));                                \
+    size_t matches = 0;                                                                            \
+    for (size_t i = 0; i < count; i += lanes) {                                                    \
+        MASK live = count - i < lanes ? (MASK)((1ULL << (count - i)) - 1) : (MASK)~0ULL;           \
+        __m512i raw = _mm512_maskz_loadu_##EPI(live, p + i);                                       \
+        VEC v = _mm512_castsi512_##PS(SWAP ? SWAP512_##W(raw) : raw);                              \
+        MASK mask = _mm512_mask_cmp_##PS##_mask(live, v, search, _CMP_EQ_OQ);                      \
+        if (mask == 0) {                                                                           \
+            continue;                                                                              \
+        }                                                                                          \
+        _mm512_mask_storeu_##EPI(p + i, mask, replace);                                            \
+        matches += __builtin_popcountll(mask);                                                     \
+    }                                                                                              \
+    return matches;                                                                                \
+}
+#define SWAP512_32(raw) _mm512_shuffle_epi8(raw, _mm512_loadu_si512((const void *)rev32_mask))
+#define SWAP512_64(raw) _mm512_shuffle_epi8(raw, _mm512_loadu_si512((const void *)rev64_mask))
+
+// Подсчёт: совпавшие байты копятся popcount'ом маски и делятся на
+// ширину элемента один раз в конце
+#define COUNT_SSE41_INT(W, EPI, SET)                                                               \
+__attribute__((target("sse4.1,popcnt")))                                                           \
+static size_t count_sse41_u##W(const void *data, size_t count, ema_value_t value) {                \
+    const uint##W##_t *p = data;                                                                   \
+    const size_t lanes = 16 / sizeof(uint##W##_t);                                                 \
+    size_t bytes = 0;                                                                              \
+    size_t i = 0;                                                                                  \
+    __m128i search = _mm_set1_##SET((int##W##_t)value);                                            \
+    for (; i + lanes <= count; i += lanes) {                                                       \
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));                                     \
+        bytes += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_##EPI(v, search)));                \
+    }                                                                                              \
+    return bytes / sizeof(uint##W##_t) + count_scalar_u##W(p + i, count - i, value);               \
+}
+
+#define COUNT_AVX2_INT(W, EPI, SET)                                                                \
+__attribute__((target("avx2,popcnt")))                                                             \
+static size_t count_avx2_u##W(const void *data, size_t count, ema_value_t value) {                 \
+    const uint##W##_t *p = data;                                                                   \
+    const size_t lanes = 32 / sizeof(uint##W##_t);                                                 \
+    size_t bytes = 0;                                                                              \
+    size_t i = 0;                                                                                  \
+    __m256i search = _mm256_set1_##SET((int##W##_t)value);                                         \
+    for (; i + lanes <= count; i += lanes) {                                                       \
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));                                  \
+        bytes += __builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_##EPI(v, search))); \
+    }                                                                                              \
+    return bytes / sizeof(uint##W##_t) + count_scalar_u##W(p + i, count - i, value);               \
+}
+
+#define COUNT_AVX512_INT(W, EPI, SET, MASK, TARGET)                                                \
+__attribute__((target(TARGET)))                                                                    \
+static size_t count_avx512_u##W(const void *data, size_t count, ema_value_t value) {               \
+    const uint##W##_t *p = data;                                                                   \
+    const size_t lanes = 64 / sizeof(uint##W##_t);                                                 \
+    size_t matches = 0;                                                                            \
+    __m512i search = _mm512_set1_##SET((int##W##_t)value);                                         \
+    for (size_t i = 0; i < count; i += lanes) {                                                    \
+        MASK live = count - i < lanes ? (MASK)((1ULL << (count - i)) - 1) : (MASK)~0ULL;           \
+        __m512i v = _mm512_maskz_loadu_##EPI(live, p + i);                                         \
+        matches += __builtin_popcountll(_mm512_mask_cmpeq_##EPI##_mask(live, v, search));          \
+    }                                                                                              \
+    return matches;                                                                                \
+}
+
+#define COUNT_SSE41_FLOAT(W, F, PS, VEC, SWAP, NAME)                                               \
+__attribute__((target("sse4.1,popcnt")))                                                           \
+static size_t count_sse41_##NAME(const void *data, size_t count, ema_value_t value) {              \
+    const uint##W##_t *p = data;                                                                   \
+    const size_t lanes = 16 / sizeof(F);                                                           \
+    uint##W##_t bits = (uint##W##_t)value;                                                         \
+    F s;                                                                                           \
+    memcpy(&s, &bits, sizeof(s));                                                                  \
+    VEC search = _mm_set1_##PS(s);                                                                 \
+    __m128i rev = _mm_loadu_si128((const __m128i *)rev##W##_mask);                                 \
+    size_t matches = 0;                                                                            \
+    size_t i = 0;                                                                                  \
+    for (; i + lanes <= count; i += lanes) {                                                       \
+        __m128i raw = _mm_loadu_si128((const __m128i *)(p + i));                                   \
+        VEC v = _mm_castsi128_##PS(SWAP ? _mm_shuffle_epi8(raw, rev) : raw);                       \
+        matches += __builtin_popcount(_mm_movemask_##PS(_mm_cmpeq_##PS(v, search)));               \
+    }                                                                                              \
+    return matches + count_scalar_##NAME(p + i, count - i, value);                                 \
+}
+
+#define COUNT_AVX2_FLOAT(W, F, PS, VEC, SWAP, NAME)                                                \
+__attribute__((target("avx2,popcnt")))                                                             \
+static size_t count_avx2_##NAME(const void *data, size_t count, ema_value_t value) {               \
+    const uint##W##_t *p = data;                                                                   \
+    const size_t lanes = 32 / sizeof(F);                                                           \
+    uint##W##_t bits = (uint##W##_t)value;                                                         \
+    F s;                                                                                           \
+    memcpy(&s, &bits, sizeof(s));                                                                  \
+    VEC search = _mm256_set1_##PS(s);                                                              \
+    __m256i rev = _mm256_loadu_si256((const __m256i *)rev##W##_mask);                              \
+    size_t matches = 0;                                                                            \
+    size_t i = 0;                                                                                  \
+    for (; i + lanes <= count; i += lanes) {                                                       \
+        __m256i raw = _mm256_loadu_si256((const __m256i *)(p + i));                                \
+        VEC v = _mm256_castsi256_##PS(SWAP ? _mm256_shuffle_epi8(raw, rev) : raw);                 \
+        matches += __builtin_popcount(_mm256_movemask_##PS(_mm256_cmp_##PS(v, search, _CMP_EQ_OQ))); \
+    }                                                                                              \
+    return matches + count_scalar_##NAME(p + i, count - i, value);                                 \
+}
+
+#define COUNT_AVX512_FLOAT(W, F, PS, VEC, EPI, MASK, SWAP, NAME, TARGET)                           \
+__attribute__((target(TARGET)))                                                                    \
+static size_t count_avx512_##NAME(const void *data, size_t count, ema_value_t value) {             \
+    const uint##W##_t *p = data;                                                                   \
+    const size_t lanes = 64 / sizeof(F);                                                           \
+    uint##W##_t bits = (uint##W##_t)value;                                                         \
+    F s;                                                                                           \
+    memcpy(&s, &bits, sizeof(s));                                                                  \
+    VEC search = _mm512_set1_##PS(s);                                                              \
+    size_t matches = 0;                                                                            \
+    for (size_t i = 0; i < count; i += lanes) {                                                    \
+        MASK live = count - i < lanes ? (MASK)((1ULL << (count - i)) - 1) : (MASK)~0ULL;           \
+        __m512i raw = _mm512_maskz_loadu_##EPI(live, p + i);                                       \
+        VEC v = _mm512_castsi512_##PS(SWAP ? SWAP512_##W(raw) : raw);                              \
+        matches += __builtin_popcountll(_mm512_mask_cmp_##PS##_mask(live, v, search, _CMP_EQ_OQ)); \
+    }                                                                                              \
+    return matches;                                                                                \
+}
+
+SSE41_INT(8, epi8, epi8)
+SSE41_INT(16, epi16, epi16)
+SSE41_INT(32, epi32, epi32)
+SSE41_INT(64, epi64, epi64x)
+AVX2_INT(8, epi8, epi8)
+AVX2_INT(16, epi16, epi16)
+AVX2_INT(32, epi32, epi32)
+AVX2_INT(64, epi64, epi64x)
+AVX512_INT(8, epi8, epi8, __mmask64, "avx512f,avx512bw,popcnt")
+AVX512_INT(16, epi16, epi16, __mmask32, "avx512f,avx512bw,popcnt")
+AVX512_INT(32, epi32, epi32, __mmask16, "avx512f,popcnt")
+AVX512_INT(64, epi64, epi64, __mmask8, "avx512f,popcnt")
+
+SWAPPED_INT(sse41, 16)
+SWAPPED_INT(sse41, 32)
+SWAPPED_INT(sse41, 64)
+SWAPPED_INT(avx2, 16)
+SWAPPED_INT(avx2, 32)
+SWAPPED_INT(avx2, 64)
+SWAPPED_INT(avx512, 16)
+SWAPPED_INT(avx512, 32)
+SWAPPED_INT(avx512, 64)
+
+SSE41_FLOAT(32, float, ps, __m128, 0, f32)
+SSE41_FLOAT(64, double, pd, __m128d, 0, f64)
+SSE41_FLOAT(32, float, ps, __m128, 1, f32_swap)
+SSE41_FLOAT(64, double, pd, __m128d, 1, f64_swap)
+AVX2_FLOAT(32, float, ps, __m256, 0, f32)
+AVX2_FLOAT(64, double, pd, __m256d, 0, f64)
+AVX2_FLOAT(32, float, ps, __m256, 1, f32_swap)
+AVX2_FLOAT(64, double, pd, __m256d, 1, f64_swap)
+AVX512_FLOAT(32, float, ps, __m512, epi32, __mmask16, 0, f32, "avx512f,popcnt")
+AVX512_FLOAT(64, double, pd, __m512d, epi64, __mmask8, 0, f64, "avx512f,popcnt")
+AVX512_FLOAT(32, float, ps, __m512, epi32, __mmask16, 1, f32_swap, "avx512f,avx512bw,popcnt")
+AVX512_FLOAT(64, double, pd, __m512d, epi64, __mmask8, 1, f64_swap, "avx512f,avx512bw,popcnt")
+
+COUNT_SSE41_INT(8, epi8, epi8)
+COUNT_SSE41_INT(16, epi16, epi16)
+COUNT_SSE41_INT(32, epi32, epi32)
+COUNT_SSE41_INT(64, epi64, epi64x)
+COUNT_AVX2_INT(8, epi8, epi8)
+COUNT_AVX2_INT(16, epi16, epi16)
+COUNT_AVX2_INT(32, epi32, epi32)
+COUNT_AVX2_INT(64, epi64, epi64x)
+COUNT_AVX512_INT(8, epi8, epi8, __mmask64, "avx512f,avx512bw,popcnt")
+COUNT_AVX512_INT(16, epi16, epi16, __mmask32, "avx512f,avx512bw,popcnt")
+COUNT_AVX512_INT(32, epi32, epi32, __mmask16, "avx512f,popcnt")
+COUNT_AVX512_INT(64, epi64, epi64, __mmask8, "avx512f,popcnt")
+
+SWAPPED_COUNT_INT(sse41, 16)
+SWAPPED_COUNT_INT(sse41, 32)
+SWAPPED_COUNT_INT(sse41, 64)
+SWAPPED_COUNT_INT(avx2, 16)
+SWAPPED_COUNT_INT(avx2, 32)
+SWAPPED_COUNT_INT(avx2, 64)
+SWAPPED_COUNT_INT(avx512, 16)
+SWAPPED_COUNT_INT(avx512, 32)
+SWAPPED_COUNT_INT(avx512, 64)
+
+COUNT_SSE41_FLOAT(32, float, ps, __m128, 0, f32)
+COUNT_SSE41_FLOAT(64, double, pd, __m128d, 0, f64)
+COUNT_SSE41_FLOAT(32, float, ps, __m128, 1, f32_swap)
+COUNT_SSE41_FLOAT(64, double, pd, __m128d, 1, f64_swap)
+COUNT_AVX2_FLOAT(32, float, ps, __m256, 0, f32)
+COUNT_AVX2_FLOAT(64, double, pd, __m256d, 0, f64)
+COUNT_AVX2_FLOAT(32, float, ps, __m256, 1, f32_swap)
+COUNT_AVX2_FLOAT(64, double, pd, __m256d, 1, f64_swap)
+COUNT_AVX512_FLOAT(32, float, ps, __m512, epi32, __mmask16, 0, f32, "avx512f,popcnt")
+COUNT_AVX512_FLOAT(64, double, pd, __m512d, epi64, __mmask8, 0, f64, "avx512f,popcnt")
+COUNT_AVX512_FLOAT(32, float, ps, __m512, epi32, __mmask16, 1, f32_swap, "avx512f,avx512bw,popcnt")
+COUNT_AVX512_FLOAT(64, double, pd, __m512d, epi64, __mmask8, 1, f64_swap, "avx512f,avx512bw,popcnt")
+
+#define X86_KERNELS(NAME) scan_sse41_##NAME, scan_avx2_##NAME, scan_avx512_##NAME
+#define X86_COUNT_KERNELS(NAME) count_sse41_##NAME, count_avx2_##NAME, count_avx512_##NAME
+#else
+#define X86_KERNELS(NAME) NULL, NULL, NULL
+#define X86_COUNT_KERNELS(NAME) NULL, NULL, NULL
+#endif
+
+// Ядра по классу элементов и порядку байтов (1 - чужой), в порядке ema_kernel_t
+#define CLASS_KERNELS(NAME) { NULL, scan_scalar_##NAME, X86_KERNELS(NAME) }
+
+static const ema_scan_fn class_kernels[CLASS_COUNT][2][EMA_KERNEL_COUNT] = {
+    [CLASS_U8]  = { CLASS_KERNELS(u8), CLASS_KERNELS(u8) },
+    [CLASS_U16] = { CLASS_KERNELS(u16), CLASS_KERNELS(u16_swap) },
+    [CLASS_U32] = { CLASS_KERNELS(u32), CLASS_KERNELS(u32_swap) },
+    [CLASS_U64] = { CLASS_KERNELS(u64), CLASS_KERNELS(u64_swap) },
+    [CLASS_F32] = { CLASS_KERNELS(f32), CLASS_KERNELS(f32_swap) },
+    [CLASS_F64] = { CLASS_KERNELS(f64), CLASS_KERNELS(f64_swap) },
+};
+
+#define CLASS_COUNT_KERNELS(NAME) { NULL, count_scalar_##NAME, X86_COUNT_KERNELS(NAME) }
+
+static const ema_count_fn class_count_kernels[CLASS_COUNT][2][EMA_KERNEL_COUNT] = {
+    [CLASS_U8]  = { CLASS_COUNT_KERNELS(u8), CLASS_COUNT_KERNELS(u8) },
+    [CLASS_U16] = { CLASS_COUNT_KERNELS(u16), CLASS_COUNT_KERNELS(u16_swap) },
+    [CLASS_U32] = { CLASS_COUNT_KERNELS(u32), CLASS_COUNT_KERNELS(u32_swap) },
+    [CLASS_U64] = { CLASS_COUNT_KERNELS(u64), CLASS_COUNT_KERNELS(u64_swap) },
+    [CLASS_F32] = { CLASS_COUNT_KERNELS(f32), CLASS_COUNT_KERNELS(f32_swap) },
+    [CLASS_F64] = { CLASS_COUNT_KERNELS(f64), CLASS_COUNT_KERNELS(f64_swap) },
+};
+
+static const char *kernel_names[EMA_KERNEL_COUNT] = {
+    [EMA_KERNEL_AUTO]   = "auto",
+    [EMA_KERNEL_SCALAR] = "scalar",
+    [EMA_KERNEL_SSE41]  = "sse4.1",
+    [EMA_KERNEL_AVX2]   = "avx2",
+    [EMA_KERNEL_AVX512] = "avx512",
+};
+
+const char *ema_kernel_name(ema_kernel_t kernel) {
+    return kernel < EMA_KERNEL_COUNT ? kernel_names[kernel] : "?";
+}
+
+int ema_kernel_parse(const char *name, ema_kernel_t *kernel) {
+    for (int i = 0; i < EMA_KERNEL_COUNT; i++) {
+        if (strcasecmp(name, kernel_names[i]) == 0) {
+            *kernel = (ema_kernel_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int ema_kernel_supported(ema_kernel_t kernel) {
+#if EMA_HAVE_X86
+    __builtin_cpu_init();
+    switch (kernel) {
+        case EMA_KERNEL_AUTO:
+        case EMA_KERNEL_SCALAR: return 1;
+        case EMA_KERNEL_SSE41:  return __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt");
+        case EMA_KERNEL_AVX2:   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+        case EMA_KERNEL_AVX512: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("popcnt");
+        default: return 0;
+    }
+#else
+    return kernel == EMA_KERNEL_AUTO || kernel == EMA_KERNEL_SCALAR;
+#endif
+}
+
+ema_kernel_t ema_kernel_resolve(ema_kernel_t kernel) {
+    if (kernel != EMA_KERNEL_AUTO) {
+        return kernel;
+    }
+    // Лучшее доступное на этом CPU ядро
+    for (int k = EMA_KERNEL_COUNT - 1; k > EMA_KERNEL_SCALAR; k--) {
+        if (ema_kernel_supported((ema_kernel_t)k)) {
+            return (ema_kernel_t)k;
+        }
+    }
+    return EMA_KERNEL_SCALAR;
+}
+
+static int type_class(ema_type_t type) {
+    switch (type) {
+        case EMA_TYPE_I8:  case EMA_TYPE_U8:  return CLASS_U8;
+        case EMA_TYPE_I16: case EMA_TYPE_U16: return CLASS_U16;
+        case EMA_TYPE_I64: case EMA_TYPE_U64: return CLASS_U64;
+        case EMA_TYPE_F32: return CLASS_F32;
+        case EMA_TYPE_F64: return CLASS_F64;
+        case EMA_TYPE_I32: case EMA_TYPE_U32:
+        default: return CLASS_U32;
+    }
+}
+
+// Ядро для CPU и класса элементов: байтовым и 16-битным сравнениям и
+// перестановке байтов в AVX-512 нужен AVX-512BW, без него такие элементы
+// идут через AVX2; неподдерживаемое ядро заменяется скалярным
+static ema_kernel_t class_kernel(ema_kernel_t kernel, int cls, int swap) {
+    kernel = ema_kernel_resolve(kernel);
+#if EMA_HAVE_X86
+    if (kernel == EMA_KERNEL_AVX512 && !__builtin_cpu_supports("avx512bw") &&
+        (cls == CLASS_U8 || cls == CLASS_U16 || (swap && (cls == CLASS_F32 || cls == CLASS_F64)))) {
+        kernel = EMA_KERNEL_AVX2;
+    }
+#endif
+    if (!ema_kernel_supported(kernel) || class_kernels[cls][swap ? 1 : 0][kernel] == NULL) {
+        return EMA_KERNEL_SCALAR;
+    }
+    return kernel;
+}
+
+ema_scan_fn ema_kernel_fn(ema_kernel_t kernel, ema_type_t type, int swap) {
+    int cls = type_class(type);
+    return class_kernels[cls][swap ? 1 : 0][class_kernel(kernel, cls, swap)];
+}
+
+ema_count_fn ema_count_kernel_fn(ema_kernel_t kernel, ema_type_t type, int swap) {
+    int cls = type_class(type);
+    return class_count_kernels[cls][swap ? 1 : 0][class_kernel(kernel, cls, swap)];
+}
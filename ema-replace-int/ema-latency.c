@@ -0,0 +1,126 @@
+#define _GNU_SOURCE
+#include "ema.h"
+#include "instrument.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Гистограмма задержек: значения меньше 2^SUB_BITS нс лежат в своих
+// корзинах, дальше каждая степень двойки [2^e, 2^(e+1)) делится на
+// 2^SUB_BITS равных корзин. Индекс - старший бит и следующие за ним
+// SUB_BITS бит значения, без циклов и ветвлений по величине.
+
+#define SUB_COUNT (1ULL << EMA_LATENCY_SUB_BITS)
+
+static const char *op_names[EMA_OP_COUNT] = {
+    [EMA_OP_READ] = "read",
+    [EMA_OP_WRITE] = "write",
+    [EMA_OP_FAULT] = "fault",
+};
+
+const char *ema_op_name(ema_op_t op) {
+    return op < EMA_OP_COUNT ? op_names[op] : "?";
+}
+
+static inline unsigned bucket_of(unsigned long long ns) {
+    if (ns < SUB_COUNT) {
+        return (unsigned)ns;
+    }
+    unsigned e = 63 - __builtin_clzll(ns);
+    unsigned sub = (unsigned)(ns >> (e - EMA_LATENCY_SUB_BITS)) & (SUB_COUNT - 1);
+    return ((e - EMA_LATENCY_SUB_BITS + 1) << EMA_LATENCY_SUB_BITS) + sub;
+}
+
+static unsigned long long bucket_low(unsigned b) {
+    if (b < SUB_COUNT) {
+        return b;
+    }
+    unsigned e = (b >> EMA_LATENCY_SUB_BITS) + EMA_LATENCY_SUB_BITS - 1;
+    return (SUB_COUNT + (b & (SUB_COUNT - 1))) << (e - EMA_LATENCY_SUB_BITS);
+}
+
+static unsigned long long bucket_high(unsigned b) {
+    if (b < SUB_COUNT) {
+        return b;
+    }
+    unsigned e = (b >> EMA_LATENCY_SUB_BITS) + EMA_LATENCY_SUB_BITS - 1;
+    return bucket_low(b) + (1ULL << (e - EMA_LATENCY_SUB_BITS)) - 1;
+}
+
+void ema_latency_record(ema_latency_t *latency, ema_op_t op, unsigned long long start_ns) {
+    if (latency == NULL) {
+        return;
+    }
+    ema_histogram_record(&latency->ops[op], get_time_ns() - start_ns);
+}
+
+void ema_histogram_record(ema_histogram_t *hist, unsigned long long ns) {
+    __atomic_fetch_add(&hist->counts[bucket_of(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->total, 1, __ATOMIC_RELAXED);
+    unsigned long long max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n(&hist->max, &max, ns, 1,
+                                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void ema_latency_add(ema_latency_t *total, const ema_latency_t *part) {
+    for (int op = 0; op < EMA_OP_COUNT; op++) {
+        ema_histogram_t *t = &total->ops[op];
+        const ema_histogram_t *p = &part->ops[op];
+        for (int b = 0; b < EMA_LATENCY_BUCKETS; b++) {
+            t->counts[b] += p->counts[b];
+        }
+        t->total += p->total;
+        if (p->max > t->max) {
+            t->max = p->max;
+        }
+    }
+}
+
+unsigned long long ema_histogram_quantile(const ema_histogram_t *hist, double q) {
+    if (hist->total == 0) {
+        return 0;
+    }
+    unsigned long long rank = (unsigned long long)(q * hist->total + 0.5);
+    rank = rank < 1 ? 1 : rank;
+    unsigned long long seen = 0;
+    for (unsigned b = 0; b < EMA_LATENCY_BUCKETS; b++) {
+        seen += hist->counts[b];
+        if (seen >= rank) {
+            unsigned long long high = bucket_high(b);
+            return high < hist->max ? high : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+void ema_latency_print(const ema_latency_t *latency, const char *indent) {
+    for (int op = 0; op < EMA_OP_COUNT; op++) {
+        const ema_histogram_t *hist = &latency->ops[op];
+        if (hist->total == 0) {
+            continue;
+        }
+        printf("%s%-5s latency (us): p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f (%llu ops)\n",
+               indent, ema_op_name((ema_op_t)op),
+               ema_histogram_quantile(hist, 0.50) / 1000.0, ema_histogram_quantile(hist, 0.90) / 1000.0,
+               ema_histogram_quantile(hist, 0.99) / 1000.0, ema_histogram_quantile(hist, 0.999) / 1000.0,
+               hist->max / 1000.0, hist->total);
+    }
+}
+
+int ema_latency_dump(const ema_latency_t *latency, const char *label, FILE *out) {
+    for (int op = 0; op < EMA_OP_COUNT; op++) {
+        const ema_histogram_t *hist = &latency->ops[op];
+        for (unsigned b = 0; b < EMA_LATENCY_BUCKETS; b++) {
+            if (hist->counts[b] == 0) {
+                continue;
+            }
+            if (fprintf(out, "%s,%s,%llu,%llu,%llu\n", label, ema_op_name((ema_op_t)op),
+                        bucket_low(b), bucket_high(b), hist->counts[b]) < 0) {
+                perror("fprintf");
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,174 @@
+#define _GNU_SOURCE
+#include "ema.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+// Режим в памяти: файл целиком загружается в анонимный буфер, и проходы
+// идут по нему без ввода-вывода - так отделяется пропускная способность
+// памяти и ядра сканирования от пути ввода-вывода ядра ОС.
+//
+// Буфер сначала пробуем взять из пула MAP_HUGETLB; если пул пуст или не
+// настроен, берём обычную анонимную память и просим THP через
+// MADV_HUGEPAGE. Привязка к узлу NUMA ставится до первого касания,
+// поэтому все страницы сразу выделяются на нём.
+
+#define MEMORY_HUGE_PAGE (2UL * 1024 * 1024)
+
+static const char *huge_names[] = {
+    [EMA_HUGE_NONE] = "none",
+    [EMA_HUGE_THP] = "transparent huge pages",
+    [EMA_HUGE_HUGETLB] = "MAP_HUGETLB",
+};
+
+const char *ema_huge_name(ema_huge_t huge) {
+    return huge <= EMA_HUGE_HUGETLB ? huge_names[huge] : "?";
+}
+
+// Объём отображения, начинающегося с data, покрытый huge pages, по
+// /proc/self/smaps; -1, если узнать не удалось
+static long long huge_backed(const void *data) {
+    FILE *f = fopen("/proc/self/smaps", "r");
+    if (f == NULL) {
+        return -1;
+    }
+    char line[256];
+    int inside = 0;
+    int found = 0;
+    long long kb = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned long begin, end;
+        if (sscanf(line, "%lx-%lx ", &begin, &end) == 2) {
+            inside = begin == (unsigned long)data;
+            continue;
+        }
+        long long value;
+        if (inside && (sscanf(line, "AnonHugePages: %lld kB", &value) == 1 ||
+                       sscanf(line, "Private_Hugetlb: %lld kB", &value) == 1)) {
+            kb += value;
+            found = 1;
+        }
+    }
+    fclose(f);
+    return found ? kb * 1024 : -1;
+}
+
+static int memory_read(int fd, const char *filename, ema_memory_t *memory) {
+    size_t done = 0;
+    while (done < memory->size) {
+        ssize_t bytes = pread(fd, (char *)memory->data + done, memory->size - done, done);
+        if (bytes == -1) {
+            perror("read");
+            return -1;
+        }
+        if (bytes == 0) {
+            fprintf(stderr, "Error: %s shrank while loading\n", filename);
+            return -1;
+        }
+        done += bytes;
+    }
+    return 0;
+}
+
+int ema_memory_load(const char *filename, int numa_node, ema_memory_t *memory) {
+    memset(memory, 0, sizeof(*memory));
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        perror("open");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        close(fd);
+        return -1;
+    }
+    memory->size = st.st_size;
+    if (memory->size == 0) {
+        close(fd);
+        fprintf(stderr, "Error: %s is empty\n", filename);
+        return -1;
+    }
+
+    memory->mapped = (memory->size + MEMORY_HUGE_PAGE - 1) / MEMORY_HUGE_PAGE * MEMORY_HUGE_PAGE;
+    memory->data = mmap(NULL, memory->mapped, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    memory->huge = EMA_HUGE_HUGETLB;
+    if (memory->data == MAP_FAILED) {
+        memory->data = mmap(NULL, memory->mapped, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        memory->huge = memory->data != MAP_FAILED && madvise(memory->data, memory->mapped, MADV_HUGEPAGE) == 0
+            ? EMA_HUGE_THP : EMA_HUGE_NONE;
+    }
+    if (memory->data == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+        memory->data = NULL;
+        return -1;
+    }
+
+    memory->numa_node = numa_node;
+    if (numa_node >= 0) {
+        unsigned long mask[16] = { 0 };
+        if (numa_node >= (int)(sizeof(mask) * 8)) {
+            fprintf(stderr, "Error: NUMA node %d is out of range\n", numa_node);
+            goto fail;
+        }
+        mask[numa_node / (sizeof(unsigned long) * 8)] |= 1UL << (numa_node % (sizeof(unsigned long) * 8));
+        if (syscall(SYS_mbind, memory->data, memory->mapped, MPOL_BIND, mask,
+                    sizeof(mask) * 8, MPOL_MF_STRICT) == -1) {
+            perror("mbind");
+            goto fail;
+        }
+    }
+
+    // Чтение в буфер заодно и выделяет все страницы до замеров
+    if (memory_read(fd, filename, memory) == -1) {
+        goto fail;
+    }
+    close(fd);
+    memory->huge_bytes = huge_backed(memory->data);
+    return 0;
+
+fail:
+    close(fd);
+    ema_memory_free(memory);
+    return -1;
+}
+
+// Файл в режиме в памяти не меняется, поэтому повторное чтение
+// возвращает буфер к исходному содержимому
+int ema_memory_reload(const char *filename, ema_memory_t *memory) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        perror("open");
+        return -1;
+    }
+    int status = memory_read(fd, filename, memory);
+    close(fd);
+    return status;
+}
+
+void ema_memory_free(ema_memory_t *memory) {
+    if (memory->data != NULL) {
+        munmap(memory->data, memory->mapped);
+    }
+    memset(memory, 0, sizeof(*memory));
+}
+
+// Проход по буферу: постранично тем же сканированием, что и mmap
+// движок, в cfg->threads потоков по диапазонам
+int ema_memory_pass(const ema_config_t *cfg, ema_stats_t *stats) {
+    if (cfg->threads > 1) {
+        return ema_run_parallel(NULL, cfg, stats);
+    }
+    ema_mmap_scan(cfg->memory->data, 0, cfg->memory->size, cfg, stats);
+    return 0;
+}
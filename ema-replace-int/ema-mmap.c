@@ -0,0 +1,117 @@
+#define _GNU_SOURCE
+#include "ema.h"
+#include "instrument.h"
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Отображение файла целиком (MAP_SHARED, MADV_SEQUENTIAL). Для пустого
+// файла возвращает NULL с *size == 0, при ошибке - MAP_FAILED.
+int *ema_map_file(const char *filename, const ema_config_t *cfg, size_t *size, ema_stats_t *stats) {
+    *size = 0;
+    int fd = open(filename, O_RDWR);
+    stats->other_calls++;
+    if (fd == -1) {
+        perror("open");
+        return MAP_FAILED;
+    }
+
+    struct stat st;
+    stats->other_calls++;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        close(fd);
+        return MAP_FAILED;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    *size = st.st_size;
+    int flags = MAP_SHARED | (cfg->mmap_populate ? MAP_POPULATE : 0);
+    int *data = mmap(NULL, *size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    close(fd);
+    stats->other_calls += 2;
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return MAP_FAILED;
+    }
+    madvise(data, *size, MADV_SEQUENTIAL);
+    stats->other_calls++;
+    return data;
+}
+
+// Поиск и замена в байтах [begin, end) отображения; begin кратен
+// странице. Сканируем постранично: ядро сбросит на диск всю грязную
+// страницу, поэтому и учитываем записанное страницами; последняя неполная
+// страница - по её длине в файле. С cfg->latency
+// время сканирования каждой страницы - окно её промаха - идёт в гистограмму.
+// Страницы зон, отсечённых картой зон, не трогаются вовсе.
+void ema_mmap_scan(void *data, size_t begin, size_t end, const ema_config_t *cfg, ema_stats_t *stats) {
+    // Как и в read/write движке, хвост короче элемента не рассматривается
+    size_t elem = ema_type_size(cfg->type);
+    size_t first = begin / elem;
+    size_t last = end / elem;
+    size_t page_elems = sysconf(_SC_PAGESIZE) / elem;
+    ema_scan_fn scan = ema_kernel_fn(cfg->kernel, cfg->type, cfg->swap);
+    unsigned long long dirty_bytes = 0;
+    const ema_zonemap_t *zones = ema_zonemap_prunes(cfg) ? cfg->zonemap : NULL;
+    off_t zone_end = begin;
+    size_t pruned = 0;
+    for (size_t i = first; i < last; i += page_elems) {
+        if (zones != NULL && (off_t)(i * elem) >= zone_end) {
+            // Зоны кратны странице, поэтому следующая серия начинается со страницы
+            size_t next = ema_zonemap_next(zones, cfg->search_value, i * elem, &zone_end) / elem;
+            next = next < last ? next : last;
+            pruned += (next - i) * elem;
+            i = next;
+            if (i >= last) {
+                break;
+            }
+        }
+        size_t n = last - i < page_elems ? last - i : page_elems;
+        unsigned long long op_start = cfg->latency ? get_time_ns() : 0;
+        size_t found = ema_scan_block(cfg, scan, (char *)data + i * elem, n, i * elem);
+        ema_latency_record(cfg->latency, EMA_OP_FAULT, op_start);
+        if (found > 0) {
+            stats->matches += found;
+            dirty_bytes += n * elem;
+        }
+    }
+    stats->bytes_read += end - begin - pruned;
+    stats->bytes_pruned += pruned;
+    stats->bytes_written += dirty_bytes;
+}
+
+int ema_unmap_file(int *data, size_t size, const ema_config_t *cfg, ema_stats_t *stats) {
+    int status = 0;
+    if (cfg->mmap_sync) {
+        stats->other_calls++;
+        if (msync(data, size, MS_SYNC) == -1) {
+            perror("msync");
+            status = -1;
+        }
+    }
+    munmap(data, size);
+    stats->other_calls++;
+    return status;
+}
+
+// Поиск и замена через MAP_SHARED отображение: int'ы правятся прямо в
+// страничном кэше, без read/lseek/write на каждый грязный блок
+int replace_in_file_mmap(const char *filename, const ema_config_t *cfg, ema_stats_t *stats) {
+    size_t size;
+    int *data = ema_map_file(filename, cfg, &size, stats);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    if (data == NULL) {
+        return 0;
+    }
+    ema_mmap_scan(data, 0, size, cfg, stats);
+    return ema_unmap_file(data, size, cfg, stats);
+}
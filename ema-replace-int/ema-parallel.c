@@ -0,0 +1,139 @@
+#define _GNU_SOURCE
+#include "ema.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Многопоточный проход: файл делится на cfg->threads смежных диапазонов,
+// выровненных по блоку (rw, uring) или странице (mmap, буфер в памяти). Каждый поток сканирует
+// свой диапазон, счётчики сливаются в конце. Границы кратны sizeof(int),
+// поэтому результат совпадает с однопоточным проходом.
+
+typedef struct {
+    const ema_config_t *cfg;
+    int fd;             // rw, uring: общий дескриптор (pread/pwrite потокобезопасны)
+    int *map;           // mmap: общее отображение
+    off_t start;
+    off_t end;
+    ema_stats_t stats;
+    int status;
+} range_job_t;
+
+static void *range_worker(void *arg) {
+    range_job_t *job = (range_job_t *)arg;
+    if (job->map != NULL) {
+        ema_mmap_scan(job->map, job->start, job->end, job->cfg, &job->stats);
+        return NULL;
+    }
+    if (job->cfg->engine == EMA_ENGINE_URING) {
+        // У каждого потока своё кольцо
+        job->status = ema_uring_range(job->fd, job->start, job->end, job->cfg, &job->stats);
+        return NULL;
+    }
+
+    int *buffer = ema_alloc_block(job->cfg->block_size ? job->cfg->block_size : BUFFER_SIZE);
+    if (buffer == NULL) {
+        job->status = -1;
+        return NULL;
+    }
+    job->status = ema_rw_range(job->fd, job->start, job->end, buffer, job->cfg, &job->stats);
+    free(buffer);
+    return NULL;
+}
+
+int ema_run_parallel(const char *filename, const ema_config_t *cfg, ema_stats_t *stats) {
+    int threads = cfg->threads;
+    int fd = -1;
+    int *map = NULL;
+    size_t size = 0;
+    size_t align;
+
+    if (cfg->memory != NULL) {
+        // Режим в памяти: буфер общий, отображать и закрывать нечего
+        map = cfg->memory->data;
+        size = cfg->memory->size;
+        align = sysconf(_SC_PAGESIZE);
+    } else if (cfg->engine == EMA_ENGINE_MMAP) {
+        map = ema_map_file(filename, cfg, &size, stats);
+        if (map == MAP_FAILED) {
+            return -1;
+        }
+        if (map == NULL) {
+            return 0;
+        }
+        align = sysconf(_SC_PAGESIZE);
+    } else {
+        fd = ema_open_data(filename, cfg, stats);
+        if (fd == -1) {
+            return -1;
+        }
+        struct stat st;
+        stats->other_calls++;
+        if (fstat(fd, &st) == -1) {
+            perror("fstat");
+            close(fd);
+            return -1;
+        }
+        size = st.st_size;
+        align = cfg->block_size ? cfg->block_size : BUFFER_SIZE;
+    }
+
+    // Размер диапазона округляется вверх до выравнивания; при маленьком
+    // файле последние потоки могут остаться без работы
+    size_t chunk = (size + threads - 1) / threads;
+    chunk = (chunk + align - 1) / align * align;
+
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    range_job_t *jobs = calloc(threads, sizeof(range_job_t));
+    int status = 0;
+    if (tids == NULL || jobs == NULL) {
+        perror("malloc");
+        status = -1;
+        goto out;
+    }
+
+    int started = 0;
+    for (int t = 0; t < threads; t++) {
+        jobs[t].cfg = cfg;
+        jobs[t].fd = fd;
+        jobs[t].map = map;
+        off_t offset = (off_t)t * (off_t)chunk;
+        jobs[t].start = offset < (off_t)size ? offset : (off_t)size;
+        jobs[t].end = jobs[t].start + (off_t)chunk < (off_t)size ? jobs[t].start + (off_t)chunk : (off_t)size;
+        if (pthread_create(&tids[t], NULL, range_worker, &jobs[t]) != 0) {
+            perror("pthread_create");
+            status = -1;
+            break;
+        }
+        started++;
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+        ema_stats_add(stats, &jobs[t].stats);
+        if (jobs[t].status == -1) {
+            status = -1;
+        }
+    }
+
+out:
+    free(tids);
+    free(jobs);
+    if (cfg->memory != NULL) {
+        return status;
+    }
+    if (map != NULL) {
+        if (ema_unmap_file(map, size, cfg, stats) == -1) {
+            status = -1;
+        }
+    } else {
+        close(fd);
+        stats->other_calls++;
+    }
+    return status;
+}
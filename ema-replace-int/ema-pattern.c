@@ -0,0 +1,289 @@
+#define _GNU_SOURCE
+#include "ema.h"
+#include "ema-gen.h"
+#include "instrument.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Нагрузка с заданным шаблоном доступа: вместо одного последовательного
+// прохода выполняется cfg->ops запросов по cfg->request_size байт.
+// Файл делится на слоты размером с запрос, шаблон выбирает слот для
+// каждой операции. Доля cfg->write_ratio операций - read-modify-write
+// (чтение, замена search -> replace, запись всего запроса), остальные
+// только читают и считают совпадения.
+//
+// Слот и тип операции i - функция от (seed, i), поэтому последовательность
+// запросов воспроизводима и не зависит от числа потоков: поток t
+// выполняет операции t, t + threads, ...
+// Одновременные read-modify-write одного слота из разных потоков не
+// упорядочиваются (как и в реальной нагрузке без блокировок), поэтому
+// число замен при нескольких потоках может немного отличаться.
+
+#define PATTERN_ZIPF_EXPONENT 1.0
+#define PATTERN_ZIPF_MAX_RANKS (1 << 24)  // дальше ранги делят файл на корзины
+#define PATTERN_HOT_DATA 0.1              // hotcold: горячая доля файла...
+#define PATTERN_HOT_OPS 0.9               // ...и доля операций, попадающих в неё
+#define PATTERN_SCRAMBLE 2654435761ULL    // простое > максимального числа рангов
+
+static const char *pattern_names[EMA_PATTERN_COUNT] = {
+    [EMA_PATTERN_NONE] = "none",
+    [EMA_PATTERN_SEQ] = "seq",
+    [EMA_PATTERN_RANDOM] = "random",
+    [EMA_PATTERN_STRIDED] = "strided",
+    [EMA_PATTERN_ZIPF] = "zipf",
+    [EMA_PATTERN_HOTCOLD] = "hotcold",
+};
+
+const char *ema_pattern_name(ema_pattern_t pattern) {
+    return pattern < EMA_PATTERN_COUNT ? pattern_names[pattern] : "?";
+}
+
+int ema_pattern_parse(const char *name, ema_pattern_t *pattern) {
+    for (int i = EMA_PATTERN_SEQ; i < EMA_PATTERN_COUNT; i++) {
+        if (strcmp(name, pattern_names[i]) == 0) {
+            *pattern = (ema_pattern_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+typedef struct {
+    const ema_config_t *cfg;
+    int fd;                     // rw
+    int *map;                   // mmap
+    unsigned long long slots;   // запросов помещается в файл
+    unsigned long long ops;
+    uint64_t key;
+    uint64_t write_threshold;   // read-modify-write, если старшие 32 бита меньше
+    ema_zipf_t zipf;
+    unsigned long long zipf_bucket;  // слотов на ранг zipf
+    ema_count_fn count;         // запросы только на чтение: подсчёт без записи
+} pattern_t;
+
+typedef struct {
+    pattern_t *pattern;
+    int id;
+    int threads;
+    ema_stats_t stats;
+    int status;
+} pattern_job_t;
+
+// Равномерное число 0..n-1 из 64 случайных бит
+static inline unsigned long long uniform(uint64_t r, unsigned long long n) {
+    return (unsigned long long)(((unsigned __int128)r * n) >> 64);
+}
+
+static unsigned long long pick_slot(const pattern_t *p, unsigned long long i, uint64_t r) {
+    unsigned long long n = p->slots;
+    switch (p->cfg->pattern) {
+        case EMA_PATTERN_RANDOM:
+            return uniform(r, n);
+        case EMA_PATTERN_STRIDED: {
+            // После каждого оборота сдвигаемся на слот, чтобы при шаге,
+            // кратном числу слотов, не ходить по одним и тем же
+            unsigned long long step = p->cfg->stride / p->cfg->request_size;
+            unsigned long long pos = i * (step ? step : 1);
+            return (pos % n + pos / n) % n;
+        }
+        case EMA_PATTERN_ZIPF: {
+            // Горячие ранги разбросаны по файлу перестановкой
+            unsigned long long rank = ema_zipf_sample(&p->zipf, r);
+            rank = rank * PATTERN_SCRAMBLE % (unsigned long long)p->zipf.n;
+            return rank * p->zipf_bucket + uniform(ema_mix64(r), p->zipf_bucket);
+        }
+        case EMA_PATTERN_HOTCOLD: {
+            unsigned long long hot = (unsigned long long)(n * PATTERN_HOT_DATA);
+            hot = hot ? hot : 1;
+            uint64_t r2 = ema_mix64(r);
+            if ((r >> 32) < (uint64_t)(PATTERN_HOT_OPS * 4294967296.0) || hot == n) {
+                return uniform(r2, hot);
+            }
+            return hot + uniform(r2, n - hot);
+        }
+        case EMA_PATTERN_SEQ:
+        default:
+            return i % n;
+    }
+}
+
+static int pattern_op_rw(const pattern_t *p, int *buffer, off_t offset, int modify, pattern_job_t *job) {
+    ema_stats_t *stats = &job->stats;
+    const ema_config_t *cfg = p->cfg;
+    size_t size = cfg->request_size;
+    unsigned long long op_start = cfg->latency ? get_time_ns() : 0;
+    ssize_t bytes = pread(p->fd, buffer, size, offset);
+    ema_latency_record(cfg->latency, EMA_OP_READ, op_start);
+    stats->read_calls++;
+    if (bytes != (ssize_t)size) {
+        perror("pread");
+        return -1;
+    }
+    stats->bytes_read += size;
+    size_t count = size / sizeof(int);
+    if (!modify) {
+        stats->read_matches += p->count(buffer, count, cfg->search_value);
+        return 0;
+    }
+    stats->matches += ema_scan_block(cfg, ema_kernel_fn(cfg->kernel, cfg->type, cfg->swap), buffer, count, offset);
+    op_start = cfg->latency || cfg->sync != EMA_SYNC_NONE ? get_time_ns() : 0;
+    ssize_t written = pwrite(p->fd, buffer, size, offset);
+    if (cfg->sync != EMA_SYNC_NONE) {
+        stats->write_ns += get_time_ns() - op_start;
+    }
+    ema_latency_record(cfg->latency, EMA_OP_WRITE, op_start);
+    stats->write_calls++;
+    if (written != (ssize_t)size) {
+        perror("pwrite");
+        return -1;
+    }
+    stats->bytes_written += size;
+    return 0;
+}
+
+static void pattern_op_mmap(const pattern_t *p, off_t offset, int modify, pattern_job_t *job) {
+    const ema_config_t *cfg = p->cfg;
+    ema_stats_t *stats = &job->stats;
+    int *data = p->map + offset / sizeof(int);
+    size_t count = cfg->request_size / sizeof(int);
+    stats->bytes_read += cfg->request_size;
+    // Окно обращения к запросу: в нём и набегают промахи по страницам
+    unsigned long long op_start = cfg->latency ? get_time_ns() : 0;
+    if (!modify) {
+        stats->read_matches += p->count(data, count, cfg->search_value);
+    } else {
+        stats->matches += ema_scan_block(cfg, ema_kernel_fn(cfg->kernel, cfg->type, cfg->swap), data, count, offset);
+        stats->bytes_written += cfg->request_size;
+    }
+    ema_latency_record(cfg->latency, EMA_OP_FAULT, op_start);
+}
+
+static void *pattern_worker(void *arg) {
+    pattern_job_t *job = (pattern_job_t *)arg;
+    const pattern_t *p = job->pattern;
+    int *buffer = NULL;
+    if (p->map == NULL) {
+        buffer = ema_alloc_block(p->cfg->request_size);
+        if (buffer == NULL) {
+            job->status = -1;
+            return NULL;
+        }
+    }
+    for (unsigned long long i = job->id; i < p->ops; i += job->threads) {
+        uint64_t r = ema_mix64(p->key + i * 0x9E3779B97F4A7C15ULL);
+        off_t offset = (off_t)(pick_slot(p, i, r) * p->cfg->request_size);
+        int modify = (ema_mix64(r ^ 0xD1B54A32D192ED03ULL) >> 32) < p->write_threshold;
+        job->stats.ops++;
+        job->stats.rmw_ops += modify;
+        if (p->map != NULL) {
+            pattern_op_mmap(p, offset, modify, job);
+        } else if (pattern_op_rw(p, buffer, offset, modify, job) == -1) {
+            job->status = -1;
+            break;
+        }
+    }
+    free(buffer);
+    return NULL;
+}
+
+int ema_pattern_pass(const char *filename, const ema_config_t *cfg, ema_stats_t *stats) {
+    pattern_t p;
+    memset(&p, 0, sizeof(p));
+    p.cfg = cfg;
+    p.fd = -1;
+    size_t size = 0;
+
+    if (cfg->engine == EMA_ENGINE_MMAP) {
+        p.map = ema_map_file(filename, cfg, &size, stats);
+        if (p.map == MAP_FAILED) {
+            return -1;
+        }
+        if (p.map != NULL && cfg->pattern != EMA_PATTERN_SEQ) {
+            // Упреждающее чтение при случайном доступе только мешает
+            madvise(p.map, size, MADV_RANDOM);
+            stats->other_calls++;
+        }
+    } else {
+        p.fd = ema_open_data(filename, cfg, stats);
+        if (p.fd == -1) {
+            return -1;
+        }
+        struct stat st;
+        stats->other_calls++;
+        if (fstat(p.fd, &st) == -1) {
+            perror("fstat");
+            close(p.fd);
+            return -1;
+        }
+        size = st.st_size;
+    }
+
+    int status = -1;
+    p.slots = size / cfg->request_size;
+    if (p.slots == 0) {
+        fprintf(stderr, "Error: file is smaller than one %zu-byte request\n", cfg->request_size);
+        goto out;
+    }
+    p.ops = cfg->ops ? cfg->ops : p.slots;
+    p.key = ema_mix64(cfg->seed ^ 0x6A09E667F3BCC909ULL);
+    p.write_threshold = (uint64_t)(cfg->write_ratio * 4294967296.0);
+    p.count = ema_count_kernel_fn(cfg->kernel, cfg->type, cfg->swap);
+    if (cfg->pattern == EMA_PATTERN_ZIPF) {
+        int ranks = p.slots < PATTERN_ZIPF_MAX_RANKS ? (int)p.slots : PATTERN_ZIPF_MAX_RANKS;
+        if (ema_zipf_init(&p.zipf, ranks, PATTERN_ZIPF_EXPONENT) == -1) {
+            goto out;
+        }
+        p.zipf_bucket = p.slots / ranks;
+    }
+
+    int threads = cfg->threads > 0 ? cfg->threads : 1;
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    pattern_job_t *jobs = calloc(threads, sizeof(pattern_job_t));
+    if (tids == NULL || jobs == NULL) {
+        perror("malloc");
+        free(tids);
+        free(jobs);
+        goto out;
+    }
+    status = 0;
+    int started = 0;
+    for (int t = 0; t < threads; t++) {
+        jobs[t].pattern = &p;
+        jobs[t].id = t;
+        jobs[t].threads = threads;
+        if (pthread_create(&tids[t], NULL, pattern_worker, &jobs[t]) != 0) {
+            perror("pthread_create");
+            status = -1;
+            break;
+        }
+        started++;
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+        ema_stats_add(stats, &jobs[t].stats);
+        if (jobs[t].status == -1) {
+            status = -1;
+        }
+    }
+    free(tids);
+    free(jobs);
+
+out:
+    ema_zipf_free(&p.zipf);
+    if (p.map != NULL) {
+        if (ema_unmap_file(p.map, size, cfg, stats) == -1) {
+            status = -1;
+        }
+    } else if (p.fd != -1) {
+        close(p.fd);
+        stats->other_calls++;
+    }
+    return status;
+}
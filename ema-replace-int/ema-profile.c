@@ -0,0 +1,107 @@
+#define _GNU_SOURCE
+#include "ema.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Профиль настройки, найденный --autotune: текстовый файл строк
+// "<ключ> = <значение>", '#' - комментарий. Профиль запоминает только
+// то, что зависит от носителя (движок, блок, потоки, глубина очереди);
+// значения поиска и замены и остальные параметры задаются как обычно.
+
+#define PROFILE_MAX_THREADS 1024
+#define PROFILE_MAX_QUEUE_DEPTH 1024
+
+int ema_profile_save(const ema_profile_t *profile, const char *path, const char *filename) {
+    // Как и индекс: временный файл и переименование
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL) {
+        perror(tmp);
+        return -1;
+    }
+    fprintf(f, "# ema-replace-int profile, tuned on %s (%.2f MB/s)\n", filename, profile->mbps);
+    fprintf(f, "engine = %s\n", ema_engine_name(profile->engine));
+    fprintf(f, "block_size = %zu\n", profile->block_size);
+    fprintf(f, "threads = %d\n", profile->threads);
+    fprintf(f, "queue_depth = %d\n", profile->queue_depth);
+    int status = ferror(f) ? -1 : 0;
+    if (fclose(f) != 0) {
+        status = -1;
+    }
+    if (status == 0 && rename(tmp, path) == -1) {
+        status = -1;
+    }
+    if (status == -1) {
+        perror(path);
+        unlink(tmp);
+    }
+    return status;
+}
+
+static int profile_number(const char *value, long long min, long long max, long long *result) {
+    char *end;
+    long long n = strtoll(value, &end, 10);
+    if (end == value || *end != '\0' || n < min || n > max) {
+        return -1;
+    }
+    *result = n;
+    return 0;
+}
+
+int ema_profile_load(ema_profile_t *profile, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    memset(profile, 0, sizeof(*profile));
+    profile->engine = EMA_ENGINE_RW;
+    profile->block_size = BUFFER_SIZE;
+    profile->threads = 1;
+    profile->queue_depth = 16;
+
+    int status = 0;
+    char line[256];
+    int line_no = 0;
+    while (status == 0 && fgets(line, sizeof(line), f) != NULL) {
+        line_no++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        char key[64], value[128];
+        if (sscanf(line, " %63[a-z_] = %127s", key, value) != 2) {
+            if (strspn(line, " \t") != strlen(line)) {
+                fprintf(stderr, "%s:%d: expected '<key> = <value>'\n", path, line_no);
+                status = -1;
+            }
+            continue;
+        }
+        long long n = 0;
+        if (strcmp(key, "engine") == 0) {
+            status = ema_engine_parse(value, &profile->engine);
+        } else if (strcmp(key, "block_size") == 0) {
+            status = profile_number(value, MIN_BLOCK_SIZE, MAX_BLOCK_SIZE, &n);
+            if (status == 0 && n % MIN_BLOCK_SIZE != 0) {
+                status = -1;
+            }
+            profile->block_size = n;
+        } else if (strcmp(key, "threads") == 0) {
+            status = profile_number(value, 1, PROFILE_MAX_THREADS, &n);
+            profile->threads = (int)n;
+        } else if (strcmp(key, "queue_depth") == 0) {
+            status = profile_number(value, 1, PROFILE_MAX_QUEUE_DEPTH, &n);
+            profile->queue_depth = (int)n;
+        } else {
+            fprintf(stderr, "%s:%d: unknown key '%s'\n", path, line_no, key);
+            status = -1;
+            continue;
+        }
+        if (status == -1) {
+            fprintf(stderr, "%s:%d: invalid %s '%s'\n", path, line_no, key, value);
+        }
+    }
+    fclose(f);
+    return status;
+}
@@ -4,207 +4,1701 @@
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include <sys/time.h>
+#include <time.h>
+#include <getopt.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <limits.h>
 
-#define BUFFER_SIZE (4096)  // Размер буфера для чтения
+#include "instrument.h"
+#include "parse.h"
+#include "ema.h"
+#include "ema-gen.h"
 
-// Получение текущего времени в микросекундах
-long long get_time_us() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+#define MAX_THREAD_COUNTS 16
+#define MAX_QUEUE_DEPTHS 16
+#define MAX_QUEUE_DEPTH 1024  // кольцо uring: до 32 записей на слот, не больше 32768 SQE
+
+// Состояние page cache перед каждой замеряемой итерацией
+typedef enum {
+    CACHE_UNCONTROLLED,  // как получится: первая итерация может быть холодной
+    CACHE_COLD,          // fdatasync + POSIX_FADV_DONTNEED перед итерацией
+    CACHE_WARM,          // файл прочитан в page cache до замера
+} cache_mode_t;
+
+// Метка, которой помечаются все цифры пропускной способности
+const char *cache_label(cache_mode_t mode, const ema_config_t *cfg) {
+    if (cfg->memory != NULL) {
+        return "in-memory";
+    }
+    if (cfg->direct) {
+        return "direct";
+    }
+    switch (mode) {
+        case CACHE_COLD:
+            return "cold";
+        case CACHE_WARM:
+            return "warm";
+        default:
+            return "uncontrolled";
+    }
 }
 
-// Поиск и замена значения в файле
-int replace_in_file(const char *filename, int search_value, int replace_value, 
-                    unsigned long long *matches_found, unsigned long long *bytes_read) {
-    int fd = open(filename, O_RDWR);
-    if (fd == -1) {
-        perror("open");
+// Имя движка для отчётов; буфер в памяти сканируется без движка ввода-вывода
+const char *engine_label(const ema_config_t *cfg) {
+    return cfg->memory != NULL ? "memory" : ema_engine_name(cfg->engine);
+}
+
+// Итоги серии итераций одной конфигурацией
+typedef struct {
+    ema_config_t cfg;
+    cache_mode_t cache;
+    int iterations;
+    unsigned long long total_matches;
+    unsigned long long total_bytes;
+    unsigned long long total_written;
+    ema_stats_t calls;  // суммарные счётчики системных вызовов
+    long long elapsed_us;
+    long long cache_us; // подготовка page cache, в elapsed_us не входит
+    long long reset_us; // восстановление из шаблона, в elapsed_us не входит
+    ema_reset_t reset;
+    int index_patches;  // итерации, выполненные по индексу без сканирования
+} ema_run_t;
+
+// Получение размера файла
+off_t get_file_size(const char *filename) {
+    struct stat st;
+    if (stat(filename, &st) == -1) {
+        perror("stat");
         return -1;
     }
-    
-    int *buffer = malloc(BUFFER_SIZE);
-    if (buffer == NULL) {
-        perror("malloc");
-        close(fd);
+    return st.st_size;
+}
+
+// Создание файла со случайными числами и ~1% искомых значений общим
+// генератором ema-gen-data
+int create_data_file(const char *filename, int size_mb, int search_value, size_t block_size) {
+    printf("File does not exist. Creating new file with size %d MB...\n", size_mb);
+
+    ema_gen_config_t gen = EMA_GEN_CONFIG_DEFAULT;
+    gen.seed = time(NULL);
+    gen.density = 0.01;
+    gen.planted_value = search_value;
+    if (block_size > gen.block_size) {
+        gen.block_size = block_size;
+    }
+    unsigned long long planted;
+    if (ema_gen_file(filename, (unsigned long long)size_mb * 1024 * 1024, &gen, &planted) == -1) {
         return -1;
     }
-    
-    *matches_found = 0;
-    *bytes_read = 0;
-    off_t position = 0;
-    
-    while (1) {
-        // Читаем блок данных
-        ssize_t bytes = read(fd, buffer, BUFFER_SIZE);
-        if (bytes == -1) {
-            perror("read");
-            free(buffer);
-            close(fd);
+    printf("File created successfully. Inserted ~%llu search values.\n\n", planted);
+    return 0;
+}
+
+// Одна итерация с индексом смещений: замена по индексу, если он годен,
+// иначе полный проход с построением индекса. Сохранение индекса входит
+// в замер. *patched - итерация обошлась без сканирования.
+int run_indexed_pass(const char *filename, const ema_config_t *cfg, ema_index_t *index,
+                     const char *index_path, ema_stats_t *stats, int *patched) {
+    int status = ema_index_patch(index, filename, cfg, stats);
+    if (status == -1) {
+        return -1;
+    }
+    *patched = (status == 0);
+    if (status == 1) {
+        ema_config_t build = *cfg;
+        build.index = index;
+        ema_index_reset(index);
+        if (ema_run_pass(filename, &build, stats) == -1 || ema_index_finish(index, filename) == -1) {
             return -1;
         }
-        
-        if (bytes == 0) {
-            break;  // Конец файла
+    }
+    return ema_index_save(index, index_path);
+}
+
+// Проход с картой зон: отсечение по годной карте, сбор сводок прочитанных
+// зон и сохранение карты рядом с файлом. *pruning - карта была годна.
+int run_zoned_pass(const char *filename, const ema_config_t *cfg, ema_stats_t *stats, int *pruning) {
+    ema_zonemap_t *zm = cfg->zonemap;
+    if (ema_zonemap_begin(zm, filename) == -1) {
+        return -1;
+    }
+    *pruning = ema_zonemap_prunes(cfg);
+    if (ema_run_pass(filename, cfg, stats) == -1 || ema_zonemap_finish(zm, filename) == -1) {
+        zm->valid = 0;
+        return -1;
+    }
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.zmap", filename);
+    return ema_zonemap_save(zm, path);
+}
+
+// Записано физически на байт, логически изменённый заменами
+double write_amplification(unsigned long long written, unsigned long long matches, const ema_config_t *cfg) {
+    return matches > 0 ? (double)written / (matches * ema_type_size(cfg->type)) : 0.0;
+}
+
+// Время в синхронизации и в записи рядом со временем прохода. С O_DSYNC
+// синхронизация идёт внутри pwrite, у uring записи асинхронны и не замеряются.
+void print_sync_time(const ema_config_t *cfg, const ema_stats_t *stats, long long elapsed_us, const char *indent) {
+    double elapsed = elapsed_us > 0 ? elapsed_us / 1000000.0 : 1e-6;
+    double sync = stats->sync_ns / 1e9;
+    double write = stats->write_ns / 1e9;
+    if (cfg->sync == EMA_SYNC_PER_BLOCK) {
+        printf("%ssync (per-block): inside the O_DSYNC writes", indent);
+    } else {
+        printf("%ssync (%s): %.6f s (%.1f%% of pass)", indent, ema_sync_name(cfg->sync), sync, 100.0 * sync / elapsed);
+    }
+    if (cfg->engine == EMA_ENGINE_URING) {
+        printf(", writes: asynchronous, not timed");
+    } else if (cfg->engine != EMA_ENGINE_MMAP || cfg->pattern != EMA_PATTERN_NONE) {
+        printf(", writes: %.6f s (%.1f%% of pass)", write, 100.0 * write / elapsed);
+    }
+    if (cfg->threads > 1) {
+        printf(" (summed over %d threads)", cfg->threads);
+    }
+    printf("\n");
+}
+
+// Пропущенные дыры против прочитанного за все проходы
+void print_holes(const ema_stats_t *stats) {
+    unsigned long long total = stats->bytes_skipped + stats->bytes_read;
+    printf("Holes skipped: %llu bytes (%.2f MB), scanned: %llu bytes (%.2f MB); %.1f%% of the file not read\n",
+           stats->bytes_skipped, (double)stats->bytes_skipped / (1024.0 * 1024.0),
+           stats->bytes_read, (double)stats->bytes_read / (1024.0 * 1024.0),
+           total > 0 ? 100.0 * stats->bytes_skipped / total : 0.0);
+}
+
+// Серия итераций поиска и замены выбранным движком. Восстановление из
+// шаблона reset_from и подготовка page cache выполняются перед каждой
+// итерацией вне замера.
+int run_iterations(const char *filename, const ema_config_t *base, cache_mode_t cache, const char *reset_from,
+                   ema_index_t *index, const char *index_path, int iterations, ema_run_t *run) {
+    ema_config_t cfg = *base;
+    memset(run, 0, sizeof(*run));
+    run->cfg = cfg;
+    run->cache = cache;
+    run->iterations = iterations;
+
+    // Задержки серии копятся в base->latency, каждой итерации - отдельно
+    ema_latency_t *latency = NULL;
+    if (base->latency != NULL) {
+        latency = malloc(sizeof(ema_latency_t));
+        if (latency == NULL) {
+            perror("malloc");
+            return -1;
+        }
+        cfg.latency = latency;
+    }
+
+    int status = 0;
+    for (int i = 0; i < iterations; i++) {
+        if (reset_from != NULL) {
+            long long reset_start = get_time_us();
+            if (ema_reset_file(reset_from, filename, &run->reset) == -1) {
+                status = -1;
+                break;
+            }
+            run->reset_us += get_time_us() - reset_start;
+        }
+        long long cache_start = get_time_us();
+        if (cache == CACHE_COLD && ema_drop_cache(filename) == -1) {
+            status = -1;
+            break;
+        }
+        if (cache == CACHE_WARM && ema_warm_cache(filename) == -1) {
+            status = -1;
+            break;
+        }
+        if (latency != NULL) {
+            memset(latency, 0, sizeof(*latency));
+        }
+        long long start_time = get_time_us();
+        run->cache_us += start_time - cache_start;
+
+        ema_stats_t stats;
+        int patched = 0;
+        int pruning = 0;
+        cfg.seed = i;  // у каждой итерации своя воспроизводимая последовательность запросов
+        if (index != NULL) {
+            status = run_indexed_pass(filename, &cfg, index, index_path, &stats, &patched);
+        } else if (cfg.zonemap != NULL) {
+            status = run_zoned_pass(filename, &cfg, &stats, &pruning);
+        } else {
+            status = ema_run_pass(filename, &cfg, &stats);
+        }
+        if (status == 0) {
+            status = ema_sync_pass_end(filename, &cfg, &stats);
         }
+        if (status == -1) {
+            break;
+        }
+        long long elapsed_us = get_time_us() - start_time;
+        run->elapsed_us += elapsed_us;
+        run->index_patches += patched;
         
-        *bytes_read += bytes;
-        int num_ints = bytes / sizeof(int);
+        run->total_matches += stats.matches;
+        run->total_bytes += stats.bytes_read;
+        run->total_written += stats.bytes_written;
+        ema_stats_add(&run->calls, &stats);
         
-        // Ищем и заменяем значения
-        int found_in_block = 0;
-        for (int i = 0; i < num_ints; i++) {
-            if (buffer[i] == search_value) {
-                buffer[i] = replace_value;
-                (*matches_found)++;
-                found_in_block = 1;
+        printf("Iteration %d/%d: found and replaced %llu values (read %llu bytes, %s%s); "
+               "changed %llu bytes, wrote %llu bytes, write amplification %.2fx\n",
+               i + 1, iterations, stats.matches, stats.bytes_read, cache_label(cache, &cfg),
+               index == NULL ? "" : patched ? ", via index" : ", index built",
+               stats.matches * ema_type_size(cfg.type), stats.bytes_written,
+               write_amplification(stats.bytes_written, stats.matches, &cfg));
+        if (cfg.pattern != EMA_PATTERN_NONE) {
+            printf("  %llu ops (%llu read-modify-write), %.0f IOPS, %llu matches seen by reads\n", stats.ops,
+                   stats.rmw_ops, stats.ops / (elapsed_us / 1000000.0), stats.read_matches);
+        }
+        if (cfg.sync != EMA_SYNC_NONE) {
+            print_sync_time(&cfg, &stats, elapsed_us, "  ");
+        }
+        if (cfg.skip_holes && cfg.engine != EMA_ENGINE_MMAP) {
+            printf("  holes: skipped %llu bytes, scanned %llu bytes%s\n", stats.bytes_skipped, stats.bytes_read,
+                   ema_holes_skippable(&cfg) ? "" : " (0 matches the search value, holes were read)");
+        }
+        if (cfg.zonemap != NULL) {
+            if (pruning) {
+                unsigned long long total = stats.bytes_pruned + stats.bytes_read;
+                printf("  zones: skipped %llu bytes, scanned %llu bytes (%.1f%% of the file skipped)\n",
+                       stats.bytes_pruned, stats.bytes_read, total > 0 ? 100.0 * stats.bytes_pruned / total : 0.0);
+            } else {
+                printf("  zones: map built by a full scan\n");
             }
         }
+        if (latency != NULL) {
+            ema_latency_print(latency, "  ");
+            ema_latency_add(base->latency, latency);
+        }
         
-        // Если нашли совпадения, записываем блок обратно
-        if (found_in_block) {
-            if (lseek(fd, position, SEEK_SET) == -1) {
-                perror("lseek");
-                free(buffer);
-                close(fd);
-                return -1;
+        // После первой итерации все значения заменены, поэтому без шаблона
+        // меняем поиск/замену местами. Набор правил в общем случае необратим
+        // и применяется как есть.
+        if (i == 0 && cfg.rules == NULL && reset_from == NULL) {
+            ema_value_t temp = cfg.search_value;
+            cfg.search_value = cfg.replace_value;
+            cfg.replace_value = temp;
+        }
+    }
+    
+    free(latency);
+    return status;
+}
+
+// Сравнение ядер сканирования в памяти: первые KERNEL_BENCH_MAX байт
+// файла прогоняются каждым ядром, результат сверяется со скалярным
+#define KERNEL_BENCH_MAX (128LL * 1024 * 1024)
+
+int read_prefix(const char *filename, void *buffer, size_t size) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        perror("open");
+        return -1;
+    }
+    size_t done = 0;
+    while (done < size) {
+        ssize_t bytes = pread(fd, (char *)buffer + done, size - done, done);
+        if (bytes <= 0) {
+            if (bytes == -1) {
+                perror("pread");
             }
-            
-            ssize_t written = write(fd, buffer, bytes);
-            if (written == -1) {
-                perror("write");
-                free(buffer);
-                close(fd);
-                return -1;
+            close(fd);
+            return bytes == 0 ? 0 : -1;
+        }
+        done += bytes;
+    }
+    close(fd);
+    return 0;
+}
+
+int compare_kernels(const char *filename, const ema_config_t *cfg, off_t file_size, int iterations) {
+    size_t size = file_size < KERNEL_BENCH_MAX ? (size_t)file_size : (size_t)KERNEL_BENCH_MAX;
+    size_t elem = ema_type_size(cfg->type);
+    size_t count = size / elem;
+    size = count * elem;
+    void *orig = ema_alloc_block(size ? size : elem);
+    void *ref = ema_alloc_block(size ? size : elem);
+    void *work = ema_alloc_block(size ? size : elem);
+    int status = -1;
+    if (orig == NULL || ref == NULL || work == NULL || read_prefix(filename, orig, size) == -1) {
+        goto out;
+    }
+
+    // Эталон - один проход скалярного ядра
+    memcpy(ref, orig, size);
+    size_t ref_matches = ema_kernel_fn(EMA_KERNEL_SCALAR, cfg->type, cfg->swap)(ref, count, cfg->search_value,
+                                                                              cfg->replace_value);
+
+    printf("Kernel comparison (%.2f MB in memory, %d passes, %llu matches):\n",
+           (double)size / (1024.0 * 1024.0), iterations, (unsigned long long)ref_matches);
+    printf("%-8s %12s %10s %10s\n", "kernel", "GB/s", "vs scalar", "result");
+    double scalar_gbps = 0;
+    status = 0;
+    for (int k = EMA_KERNEL_SCALAR; k < EMA_KERNEL_COUNT; k++) {
+        if (!ema_kernel_supported((ema_kernel_t)k)) {
+            printf("%-8s %12s\n", ema_kernel_name((ema_kernel_t)k), "unsupported");
+            continue;
+        }
+        ema_scan_fn scan = ema_kernel_fn((ema_kernel_t)k, cfg->type, cfg->swap);
+        memcpy(work, orig, size);
+
+        // Проходы чередуют направление замены, чтобы каждый видел
+        // одинаковое число совпадений
+        size_t first_matches = 0;
+        int verified = 1;
+        long long start = get_time_ns();
+        for (int i = 0; i < iterations; i++) {
+            size_t matches = (i % 2 == 0)
+                ? scan(work, count, cfg->search_value, cfg->replace_value)
+                : scan(work, count, cfg->replace_value, cfg->search_value);
+            if (i == 0) {
+                first_matches = matches;
+                verified = memcmp(work, ref, size) == 0;
             }
-            
-            if (written != bytes) {
-                fprintf(stderr, "Error: incomplete write\n");
-                free(buffer);
-                close(fd);
-                return -1;
+        }
+        long long elapsed = get_time_ns() - start;
+
+        verified = verified && first_matches == ref_matches;
+        double gbps = (double)size * iterations / (elapsed > 0 ? elapsed : 1);
+        if (k == EMA_KERNEL_SCALAR) {
+            scalar_gbps = gbps;
+        }
+        printf("%-8s %12.2f %9.2fx %10s\n", ema_kernel_name((ema_kernel_t)k), gbps,
+               gbps / scalar_gbps, verified ? "ok" : "MISMATCH");
+        if (!verified) {
+            status = -1;
+        }
+    }
+    printf("Auto-selected kernel: %s\n", ema_kernel_name(ema_kernel_resolve(EMA_KERNEL_AUTO)));
+
+out:
+    free(orig);
+    free(ref);
+    free(work);
+    return status;
+}
+
+// Масштабирование однопроходной замены по числу правил: на префиксе
+// файла в памяти для 1, 10, 100, ... max_rules правил. Половина old
+// берётся из самих данных, чтобы совпадения были при любом числе правил.
+int bench_rules(const char *filename, off_t file_size, long max_rules, int iterations) {
+    size_t size = file_size < KERNEL_BENCH_MAX ? (size_t)file_size : (size_t)KERNEL_BENCH_MAX;
+    size_t count = size / sizeof(int);
+    size = count * sizeof(int);
+    int *orig = ema_alloc_block(size ? size : sizeof(int));
+    int *work = ema_alloc_block(size ? size : sizeof(int));
+    int status = -1;
+    if (orig == NULL || work == NULL || read_prefix(filename, orig, size) == -1) {
+        goto out;
+    }
+
+    printf("Rule scaling (%.2f MB in memory, %d passes per size):\n",
+           (double)size / (1024.0 * 1024.0), iterations);
+    printf("%10s %12s %12s %12s %10s\n", "rules", "table (KB)", "GB/s", "matches", "vs 1 rule");
+    double first_gbps = 0;
+    unsigned long long state = 0x9E3779B97F4A7C15ULL;
+    for (long n = 1; ; n = (n * 10 > max_rules && n < max_rules) ? max_rules : n * 10) {
+        ema_rules_t rules;
+        if (ema_rules_init(&rules, n) == -1) {
+            goto out;
+        }
+        while ((long)rules.count < n) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            unsigned r = (unsigned)(state >> 33);
+            int old_value = (count > 0 && (r & 1)) ? orig[(r >> 1) % count] : (int)(r * 2654435761u);
+            ema_rules_add(&rules, old_value, (int)(state >> 7));
+        }
+
+        size_t matches = 0;
+        long long elapsed = 0;
+        for (int i = 0; i < iterations; i++) {
+            memcpy(work, orig, size);
+            long long start = get_time_ns();
+            matches = ema_rules_scan(&rules, work, count);
+            elapsed += get_time_ns() - start;
+        }
+        size_t slots = (size_t)1 << rules.table_bits;
+        double table_kb = (slots * sizeof(ema_rule_slot_t) + slots / 8 + (rules.filter_mask + 1) / 8) / 1024.0;
+        ema_rules_free(&rules);
+
+        double gbps = (double)size * iterations / (elapsed > 0 ? elapsed : 1);
+        if (n == 1) {
+            first_gbps = gbps;
+        }
+        printf("%10ld %12.1f %12.2f %12zu %9.2fx\n", n, table_kb, gbps, matches, gbps / first_gbps);
+        if (n >= max_rules) {
+            break;
+        }
+    }
+    status = 0;
+
+out:
+    free(orig);
+    free(work);
+    return status;
+}
+
+double run_mbps(const ema_run_t *run) {
+    return (double)run->total_bytes / (run->elapsed_us / 1000000.0) / (1024.0 * 1024.0);
+}
+
+// Разбор списка положительных чисел "4" или "1,2,4,8"
+int parse_count_list(const char *str, int *counts, int max_count, long max_value) {
+    int n = 0;
+    const char *p = str;
+    while (*p != '\0') {
+        char *end;
+        long value = strtol(p, &end, 10);
+        if (end == p || value <= 0 || value > max_value || n == max_count) {
+            return -1;
+        }
+        counts[n++] = (int)value;
+        p = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return -1;
+        }
+    }
+    return n;
+}
+
+// Разбор списка значений int через запятую, допускаются отрицательные
+int parse_value_list(const char *str, int *values, int max_count) {
+    int n = 0;
+    const char *p = str;
+    while (*p != '\0') {
+        char *end;
+        errno = 0;
+        long value = strtol(p, &end, 10);
+        if (end == p || errno != 0 || value < INT_MIN || value > INT_MAX || n == max_count) {
+            return -1;
+        }
+        values[n++] = (int)value;
+        p = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return -1;
+        }
+    }
+    return n;
+}
+
+// Разбор списка значений типа type через запятую
+int parse_typed_list(const char *str, ema_type_t type, ema_value_t *values, int max_count) {
+    char copy[4096];
+    if (strlen(str) >= sizeof(copy)) {
+        return -1;
+    }
+    strcpy(copy, str);
+    int n = 0;
+    char *save;
+    for (char *token = strtok_r(copy, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+        if (n == max_count || ema_value_parse(token, type, &values[n]) == -1) {
+            return -1;
+        }
+        n++;
+    }
+    return n;
+}
+
+int parse_thread_counts(const char *str, int *counts) {
+    int n = parse_count_list(str, counts, MAX_THREAD_COUNTS, 1024);
+    if (n <= 0) {
+        return -1;
+    }
+    // Для одного N > 1 добавляем однопоточный прогон как базу для
+    // оценки эффективности масштабирования
+    if (n == 1 && counts[0] > 1) {
+        counts[1] = counts[0];
+        counts[0] = 1;
+        n = 2;
+    }
+    return n;
+}
+
+// Итоговая таблица при нескольких конфигурациях. Ускорение и
+// эффективность считаются относительно первой строки того же движка.
+void print_comparison(const ema_run_t *runs, int count) {
+    printf("Comparison:\n");
+    printf("===========\n");
+    printf("%-8s %7s %5s %-12s %14s %12s %12s %12s %9s %9s %9s %10s %6s\n", "engine", "threads", "qd",
+           "cache", "avg time (s)", "MB/s", "matches", "syscalls", "write amp", "vs first", "speedup",
+           "efficiency", "check");
+    for (int i = 0; i < count; i++) {
+        const ema_run_t *base = &runs[i];
+        for (int j = 0; j < i; j++) {
+            if (runs[j].cfg.engine == runs[i].cfg.engine) {
+                base = &runs[j];
+                break;
             }
-            
-            // Возвращаемся на следующую позицию для чтения
-            if (lseek(fd, position + bytes, SEEK_SET) == -1) {
-                perror("lseek");
-                free(buffer);
-                close(fd);
+        }
+        double speedup = run_mbps(&runs[i]) / run_mbps(base);
+        double efficiency = speedup / ((double)runs[i].cfg.threads / base->cfg.threads);
+        char qd[16] = "-";
+        if (runs[i].cfg.engine == EMA_ENGINE_URING) {
+            snprintf(qd, sizeof(qd), "%d", runs[i].cfg.queue_depth);
+        }
+        printf("%-8s %7d %5s %-12s %14.6f %12.2f %12llu %12llu %8.2fx %8.2fx %8.2fx %9.1f%% %6s\n",
+               engine_label(&runs[i].cfg), runs[i].cfg.threads, qd,
+               cache_label(runs[i].cache, &runs[i].cfg),
+               (double)runs[i].elapsed_us / runs[i].iterations / 1000000.0, run_mbps(&runs[i]),
+               runs[i].total_matches, ema_stats_syscalls(&runs[i].calls),
+               write_amplification(runs[i].total_written, runs[i].total_matches, &runs[i].cfg),
+               run_mbps(&runs[i]) / run_mbps(&runs[0]), speedup, efficiency * 100.0,
+               runs[i].total_matches == runs[0].total_matches ? "ok" : "DIFF");
+    }
+}
+
+// Проходы только на чтение (--count, --histogram) для каждого числа
+// потоков. Результат печатается один раз; проходы сверяются с первым.
+int run_analysis(const char *filename, const ema_config_t *base, cache_mode_t cache,
+                 const int *thread_counts, int n_thread_counts, int iterations, ema_analysis_t *analysis) {
+    ema_analysis_t *result = malloc(sizeof(*result));
+    if (result == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    int status = 0;
+    int first = 1;
+    for (int t = 0; t < n_thread_counts && status == 0; t++) {
+        ema_config_t cfg = *base;
+        cfg.threads = thread_counts[t];
+        if (n_thread_counts > 1) {
+            printf("--- Engine: %s, threads: %d ---\n", engine_label(&cfg), cfg.threads);
+        }
+        unsigned long long total_bytes = 0;
+        long long total_us = 0;
+        long long cache_us = 0;
+        int same = 1;
+        for (int i = 0; i < iterations; i++) {
+            long long cache_start = get_time_us();
+            if ((cache == CACHE_COLD && ema_drop_cache(filename) == -1) ||
+                (cache == CACHE_WARM && ema_warm_cache(filename) == -1)) {
+                status = -1;
+                break;
+            }
+            long long start_time = get_time_us();
+            cache_us += start_time - cache_start;
+
+            *result = *analysis;
+            ema_stats_t stats;
+            if (ema_analyze_pass(filename, &cfg, result, &stats) == -1) {
+                status = -1;
+                break;
+            }
+            long long elapsed_us = get_time_us() - start_time;
+            total_us += elapsed_us;
+            total_bytes += stats.bytes_read;
+            printf("Iteration %d/%d: scanned %llu elements (read %llu bytes, %s), wrote nothing, "
+                   "%.2f MB/s\n", i + 1, iterations, result->elements, stats.bytes_read,
+                   cache_label(cache, &cfg),
+                   (double)stats.bytes_read / (elapsed_us > 0 ? elapsed_us : 1) * 1000000.0 / (1024.0 * 1024.0));
+            if (first) {
+                *analysis = *result;
+                first = 0;
+            } else if (!ema_analysis_equal(analysis, result)) {
+                same = 0;
+            }
+        }
+        if (status == 0) {
+            printf("Average time per pass: %.6f seconds, read throughput: %.2f MB/s (%s), check: %s\n",
+                   (double)total_us / iterations / 1000000.0,
+                   (double)total_bytes / (total_us > 0 ? total_us : 1) * 1000000.0 / (1024.0 * 1024.0),
+                   cache_label(cache, &cfg), same ? "ok" : "DIFF");
+            if (cache != CACHE_UNCONTROLLED) {
+                printf("Cache preparation time: %lld.%06lld seconds (not included above)\n",
+                       cache_us / 1000000, cache_us % 1000000);
+            }
+            printf("\n");
+        }
+        if (!same) {
+            status = -1;
+        }
+    }
+    if (status == 0) {
+        ema_analysis_print(analysis, base);
+    }
+    free(result);
+    return status;
+}
+
+// Пакетный режим: файлы из каталога, шаблона или списка обрабатываются
+// пулом потоков; итоги по файлам, суммарная пропускная способность и
+// распределение времени обработки файла
+int run_batch(const char *source, const ema_config_t *cfg, int jobs, int iterations, int use_perf) {
+    ema_batch_t *batch = malloc(sizeof(*batch));
+    if (batch == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    if (ema_batch_collect(source, batch) == -1) {
+        free(batch);
+        return -1;
+    }
+    unsigned long long total_size = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        total_size += batch->files[i].size;
+    }
+    printf("Batch: %zu files, %.2f MB, %d workers\n\n", batch->count, (double)total_size / (1024.0 * 1024.0),
+           (size_t)jobs < batch->count ? jobs : (int)batch->count);
+
+    perf_counters_t counters;
+    if (use_perf) {
+        perf_counters_open(&counters, 1);
+        perf_counters_start(&counters);
+    }
+    long long start_time = get_time_us();
+    int status = ema_batch_run(batch, cfg, jobs, iterations);
+    long long elapsed_us = get_time_us() - start_time;
+    if (use_perf) {
+        perf_counters_stop(&counters);
+    }
+
+    ema_stats_t total;
+    memset(&total, 0, sizeof(total));
+    int failed = 0;
+    printf("Files:\n");
+    printf("  %10s %12s %10s %10s %9s %-6s %s\n", "MB", "matches", "time (s)", "MB/s", "syscalls", "status", "file");
+    for (size_t i = 0; i < batch->count; i++) {
+        const ema_batch_file_t *file = &batch->files[i];
+        double seconds = file->elapsed_ns / 1e9;
+        printf("  %10.2f %12llu %10.4f %10.2f %9llu %-6s %s\n", (double)file->size / (1024.0 * 1024.0),
+               file->stats.matches, seconds,
+               seconds > 0 ? (double)file->stats.bytes_read / seconds / (1024.0 * 1024.0) : 0.0,
+               ema_stats_syscalls(&file->stats), file->status == 0 ? "ok" : "FAILED", file->path);
+        ema_stats_add(&total, &file->stats);
+        failed += file->status != 0;
+    }
+
+    double seconds = elapsed_us / 1000000.0;
+    printf("\n");
+    printf("Batch results:\n");
+    printf("==============\n");
+    printf("Files: %zu processed, %d failed, %d iterations each\n", batch->count, failed, iterations);
+    printf("Total matches found and replaced: %llu\n", total.matches);
+    printf("Total bytes read: %llu (%.2f MB), written: %llu (%.2f MB), write amplification %.2fx\n",
+           total.bytes_read, (double)total.bytes_read / (1024.0 * 1024.0),
+           total.bytes_written, (double)total.bytes_written / (1024.0 * 1024.0),
+           write_amplification(total.bytes_written, total.matches, cfg));
+    printf("Wall time: %.6f seconds\n", seconds);
+    printf("Aggregate throughput: %.2f MB/s, %.1f files/s\n",
+           (double)total.bytes_read / seconds / (1024.0 * 1024.0), batch->count / seconds);
+    printf("File latency (ms): p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+           ema_histogram_quantile(&batch->latency, 0.50) / 1e6, ema_histogram_quantile(&batch->latency, 0.90) / 1e6,
+           ema_histogram_quantile(&batch->latency, 0.99) / 1e6, batch->latency.max / 1e6);
+    if (cfg->sync != EMA_SYNC_NONE) {
+        print_sync_time(cfg, &total, elapsed_us, "Time in ");
+    }
+    if (cfg->skip_holes && cfg->engine != EMA_ENGINE_MMAP) {
+        print_holes(&total);
+    }
+    printf("Syscalls: %llu (read %llu, write %llu, other %llu; %.1f per file)\n",
+           ema_stats_syscalls(&total), total.read_calls, total.write_calls, total.other_calls,
+           (double)ema_stats_syscalls(&total) / batch->count);
+    if (cfg->latency != NULL) {
+        printf("Latency over all files:\n");
+        ema_latency_print(cfg->latency, "  ");
+    }
+    if (use_perf) {
+        perf_counters_report(&counters, total.bytes_read);
+        perf_counters_close(&counters);
+    }
+
+    ema_batch_free(batch);
+    free(batch);
+    return status;
+}
+
+// Автонастройка: короткие пробы по ограниченной сетке движков, размеров
+// блока и чисел потоков. Проба - AUTOTUNE_PASSES проходов, перед каждым
+// файл восстанавливается из шаблона (--reset-from) или из снимка, снятого
+// до перебора: обмен поиска и замены не вернул бы файл, если в нём уже
+// были значения замены. Подготовка page cache и восстановление вне замера.
+#define AUTOTUNE_PASSES 2
+#define AUTOTUNE_MAX_THREADS 8
+
+static const size_t autotune_blocks[] = { 4096, 64 * 1024, 1024 * 1024, 8 * 1024 * 1024 };
+
+int autotune_max_threads(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus <= 1 ? 1 : cpus < AUTOTUNE_MAX_THREADS ? (int)cpus : AUTOTUNE_MAX_THREADS;
+}
+
+int autotune_probe(const char *filename, const ema_config_t *cfg, cache_mode_t cache, const char *source,
+                   ema_run_t *run) {
+    memset(run, 0, sizeof(*run));
+    run->cfg = *cfg;
+    run->cache = cache;
+    run->iterations = AUTOTUNE_PASSES;
+    for (int i = 0; i < AUTOTUNE_PASSES; i++) {
+        if (ema_reset_file(source, filename, &run->reset) == -1) {
+            return -1;
+        }
+        if ((cache == CACHE_COLD && ema_drop_cache(filename) == -1) ||
+            (cache == CACHE_WARM && ema_warm_cache(filename) == -1)) {
+            return -1;
+        }
+        ema_stats_t stats;
+        long long start_time = get_time_us();
+        if (ema_run_pass(filename, cfg, &stats) == -1 || ema_sync_pass_end(filename, cfg, &stats) == -1) {
+            return -1;
+        }
+        run->elapsed_us += get_time_us() - start_time;
+        run->total_matches += stats.matches;
+        run->total_bytes += stats.bytes_read;
+        run->total_written += stats.bytes_written;
+        ema_stats_add(&run->calls, &stats);
+    }
+    return 0;
+}
+
+// Перебор сетки, файл перед каждым проходом восстанавливается из source;
+// лучшая по пропускной способности конфигурация - в best. Проба, которую
+// движок не смог выполнить (например, нет io_uring), пропускается;
+// расхождение числа совпадений между пробами - ошибка.
+int autotune_grid(const char *filename, const ema_config_t *base, cache_mode_t cache, const char *source,
+                  ema_profile_t *best) {
+    int max_threads = autotune_max_threads();
+    int n_blocks = sizeof(autotune_blocks) / sizeof(autotune_blocks[0]);
+    printf("Autotune probes (%d passes each, file restored from %s before every pass):\n", AUTOTUNE_PASSES,
+           source);
+    printf("  %-8s %8s %7s %5s %12s %12s %6s\n", "engine", "block", "threads", "qd", "time (s)", "MB/s", "check");
+
+    memset(best, 0, sizeof(*best));
+    double default_mbps = 0.0;
+    unsigned long long first_matches = 0;
+    int probed = 0;
+    int same = 1;
+    for (int e = 0; e < EMA_ENGINE_COUNT; e++) {
+        // mmap не умеет пропускать дыры и синхронизировать по блокам
+        if (e == EMA_ENGINE_MMAP && (base->skip_holes || base->sync == EMA_SYNC_PER_BLOCK ||
+                                     base->sync == EMA_SYNC_RANGE)) {
+            continue;
+        }
+        for (int b = 0; b < (e == EMA_ENGINE_MMAP ? 1 : n_blocks); b++) {
+            for (int threads = 1; threads <= max_threads; threads *= 2) {
+                ema_config_t cfg = *base;
+                cfg.engine = (ema_engine_t)e;
+                cfg.block_size = e == EMA_ENGINE_MMAP ? base->block_size : autotune_blocks[b];
+                cfg.threads = threads;
+                cfg.queue_depth = e == EMA_ENGINE_URING ? base->queue_depth : 0;
+                cfg.direct = e == EMA_ENGINE_MMAP ? 0 : base->direct;
+                cfg.latency = NULL;
+                char block[24] = "-";
+                char qd[16] = "-";
+                if (e != EMA_ENGINE_MMAP) {
+                    snprintf(block, sizeof(block), "%zuK", cfg.block_size / 1024);
+                }
+                if (e == EMA_ENGINE_URING) {
+                    snprintf(qd, sizeof(qd), "%d", cfg.queue_depth);
+                }
+
+                ema_run_t run;
+                if (autotune_probe(filename, &cfg, cache, source, &run) == -1) {
+                    printf("  %-8s %8s %7d %5s %12s %12s %6s\n", engine_label(&cfg), block, threads, qd, "-", "-",
+                           "failed");
+                    continue;
+                }
+                if (probed++ == 0) {
+                    first_matches = run.total_matches;
+                    default_mbps = run_mbps(&run);
+                }
+                int ok = run.total_matches == first_matches;
+                same = same && ok;
+                printf("  %-8s %8s %7d %5s %12.6f %12.2f %6s\n", engine_label(&cfg), block, threads, qd,
+                       (double)run.elapsed_us / AUTOTUNE_PASSES / 1000000.0, run_mbps(&run), ok ? "ok" : "DIFF");
+                if (run_mbps(&run) > best->mbps) {
+                    best->engine = cfg.engine;
+                    best->block_size = cfg.block_size;
+                    best->threads = threads;
+                    best->queue_depth = e == EMA_ENGINE_URING ? cfg.queue_depth : base->queue_depth;
+                    best->mbps = run_mbps(&run);
+                }
+            }
+        }
+    }
+    printf("\n");
+    if (probed == 0) {
+        fprintf(stderr, "Error: every autotune probe failed\n");
+        return -1;
+    }
+    if (!same) {
+        fprintf(stderr, "Error: autotune probes disagree on the number of matches\n");
+        return -1;
+    }
+    printf("Best configuration: engine %s, block size %zu bytes, threads %d", ema_engine_name(best->engine),
+           best->block_size, best->threads);
+    if (best->engine == EMA_ENGINE_URING) {
+        printf(", qd %d", best->queue_depth);
+    }
+    printf(": %.2f MB/s (%.2fx rw with 4K blocks and 1 thread)\n", best->mbps,
+           default_mbps > 0 ? best->mbps / default_mbps : 0.0);
+    return 0;
+}
+
+// Без шаблона пробы восстанавливают файл из снимка, снятого до перебора;
+// итерации затем начинаются с исходного содержимого
+int run_autotune(const char *filename, const ema_config_t *base, cache_mode_t cache, const char *reset_from,
+                 ema_profile_t *best) {
+    if (reset_from != NULL) {
+        return autotune_grid(filename, base, cache, reset_from, best);
+    }
+    char snapshot[4096];
+    if (ema_snapshot_create(filename, snapshot, sizeof(snapshot)) == -1) {
+        return -1;
+    }
+    int status = autotune_grid(filename, base, cache, snapshot, best);
+    ema_reset_t method;
+    if (ema_reset_file(snapshot, filename, &method) == -1) {
+        status = -1;
+    }
+    unlink(snapshot);
+    return status;
+}
+
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <file> <size_mb> <search_value> <replace_value> <iterations>\n", prog);
+    fprintf(stderr, "  file          - path to the data file\n");
+    fprintf(stderr, "  size_mb       - size of file in MB (for new file creation)\n");
+    fprintf(stderr, "  search_value  - value to search for, of the element type (--type)\n");
+    fprintf(stderr, "  replace_value - value to replace with\n");
+    fprintf(stderr, "  iterations    - number of search-replace iterations\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --engine rw|mmap|uring|all  I/O engine; 'all' runs each and compares (default: rw)\n");
+    fprintf(stderr, "  --block-size <size>     rw/uring block size, 4K..64M, multiple of 4K (default: 4K)\n");
+    fprintf(stderr, "  --qd <n>[,<n>...]       uring engine: blocks in flight, each value is a separate run (default: 16)\n");
+    fprintf(stderr, "  --kernel <name>         scan kernel: auto|scalar|sse4.1|avx2|avx512 (default: auto);\n");
+    fprintf(stderr, "                          'all' compares every kernel in memory and exits\n");
+    fprintf(stderr, "  --rules <file>          apply every '<old> <new>' pair from file in one pass;\n");
+    fprintf(stderr, "                          search_value/replace_value then only seed a new file\n");
+    fprintf(stderr, "  --rules-bench <max>     in-memory pass throughput for 1, 10, ... max random rules, then exit\n");
+    fprintf(stderr, "  --index                 keep a sidecar <file>.idx of offsets of the search and replace\n");
+    fprintf(stderr, "                          values; repeat replaces patch those offsets without a scan\n");
+    fprintf(stderr, "  --index-values <v,...>  index these hot values instead (implies --index)\n");
+    fprintf(stderr, "  --zonemap               keep a sidecar <file>.zmap of per-zone min/max and value bitmaps,\n");
+    fprintf(stderr, "                          built by every pass; zones that cannot hold the search value\n");
+    fprintf(stderr, "                          are not read\n");
+    fprintf(stderr, "  --zone-size <size>      zone map granularity, multiple of 4K (default: 64K)\n");
+    fprintf(stderr, "  --threads <n>[,<n>...]  split the file into ranges scanned by n threads;\n");
+    fprintf(stderr, "                          a single n > 1 is also run with 1 thread to report scaling\n");
+    fprintf(stderr, "  --dirty block|page|int  rw/uring engines: write back the whole dirty block, only its\n");
+    fprintf(stderr, "                          changed 4K pages or only changed ints (default: page)\n");
+    fprintf(stderr, "  --direct                rw/uring engines: O_DIRECT, bypassing the page cache\n");
+    fprintf(stderr, "  --skip-holes            rw/uring engines: do not read holes of a sparse file (SEEK_DATA);\n");
+    fprintf(stderr, "                          a pass whose search value matches 0 still reads them\n");
+    fprintf(stderr, "  --drop-cache, --cold    flush and evict the file from the page cache before every\n");
+    fprintf(stderr, "                          iteration (not timed)\n");
+    fprintf(stderr, "  --warm                  read the whole file into the page cache before every iteration\n");
+    fprintf(stderr, "  --reset-from <file>     restore the data file from this template before every iteration\n");
+    fprintf(stderr, "                          (reflink, else copy_file_range; not timed), so every iteration\n");
+    fprintf(stderr, "                          replaces the same values instead of swapping search/replace\n");
+    fprintf(stderr, "  --populate              mmap engine: prefault the mapping with MAP_POPULATE\n");
+    fprintf(stderr, "  --msync                 mmap engine: msync(MS_SYNC) at the end of every pass\n");
+    fprintf(stderr, "  --perf                  collect hardware counters (IPC, cycles/byte) for all iterations\n");
+    fprintf(stderr, "  --latency               time every read, write and mmap page window; print\n");
+    fprintf(stderr, "                          p50/p90/p99/p99.9/max per iteration and operation type\n");
+    fprintf(stderr, "  --latency-dump <file>   also write the raw histograms as CSV (implies --latency)\n");
+    fprintf(stderr, "  --type <type>           element type: i8|i16|i32|i64|u8|u16|u32|u64|f32|f64 (default: i32);\n");
+    fprintf(stderr, "                          floats compare by value, so 0 also matches -0\n");
+    fprintf(stderr, "  --endian native|little|big  byte order of the elements in the file (default: native)\n");
+    fprintf(stderr, "  --in-memory             load the file into an anonymous buffer (MAP_HUGETLB, else THP)\n");
+    fprintf(stderr, "                          and run the iterations over it; reports memory GB/s\n");
+    fprintf(stderr, "  --numa-node <n>         bind the --in-memory buffer to NUMA node n\n");
+    fprintf(stderr, "  --pattern <name>        rw/mmap engines: instead of a full pass issue requests with\n");
+    fprintf(stderr, "                          pattern seq|random|strided|zipf|hotcold and report IOPS\n");
+    fprintf(stderr, "  --request-size <size>   pattern request size, multiple of 4 (default: 4K)\n");
+    fprintf(stderr, "  --ops <n>               pattern requests per iteration (default: file size / request size)\n");
+    fprintf(stderr, "  --write-ratio <f>       pattern share of read-modify-write requests, 0..1 (default: 0.5)\n");
+    fprintf(stderr, "  --stride <size>         strided pattern step, multiple of the request size\n");
+    fprintf(stderr, "                          (default: 16 requests)\n");
+    fprintf(stderr, "  --sync <policy>         durability of the writes: none, end (fdatasync after every pass),\n");
+    fprintf(stderr, "                          per-block (O_DSYNC) or range (rolling sync_file_range window);\n");
+    fprintf(stderr, "                          time in sync is reported separately (default: none)\n");
+    fprintf(stderr, "  --sync-window <size>    range policy: bytes under writeback before waiting (default: 8M)\n");
+    fprintf(stderr, "  --autotune              probe rw/mmap/uring, block sizes 4K..8M and 1..%d threads with short\n",
+            AUTOTUNE_MAX_THREADS);
+    fprintf(stderr, "                          timed passes and run the iterations with the fastest one\n");
+    fprintf(stderr, "  --profile <file>        with --autotune save the fastest configuration here; otherwise\n");
+    fprintf(stderr, "                          load engine, block size, threads and qd from it\n");
+    fprintf(stderr, "  --batch                 <file> is a directory, glob pattern or @list of paths; files are\n");
+    fprintf(stderr, "                          processed by a pool of workers (size_mb is then ignored)\n");
+    fprintf(stderr, "  --jobs <n>              batch workers (default: online CPUs)\n");
+    fprintf(stderr, "  --count <v,...>         read-only: count occurrences of each value in one pass;\n");
+    fprintf(stderr, "                          search_value/replace_value then only seed a new file\n");
+    fprintf(stderr, "  --histogram             read-only: most frequent values and a power-of-two\n");
+    fprintf(stderr, "                          magnitude distribution in one pass (scalar hash-table\n");
+    fprintf(stderr, "                          pass, several times slower than --count)\n");
+    fprintf(stderr, "  --top <k>               histogram: number of most frequent values (default: 10)\n");
+}
+
+// Ключи командной строки, которые не входят в ema_config_t
+typedef struct {
+    int use_perf;
+    int compare;            // --engine all
+    int compare_kernel;     // --kernel all
+    cache_mode_t cache;
+    const char *rules_path;
+    long rules_bench;
+    int use_index;
+    int index_values[EMA_INDEX_MAX_VALUES];
+    int n_index_values;
+    int use_zonemap;
+    size_t zone_size;
+    int use_latency;
+    ema_endian_t endian;
+    const char *latency_dump;
+    int in_memory;
+    int numa_node;
+    const char *count_list;
+    int histogram;
+    int top_k;
+    int batch;
+    int jobs;
+    const char *reset_from;
+    int autotune;
+    const char *profile_path;
+    int thread_counts[MAX_THREAD_COUNTS];
+    int n_thread_counts;
+    int queue_depths[MAX_QUEUE_DEPTHS];
+    int n_queue_depths;
+} options_t;
+
+// Профиль (загруженный или найденный --autotune) задаёт одну конфигурацию
+void apply_profile(ema_config_t *cfg, options_t *opts, const ema_profile_t *profile) {
+    cfg->engine = profile->engine;
+    cfg->block_size = profile->block_size;
+    opts->thread_counts[0] = profile->threads;
+    opts->n_thread_counts = 1;
+    opts->queue_depths[0] = profile->queue_depth;
+    opts->n_queue_depths = 1;
+}
+
+// Профиль заменяет движок, блок, потоки и глубину очереди из командной
+// строки: одна конфигурация, без прогона для сравнения
+int load_profile(ema_config_t *cfg, options_t *opts) {
+    ema_profile_t profile;
+    if (ema_profile_load(&profile, opts->profile_path) == -1) {
+        return -1;
+    }
+    opts->compare = 0;
+    apply_profile(cfg, opts, &profile);
+    return 0;
+}
+
+// Несовместимые сочетания ключей; сообщение печатается здесь
+int check_options(const ema_config_t *cfg, const options_t *opts) {
+    int analyze = opts->count_list != NULL || opts->histogram;
+    if (opts->autotune && (opts->compare || opts->compare_kernel || opts->rules_bench > 0 || opts->use_index ||
+                           opts->use_zonemap || opts->in_memory || cfg->pattern != EMA_PATTERN_NONE || analyze ||
+                           opts->batch || opts->latency_dump != NULL)) {
+        fprintf(stderr, "Error: --autotune probes full search-and-replace passes over one file and cannot be "
+                        "combined with --engine all, --kernel all, --rules-bench, --index, --zonemap, --in-memory, "
+                        "--pattern, --count/--histogram, --batch or --latency-dump\n");
+        return -1;
+    }
+    if (cfg->direct && !opts->compare && cfg->engine == EMA_ENGINE_MMAP) {
+        fprintf(stderr, "Error: --direct is not supported by the mmap engine\n");
+        return -1;
+    }
+    if (cfg->direct && cfg->dirty == EMA_DIRTY_INT) {
+        fprintf(stderr, "Error: --dirty int writes unaligned ranges and cannot be used with --direct\n");
+        return -1;
+    }
+    if (cfg->direct && opts->cache == CACHE_WARM) {
+        fprintf(stderr, "Error: --warm has no effect with --direct\n");
+        return -1;
+    }
+    if ((cfg->type != EMA_TYPE_I32 || cfg->swap) &&
+        (opts->rules_path != NULL || opts->rules_bench > 0 || opts->use_index || cfg->pattern != EMA_PATTERN_NONE)) {
+        fprintf(stderr, "Error: --rules, --rules-bench, --index and --pattern work on native i32 only\n");
+        return -1;
+    }
+    if (opts->numa_node >= 0 && !opts->in_memory) {
+        fprintf(stderr, "Error: --numa-node applies to the --in-memory buffer only\n");
+        return -1;
+    }
+    if (opts->in_memory && (opts->compare || cfg->direct || opts->cache != CACHE_UNCONTROLLED || opts->use_index ||
+                            cfg->pattern != EMA_PATTERN_NONE)) {
+        fprintf(stderr, "Error: --in-memory replaces file I/O and cannot be combined with --engine all, "
+                        "--direct, --cold/--warm, --index or --pattern\n");
+        return -1;
+    }
+    if (cfg->sync != EMA_SYNC_NONE && opts->in_memory) {
+        fprintf(stderr, "Error: --sync has nothing to flush with --in-memory\n");
+        return -1;
+    }
+    if ((cfg->sync == EMA_SYNC_PER_BLOCK || cfg->sync == EMA_SYNC_RANGE) &&
+        (opts->compare || cfg->engine == EMA_ENGINE_MMAP)) {
+        fprintf(stderr, "Error: --sync per-block and range need the rw or uring engine; use --sync end with mmap\n");
+        return -1;
+    }
+    if (cfg->sync == EMA_SYNC_RANGE && cfg->pattern != EMA_PATTERN_NONE) {
+        fprintf(stderr, "Error: --sync range follows a sequential pass and cannot be used with --pattern\n");
+        return -1;
+    }
+    if (cfg->skip_holes && ((!opts->compare && cfg->engine == EMA_ENGINE_MMAP) || opts->in_memory ||
+                            cfg->pattern != EMA_PATTERN_NONE || analyze)) {
+        fprintf(stderr, "Error: --skip-holes needs a full rw or uring pass and cannot be combined with "
+                        "--engine mmap, --in-memory, --pattern or --count/--histogram\n");
+        return -1;
+    }
+    if (opts->use_zonemap && (cfg->type != EMA_TYPE_I32 || cfg->swap || opts->use_index || cfg->skip_holes ||
+                              opts->in_memory || cfg->pattern != EMA_PATTERN_NONE || analyze || opts->batch)) {
+        fprintf(stderr, "Error: --zonemap works on native i32 full passes over one file and cannot be combined "
+                        "with --index, --skip-holes, --in-memory, --pattern, --count/--histogram or --batch\n");
+        return -1;
+    }
+    if (opts->count_list != NULL && opts->histogram) {
+        fprintf(stderr, "Error: --count and --histogram are mutually exclusive\n");
+        return -1;
+    }
+    if (analyze && (opts->compare || opts->compare_kernel || cfg->engine == EMA_ENGINE_URING ||
+                    opts->rules_path != NULL || opts->rules_bench > 0 || opts->use_index ||
+                    cfg->pattern != EMA_PATTERN_NONE || opts->use_latency || opts->use_perf)) {
+        fprintf(stderr, "Error: --count and --histogram run on the rw or mmap engine only and cannot be combined "
+                        "with --kernel all, --rules, --rules-bench, --index, --pattern, --latency or --perf\n");
+        return -1;
+    }
+    if (opts->batch && (opts->compare || opts->compare_kernel || opts->rules_bench > 0 || opts->use_index ||
+                        opts->in_memory || cfg->pattern != EMA_PATTERN_NONE || analyze ||
+                        opts->cache != CACHE_UNCONTROLLED || opts->n_thread_counts > 1 || opts->latency_dump != NULL)) {
+        fprintf(stderr, "Error: --batch runs one configuration with one thread per file and cannot be combined "
+                        "with --engine all, --kernel all, --rules-bench, --index, --in-memory, --pattern, "
+                        "--count/--histogram, --cold/--warm, --threads or --latency-dump\n");
+        return -1;
+    }
+    if (opts->reset_from != NULL && (opts->compare_kernel || opts->rules_bench > 0 || opts->use_index ||
+                                     opts->use_zonemap || opts->in_memory || analyze || opts->batch)) {
+        fprintf(stderr, "Error: --reset-from restores the file between full passes and cannot be combined with "
+                        "--kernel all, --rules-bench, --index, --zonemap, --in-memory, --count/--histogram "
+                        "or --batch\n");
+        return -1;
+    }
+    if (opts->jobs > 0 && !opts->batch) {
+        fprintf(stderr, "Error: --jobs applies to --batch only\n");
+        return -1;
+    }
+    if (cfg->pattern != EMA_PATTERN_NONE) {
+        if (!opts->compare && cfg->engine == EMA_ENGINE_URING) {
+            fprintf(stderr, "Error: --pattern is supported by the rw and mmap engines only\n");
+            return -1;
+        }
+        if (opts->use_index || opts->rules_path != NULL) {
+            fprintf(stderr, "Error: --pattern cannot be combined with --index or --rules\n");
+            return -1;
+        }
+        if (cfg->direct && cfg->request_size % DIRECT_ALIGN != 0) {
+            fprintf(stderr, "Error: --direct needs a request size that is a multiple of 4K\n");
+            return -1;
+        }
+        if (cfg->stride % cfg->request_size != 0) {
+            fprintf(stderr, "Error: stride must be a multiple of the request size\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Режим и значения для --count/--histogram
+int init_analysis(ema_analysis_t *analysis, const ema_config_t *cfg, const options_t *opts) {
+    memset(analysis, 0, sizeof(*analysis));
+    if (opts->count_list != NULL || opts->histogram) {
+        analysis->mode = opts->histogram ? EMA_ANALYZE_HISTOGRAM : EMA_ANALYZE_COUNT;
+        analysis->top_k = opts->top_k;
+        if (opts->count_list != NULL) {
+            analysis->n_values = parse_typed_list(opts->count_list, cfg->type, analysis->values,
+                                                  EMA_COUNT_MAX_VALUES);
+            if (analysis->n_values <= 0) {
+                fprintf(stderr, "Error: invalid %s value list '%s' (at most %d values)\n",
+                        ema_type_name(cfg->type), opts->count_list, EMA_COUNT_MAX_VALUES);
                 return -1;
             }
         }
-        
-        position += bytes;
     }
-    
-    free(buffer);
-    close(fd);
     return 0;
 }
 
-// Получение размера файла
-off_t get_file_size(const char *filename) {
-    struct stat st;
-    if (stat(filename, &st) == -1) {
-        perror("stat");
+// Параметры запуска перед первым проходом
+void print_header(const char *filename, const ema_config_t *cfg, const options_t *opts, int iterations) {
+    int analyze = opts->count_list != NULL || opts->histogram;
+    printf("EMA Replace Integer\n");
+    printf("===================\n");
+    printf("%s: %s\n", opts->batch ? "Batch source" : "File", filename);
+    char search_str[64], replace_str[64];
+    ema_value_format(cfg->search_value, cfg->type, search_str, sizeof(search_str));
+    ema_value_format(cfg->replace_value, cfg->type, replace_str, sizeof(replace_str));
+    printf("Search value: %s\n", search_str);
+    printf("Replace value: %s\n", replace_str);
+    printf("Element type: %s (%s-endian)\n", ema_type_name(cfg->type), ema_endian_name(opts->endian));
+    printf("Iterations: %d\n", iterations);
+    if (analyze) {
+        printf("Mode: %s (read-only)\n", opts->histogram ? "histogram" : "count");
+    }
+    if (opts->in_memory) {
+        printf("Engine: in-memory (anonymous buffer, no file I/O)\n");
+    } else if (opts->autotune) {
+        printf("Engine: autotune (rw, mmap, uring; block size 4K..8M; 1..%d threads)%s%s\n",
+               autotune_max_threads(), opts->profile_path != NULL ? ", profile saved to " : "",
+               opts->profile_path != NULL ? opts->profile_path : "");
+    } else {
+        if (opts->profile_path != NULL) {
+            printf("Profile: %s\n", opts->profile_path);
+        }
+        printf("Engine: %s", opts->compare ? "all" : ema_engine_name(cfg->engine));
+        if (opts->compare || cfg->engine == EMA_ENGINE_MMAP) {
+            printf("%s%s", cfg->mmap_populate ? " (MAP_POPULATE)" : "", cfg->mmap_sync ? " (msync)" : "");
+        }
+        printf("\n");
+    }
+    if (cfg->pattern != EMA_PATTERN_NONE) {
+        printf("Pattern: %s, %zu-byte requests, ", ema_pattern_name(cfg->pattern), cfg->request_size);
+        if (cfg->ops) {
+            printf("%llu ops", cfg->ops);
+        } else {
+            printf("one op per request slot");
+        }
+        printf(", %.0f%% read-modify-write", cfg->write_ratio * 100.0);
+        if (cfg->pattern == EMA_PATTERN_STRIDED) {
+            printf(", stride %zu bytes", cfg->stride);
+        }
+        printf("\n");
+    } else if (opts->compare || opts->autotune || cfg->engine != EMA_ENGINE_MMAP) {
+        if (!opts->autotune) {
+            printf("Block size: %zu bytes\n", cfg->block_size);
+        }
+        if (!analyze) {
+            printf("Write-back: %s\n", ema_dirty_name(cfg->dirty));
+        }
+    }
+    if (opts->compare || opts->autotune || cfg->engine == EMA_ENGINE_URING) {
+        printf("Queue depth:");
+        for (int i = 0; i < opts->n_queue_depths; i++) {
+            printf("%s%d", i == 0 ? " " : ",", opts->queue_depths[i]);
+        }
+        printf("\n");
+    }
+    if (cfg->sync != EMA_SYNC_NONE) {
+        printf("Sync: %s", ema_sync_name(cfg->sync));
+        if (cfg->sync == EMA_SYNC_END) {
+            printf(" (fdatasync after every pass)");
+        } else if (cfg->sync == EMA_SYNC_PER_BLOCK) {
+            printf(" (O_DSYNC writes)");
+        } else {
+            printf(" (sync_file_range, %zu-byte window, fdatasync after every pass)", cfg->sync_window);
+        }
+        printf("\n");
+    }
+    if (cfg->direct) {
+        printf("Direct I/O: O_DIRECT%s\n", opts->compare ? " (mmap engine runs through the page cache)" : "");
+    }
+    if (cfg->skip_holes) {
+        printf("Holes: skipped via SEEK_DATA/SEEK_HOLE%s\n", opts->compare ? " (mmap engine reads them)" : "");
+    }
+    printf("Cache: %s\n", opts->cache == CACHE_COLD ? "cold (dropped before every iteration)"
+                          : opts->cache == CACHE_WARM ? "warm (preloaded before every iteration)"
+                          : "uncontrolled");
+    printf("Kernel: %s\n", opts->compare_kernel ? "all" : ema_kernel_name(ema_kernel_resolve(cfg->kernel)));
+    if (opts->batch) {
+        printf("Workers: up to %d, one file per worker at a time\n", opts->jobs);
+    } else if (!opts->autotune) {
+        printf("Threads:");
+        for (int i = 0; i < opts->n_thread_counts; i++) {
+            printf("%s%d", i == 0 ? " " : ",", opts->thread_counts[i]);
+        }
+        printf("\n");
+    }
+    if (opts->use_latency) {
+        printf("Latency: per operation, log-linear histogram%s%s\n", opts->latency_dump != NULL ? ", raw buckets to " : "",
+               opts->latency_dump != NULL ? opts->latency_dump : "");
+    }
+    printf("\n");
+}
+
+// --batch: правила и гистограмма задержек общие для всех файлов пакета
+int run_batch_mode(const char *source, ema_config_t *cfg, const options_t *opts, int iterations) {
+    ema_rules_t batch_rules;
+    if (opts->rules_path != NULL) {
+        if (ema_rules_load(opts->rules_path, &batch_rules) == -1) {
+            return -1;
+        }
+        cfg->rules = &batch_rules;
+    }
+    ema_latency_t *batch_latency = NULL;
+    if (opts->use_latency) {
+        batch_latency = calloc(1, sizeof(ema_latency_t));
+        if (batch_latency == NULL) {
+            perror("calloc");
+            if (cfg->rules != NULL) {
+                ema_rules_free(&batch_rules);
+            }
+            return -1;
+        }
+        cfg->latency = batch_latency;
+    }
+    int status = run_batch(source, cfg, opts->jobs, iterations, opts->use_perf);
+    free(batch_latency);
+    if (cfg->rules != NULL) {
+        ema_rules_free(&batch_rules);
+    }
+    return status;
+}
+
+// --autotune: перебор, сохранение профиля и переход к найденной конфигурации
+int run_autotune_mode(const char *filename, ema_config_t *cfg, options_t *opts) {
+    ema_profile_t profile;
+    cfg->queue_depth = opts->queue_depths[0];
+    if (run_autotune(filename, cfg, opts->cache, opts->reset_from, &profile) == -1) {
         return -1;
     }
-    return st.st_size;
+    if (opts->profile_path != NULL) {
+        if (ema_profile_save(&profile, opts->profile_path, filename) == -1) {
+            return -1;
+        }
+        printf("Profile saved to %s\n", opts->profile_path);
+    }
+    printf("\n");
+    apply_profile(cfg, opts, &profile);
+    return 0;
+}
+
+// Итоги серии итераций одной конфигурации
+void print_run(const ema_run_t *run, const options_t *opts) {
+    printf("\n");
+    printf("Results:\n");
+    printf("========\n");
+    printf("Total iterations: %d\n", run->iterations);
+    printf("Total matches found and replaced: %llu\n", run->total_matches);
+    printf("Total bytes read: %llu (%.2f MB)\n", 
+           run->total_bytes, (double)run->total_bytes / (1024.0 * 1024.0));
+    printf("Total bytes written: %llu (%.2f MB)\n", 
+           run->total_written, (double)run->total_written / (1024.0 * 1024.0));
+    printf("Logical bytes changed: %llu, write amplification: %.2fx\n",
+           run->total_matches * ema_type_size(run->cfg.type),
+           write_amplification(run->total_written, run->total_matches, &run->cfg));
+    printf("Execution time: %lld.%06lld seconds\n", 
+           run->elapsed_us / 1000000, run->elapsed_us % 1000000);
+    printf("Average time per iteration: %.6f seconds\n", 
+           (double)run->elapsed_us / run->iterations / 1000000.0);
+    printf("Read throughput: %.2f MB/s (%s)\n", run_mbps(run), cache_label(run->cache, &run->cfg));
+    if (opts->in_memory) {
+        printf("Memory throughput: %.2f GB/s\n",
+               (double)run->total_bytes / (run->elapsed_us / 1000000.0) / (1024.0 * 1024.0 * 1024.0));
+    }
+    if (run->cfg.pattern != EMA_PATTERN_NONE) {
+        double seconds = run->elapsed_us / 1000000.0;
+        printf("Operations: %llu (%llu reads, %llu read-modify-writes)\n", run->calls.ops,
+               run->calls.ops - run->calls.rmw_ops, run->calls.rmw_ops);
+        printf("IOPS: %.0f, bandwidth: %.2f MB/s (read + write)\n", run->calls.ops / seconds,
+               (double)(run->total_bytes + run->total_written) / seconds / (1024.0 * 1024.0));
+        printf("Matches seen by read-only requests: %llu\n", run->calls.read_matches);
+    }
+    if (run->cfg.sync != EMA_SYNC_NONE) {
+        print_sync_time(&run->cfg, &run->calls, run->elapsed_us, "Time in ");
+    }
+    if (run->cfg.skip_holes && run->cfg.engine != EMA_ENGINE_MMAP) {
+        print_holes(&run->calls);
+    }
+    if (opts->use_zonemap) {
+        unsigned long long total = run->calls.bytes_pruned + run->total_bytes;
+        printf("Zone map: %.1f%% of the file skipped over all iterations, I/O saved %.2f MB of %.2f MB\n",
+               total > 0 ? 100.0 * run->calls.bytes_pruned / total : 0.0,
+               (double)run->calls.bytes_pruned / (1024.0 * 1024.0), (double)total / (1024.0 * 1024.0));
+    }
+    if (opts->use_index) {
+        printf("Iterations served from index: %d of %d\n", run->index_patches, run->iterations);
+    }
+    if (run->cache != CACHE_UNCONTROLLED) {
+        printf("Cache preparation time: %lld.%06lld seconds (not included above)\n",
+               run->cache_us / 1000000, run->cache_us % 1000000);
+    }
+    if (opts->reset_from != NULL) {
+        printf("Reset time: %lld.%06lld seconds (%s, not included above)\n",
+               run->reset_us / 1000000, run->reset_us % 1000000, ema_reset_name(run->reset));
+    }
+    printf("Syscalls: %llu (read %llu, write %llu, other %llu; %.1f per iteration)\n",
+           ema_stats_syscalls(&run->calls), run->calls.read_calls, run->calls.write_calls,
+           run->calls.other_calls, (double)ema_stats_syscalls(&run->calls) / run->iterations);
+    if (run->cfg.latency != NULL) {
+        printf("Latency over all iterations:\n");
+        ema_latency_print(run->cfg.latency, "  ");
+    }
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < 6) {
-        fprintf(stderr, "Usage: %s <file> <size_mb> <search_value> <replace_value> <iterations>\n", argv[0]);
-        fprintf(stderr, "  file          - path to the data file\n");
-        fprintf(stderr, "  size_mb       - size of file in MB (for new file creation)\n");
-        fprintf(stderr, "  search_value  - integer value to search for\n");
-        fprintf(stderr, "  replace_value - integer value to replace with\n");
-        fprintf(stderr, "  iterations    - number of search-replace iterations\n");
+    options_t opts = { .cache = CACHE_UNCONTROLLED, .zone_size = EMA_ZONE_DEFAULT_SIZE, .endian = EMA_ENDIAN_NATIVE,
+                       .numa_node = -1, .top_k = 10, .thread_counts = { 1 }, .n_thread_counts = 1,
+                       .queue_depths = { 16 }, .n_queue_depths = 1 };
+    ema_config_t cfg = { .engine = EMA_ENGINE_RW, .block_size = BUFFER_SIZE, .threads = 1,
+                         .type = EMA_TYPE_I32, .dirty = EMA_DIRTY_PAGE, .request_size = BUFFER_SIZE, .write_ratio = 0.5,
+                         .sync_window = EMA_SYNC_DEFAULT_WINDOW };
+
+    static const struct option long_options[] = {
+        {"engine",   required_argument, NULL, 'e'},
+        {"block-size", required_argument, NULL, 'b'},
+        {"kernel",   required_argument, NULL, 'k'},
+        {"threads",  required_argument, NULL, 't'},
+        {"qd",       required_argument, NULL, 'q'},
+        {"rules",    required_argument, NULL, 'r'},
+        {"rules-bench", required_argument, NULL, 'R'},
+        {"index",    no_argument,       NULL, 'i'},
+        {"index-values", required_argument, NULL, 'I'},
+        {"zonemap",  no_argument,       NULL, 'Z'},
+        {"zone-size", required_argument, NULL, 'X'},
+        {"dirty",    required_argument, NULL, 'd'},
+        {"direct",   no_argument,       NULL, 'D'},
+        {"skip-holes", no_argument,     NULL, 'G'},
+        {"drop-cache", no_argument,     NULL, 'C'},
+        {"cold",     no_argument,       NULL, 'C'},
+        {"warm",     no_argument,       NULL, 'W'},
+        {"reset-from", required_argument, NULL, 'F'},
+        {"populate", no_argument,       NULL, 'p'},
+        {"msync",    no_argument,       NULL, 'm'},
+        {"perf",     no_argument,       NULL, 'P'},
+        {"pattern",  required_argument, NULL, 'a'},
+        {"request-size", required_argument, NULL, 'z'},
+        {"ops",      required_argument, NULL, 'o'},
+        {"write-ratio", required_argument, NULL, 'w'},
+        {"stride",   required_argument, NULL, 'S'},
+        {"latency",  no_argument,       NULL, 'l'},
+        {"latency-dump", required_argument, NULL, 'L'},
+        {"in-memory", no_argument,      NULL, 'M'},
+        {"type",     required_argument, NULL, 'T'},
+        {"endian",   required_argument, NULL, 'E'},
+        {"numa-node", required_argument, NULL, 'N'},
+        {"sync",     required_argument, NULL, 's'},
+        {"sync-window", required_argument, NULL, 'Y'},
+        {"autotune", no_argument,       NULL, 'A'},
+        {"profile",  required_argument, NULL, 'O'},
+        {"batch",    no_argument,       NULL, 'B'},
+        {"jobs",     required_argument, NULL, 'J'},
+        {"count",    required_argument, NULL, 'c'},
+        {"histogram", no_argument,      NULL, 'H'},
+        {"top",      required_argument, NULL, 'K'},
+        {"help",     no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'e':
+                if (strcmp(optarg, "all") == 0) {
+                    opts.compare = 1;
+                } else if (ema_engine_parse(optarg, &cfg.engine) == -1) {
+                    fprintf(stderr, "Error: unknown engine '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'b': {
+                long long size = parse_size(optarg);
+                if (size < MIN_BLOCK_SIZE || size > MAX_BLOCK_SIZE || size % MIN_BLOCK_SIZE != 0) {
+                    fprintf(stderr, "Error: block size must be a multiple of 4K in 4K..64M\n");
+                    return 1;
+                }
+                cfg.block_size = size;
+                break;
+            }
+            case 'k':
+                if (strcmp(optarg, "all") == 0) {
+                    opts.compare_kernel = 1;
+                } else if (ema_kernel_parse(optarg, &cfg.kernel) == -1) {
+                    fprintf(stderr, "Error: unknown kernel '%s'\n", optarg);
+                    return 1;
+                } else if (!ema_kernel_supported(cfg.kernel)) {
+                    fprintf(stderr, "Error: kernel '%s' is not supported by this CPU\n", optarg);
+                    return 1;
+                }
+                break;
+            case 't':
+                opts.n_thread_counts = parse_thread_counts(optarg, opts.thread_counts);
+                if (opts.n_thread_counts <= 0) {
+                    fprintf(stderr, "Error: invalid thread count list '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'q':
+                opts.n_queue_depths = parse_count_list(optarg, opts.queue_depths, MAX_QUEUE_DEPTHS, MAX_QUEUE_DEPTH);
+                if (opts.n_queue_depths <= 0) {
+                    fprintf(stderr, "Error: invalid queue depth list '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'r':
+                opts.rules_path = optarg;
+                break;
+            case 'i':
+                opts.use_index = 1;
+                break;
+            case 'I':
+                opts.n_index_values = parse_value_list(optarg, opts.index_values, EMA_INDEX_MAX_VALUES);
+                if (opts.n_index_values <= 0) {
+                    fprintf(stderr, "Error: invalid index value list '%s' (at most %d values)\n",
+                            optarg, EMA_INDEX_MAX_VALUES);
+                    return 1;
+                }
+                opts.use_index = 1;
+                break;
+            case 'R': {
+                char *end;
+                opts.rules_bench = strtol(optarg, &end, 10);
+                if (*end != '\0' || opts.rules_bench <= 0 || opts.rules_bench > 64L * 1024 * 1024) {
+                    fprintf(stderr, "Error: invalid rule count '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case 'd':
+                if (ema_dirty_parse(optarg, &cfg.dirty) == -1) {
+                    fprintf(stderr, "Error: unknown dirty granularity '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'D':
+                cfg.direct = 1;
+                break;
+            case 'C':
+            case 'W': {
+                cache_mode_t mode = (opt == 'C') ? CACHE_COLD : CACHE_WARM;
+                if (opts.cache != CACHE_UNCONTROLLED && opts.cache != mode) {
+                    fprintf(stderr, "Error: --cold/--drop-cache and --warm are mutually exclusive\n");
+                    return 1;
+                }
+                opts.cache = mode;
+                break;
+            }
+            case 'p':
+                cfg.mmap_populate = 1;
+                break;
+            case 'm':
+                cfg.mmap_sync = 1;
+                break;
+            case 'P':
+                opts.use_perf = 1;
+                break;
+            case 'l':
+                opts.use_latency = 1;
+                break;
+            case 'M':
+                opts.in_memory = 1;
+                break;
+            case 'T':
+                if (ema_type_parse(optarg, &cfg.type) == -1) {
+                    fprintf(stderr, "Error: unknown element type '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'E':
+                if (ema_endian_parse(optarg, &opts.endian) == -1) {
+                    fprintf(stderr, "Error: unknown byte order '%s'\n", optarg);
+                    return 1;
+                }
+                cfg.swap = ema_endian_swap(opts.endian);
+                break;
+            case 'N': {
+                char *end;
+                long node = strtol(optarg, &end, 10);
+                if (*end != '\0' || node < 0 || node > 1023) {
+                    fprintf(stderr, "Error: invalid NUMA node '%s'\n", optarg);
+                    return 1;
+                }
+                opts.numa_node = (int)node;
+                break;
+            }
+            case 's':
+                if (ema_sync_parse(optarg, &cfg.sync) == -1) {
+                    fprintf(stderr, "Error: unknown sync policy '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'Y': {
+                long long size = parse_size(optarg);
+                if (size < MIN_BLOCK_SIZE || size % MIN_BLOCK_SIZE != 0) {
+                    fprintf(stderr, "Error: sync window must be a positive multiple of 4K\n");
+                    return 1;
+                }
+                cfg.sync_window = size;
+                break;
+            }
+            case 'G':
+                cfg.skip_holes = 1;
+                break;
+            case 'Z':
+                opts.use_zonemap = 1;
+                break;
+            case 'X': {
+                long long size = parse_size(optarg);
+                if (size < MIN_BLOCK_SIZE || size % MIN_BLOCK_SIZE != 0) {
+                    fprintf(stderr, "Error: zone size must be a positive multiple of 4K\n");
+                    return 1;
+                }
+                opts.zone_size = size;
+                opts.use_zonemap = 1;
+                break;
+            }
+            case 'B':
+                opts.batch = 1;
+                break;
+            case 'F':
+                opts.reset_from = optarg;
+                break;
+            case 'A':
+                opts.autotune = 1;
+                break;
+            case 'O':
+                opts.profile_path = optarg;
+                break;
+            case 'J':
+                if (parse_count_list(optarg, &opts.jobs, 1, 1024) != 1) {
+                    fprintf(stderr, "Error: --jobs must be in 1..1024\n");
+                    return 1;
+                }
+                break;
+            case 'c':
+                opts.count_list = optarg;
+                break;
+            case 'H':
+                opts.histogram = 1;
+                break;
+            case 'K': {
+                char *end;
+                long k = strtol(optarg, &end, 10);
+                if (*end != '\0' || k <= 0 || k > EMA_TOP_MAX) {
+                    fprintf(stderr, "Error: --top must be in 1..%d\n", EMA_TOP_MAX);
+                    return 1;
+                }
+                opts.top_k = (int)k;
+                break;
+            }
+            case 'L':
+                opts.latency_dump = optarg;
+                opts.use_latency = 1;
+                break;
+            case 'a':
+                if (ema_pattern_parse(optarg, &cfg.pattern) == -1) {
+                    fprintf(stderr, "Error: unknown access pattern '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'z': {
+                long long size = parse_size(optarg);
+                if (size < (long long)sizeof(int) || size > MAX_BLOCK_SIZE || size % sizeof(int) != 0) {
+                    fprintf(stderr, "Error: request size must be a multiple of 4 bytes up to 64M\n");
+                    return 1;
+                }
+                cfg.request_size = size;
+                break;
+            }
+            case 'o': {
+                char *end;
+                cfg.ops = strtoull(optarg, &end, 10);
+                if (*end != '\0' || cfg.ops == 0) {
+                    fprintf(stderr, "Error: invalid operation count '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case 'w': {
+                char *end;
+                cfg.write_ratio = strtod(optarg, &end);
+                if (*end != '\0' || cfg.write_ratio < 0.0 || cfg.write_ratio > 1.0) {
+                    fprintf(stderr, "Error: write ratio must be in 0..1\n");
+                    return 1;
+                }
+                break;
+            }
+            case 'S': {
+                long long size = parse_size(optarg);
+                if (size <= 0) {
+                    fprintf(stderr, "Error: invalid stride '%s'\n", optarg);
+                    return 1;
+                }
+                cfg.stride = size;
+                break;
+            }
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (argc - optind < 5) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (opts.profile_path != NULL && !opts.autotune && load_profile(&cfg, &opts) == -1) {
+        return 1;
+    }
+    // Шаг по умолчанию нужен проверке кратности размеру запроса
+    if (cfg.pattern != EMA_PATTERN_NONE && cfg.stride == 0) {
+        cfg.stride = cfg.request_size * 16;
+    }
+    if (check_options(&cfg, &opts) == -1) {
         return 1;
     }
+    int analyze = opts.count_list != NULL || opts.histogram;
     
-    const char *filename = argv[1];
-    int size_mb = atoi(argv[2]);
-    int search_value = atoi(argv[3]);
-    int replace_value = atoi(argv[4]);
-    int iterations = atoi(argv[5]);
+    const char *filename = argv[optind];
+    int size_mb = atoi(argv[optind + 1]);
+    int iterations = atoi(argv[optind + 4]);
+    if (ema_value_parse(argv[optind + 2], cfg.type, &cfg.search_value) == -1 ||
+        ema_value_parse(argv[optind + 3], cfg.type, &cfg.replace_value) == -1) {
+        fprintf(stderr, "Error: search and replace values must be valid %s values\n", ema_type_name(cfg.type));
+        return 1;
+    }
     
-    if (size_mb <= 0 || iterations <= 0) {
+    // В пакетном режиме файлы не создаются, и size_mb не используется
+    if ((size_mb <= 0 && !opts.batch) || iterations <= 0) {
         fprintf(stderr, "Error: size_mb and iterations must be positive\n");
         return 1;
     }
+
+    ema_analysis_t analysis;
+    if (init_analysis(&analysis, &cfg, &opts) == -1) {
+        return 1;
+    }
     
-    printf("EMA Replace Integer\n");
-    printf("===================\n");
-    printf("File: %s\n", filename);
-    printf("Search value: %d\n", search_value);
-    printf("Replace value: %d\n", replace_value);
-    printf("Iterations: %d\n", iterations);
-    printf("\n");
+    if (opts.batch && opts.jobs == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        opts.jobs = cpus > 0 ? (cpus < 1024 ? (int)cpus : 1024) : 1;
+    }
+    if (opts.in_memory) {
+        // Буфер сканируется постранично, как отображение mmap движка
+        cfg.engine = EMA_ENGINE_MMAP;
+    }
+    print_header(filename, &cfg, &opts, iterations);
     
-    // Проверяем существование файла
-    if (access(filename, F_OK) != 0) {
-        printf("File does not exist. Creating new file with size %d MB...\n", size_mb);
-        
-        // Создаем файл
-        int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd == -1) {
-            perror("open");
+    if (opts.batch) {
+        return run_batch_mode(filename, &cfg, &opts, iterations) == -1 ? 1 : 0;
+    }
+
+    if (opts.reset_from != NULL) {
+        // Итерации пишут в файл: шаблон не должен оказаться им самим
+        struct stat template_st, data_st;
+        if (stat(opts.reset_from, &template_st) == -1) {
+            perror(opts.reset_from);
             return 1;
         }
-        
-        int *buffer = malloc(BUFFER_SIZE);
-        if (buffer == NULL) {
-            perror("malloc");
-            close(fd);
+        if (stat(filename, &data_st) == 0 && data_st.st_dev == template_st.st_dev &&
+            data_st.st_ino == template_st.st_ino) {
+            fprintf(stderr, "Error: --reset-from template is the data file itself\n");
             return 1;
         }
-        
-        // Заполняем файл случайными числами
-        srand(time(NULL));
-        unsigned long long total_bytes = (unsigned long long)size_mb * 1024 * 1024;
-        unsigned long long written_bytes = 0;
-        int search_count = 0;
-        int target_searches = (total_bytes / sizeof(int)) / 100;  // 1% значений
-        
-        while (written_bytes < total_bytes) {
-            int num_ints = BUFFER_SIZE / sizeof(int);
-            for (int i = 0; i < num_ints; i++) {
-                // Вставляем искомое значение с определенной вероятностью
-                if (search_count < target_searches && (rand() % 100) == 0) {
-                    buffer[i] = search_value;
-                    search_count++;
-                } else {
-                    buffer[i] = rand();
-                }
-            }
-            
-            ssize_t to_write = BUFFER_SIZE;
-            if (written_bytes + to_write > total_bytes) {
-                to_write = total_bytes - written_bytes;
-            }
-            
-            ssize_t result = write(fd, buffer, to_write);
-            if (result == -1) {
-                perror("write");
-                free(buffer);
-                close(fd);
+    }
+
+    // Проверяем существование файла; при восстановлении из шаблона он
+    // создаётся копией шаблона
+    if (access(filename, F_OK) != 0) {
+        ema_reset_t method;
+        if (opts.reset_from != NULL) {
+            if (ema_reset_file(opts.reset_from, filename, &method) == -1) {
                 return 1;
             }
-            
-            written_bytes += result;
-            
-            if (written_bytes % (1024 * 1024 * 10) == 0) {
-                printf("Generated: %llu MB\n", written_bytes / (1024 * 1024));
-            }
+        } else if (cfg.type != EMA_TYPE_I32 || cfg.swap) {
+            fprintf(stderr, "Error: %s does not exist; only native i32 files can be generated\n", filename);
+            return 1;
+        } else if (create_data_file(filename, size_mb, (int)cfg.search_value, cfg.block_size) == -1) {
+            return 1;
         }
-        
-        printf("File created successfully. Inserted ~%d search values.\n\n", search_count);
-        free(buffer);
-        close(fd);
     }
     
     // Получаем размер файла
@@ -216,51 +1710,236 @@ int main(int argc, char *argv[]) {
     printf("File size: %.2f MB (%lld bytes)\n", 
            (double)file_size / (1024.0 * 1024.0), (long long)file_size);
     printf("\n");
-    
-    // Выполняем поиск и замену
-    long long start_time = get_time_us();
-    unsigned long long total_matches = 0;
-    unsigned long long total_bytes = 0;
-    
-    for (int i = 0; i < iterations; i++) {
-        unsigned long long matches = 0;
-        unsigned long long bytes = 0;
-        
-        if (replace_in_file(filename, search_value, replace_value, &matches, &bytes) == -1) {
+
+    if (opts.compare_kernel) {
+        return compare_kernels(filename, &cfg, file_size, iterations) == -1 ? 1 : 0;
+    }
+    if (opts.rules_bench > 0) {
+        return bench_rules(filename, file_size, opts.rules_bench, iterations) == -1 ? 1 : 0;
+    }
+
+    ema_memory_t memory;
+    if (opts.in_memory) {
+        long long load_start = get_time_us();
+        if (ema_memory_load(filename, opts.numa_node, &memory) == -1) {
             return 1;
         }
-        
-        total_matches += matches;
-        total_bytes += bytes;
-        
-        printf("Iteration %d/%d: found and replaced %llu values (read %llu bytes)\n", 
-               i + 1, iterations, matches, bytes);
-        
-        // После первой итерации все значения заменены, поэтому меняем поиск/замену местами
-        if (i == 0) {
-            int temp = search_value;
-            search_value = replace_value;
-            replace_value = temp;
+        long long load_us = get_time_us() - load_start;
+        cfg.memory = &memory;
+        printf("In-memory buffer: %.2f MB loaded in %.3f s, %s", (double)memory.size / (1024.0 * 1024.0),
+               load_us / 1000000.0, ema_huge_name(memory.huge));
+        if (memory.huge_bytes >= 0) {
+            printf(" (%.2f MB backed by huge pages)", (double)memory.huge_bytes / (1024.0 * 1024.0));
+        }
+        if (memory.numa_node >= 0) {
+            printf(", bound to NUMA node %d", memory.numa_node);
         }
+        printf("\n\n");
+    }
+
+    if (analyze) {
+        int status = run_analysis(filename, &cfg, opts.cache, opts.thread_counts, opts.n_thread_counts, iterations,
+                                  &analysis);
+        if (opts.in_memory) {
+            ema_memory_free(&memory);
+        }
+        return status == -1 ? 1 : 0;
+    }
+
+    ema_index_t index;
+    char index_path[4096];
+    if (opts.use_index) {
+        if (opts.rules_path != NULL) {
+            fprintf(stderr, "Error: --index cannot be combined with --rules\n");
+            return 1;
+        }
+        if (opts.n_index_values == 0) {
+            opts.index_values[opts.n_index_values++] = (int)cfg.search_value;
+            opts.index_values[opts.n_index_values++] = (int)cfg.replace_value;
+        }
+        snprintf(index_path, sizeof(index_path), "%s.idx", filename);
+        if (ema_index_init(&index, opts.index_values, opts.n_index_values) == -1) {
+            return 1;
+        }
+        int loaded = ema_index_load(&index, index_path, filename);
+        if (loaded == -1) {
+            return 1;
+        }
+        printf("Index: %s (%s, values", index_path, loaded == 0 ? "loaded" : "will be built");
+        for (int k = 0; k < index.n_values; k++) {
+            printf("%s%d", k == 0 ? " " : ",", index.values[k]);
+        }
+        printf(")\n\n");
+    } else {
+        index_path[0] = '\0';
+    }
+
+    ema_zonemap_t zonemap;
+    if (opts.use_zonemap) {
+        char zonemap_path[4096];
+        snprintf(zonemap_path, sizeof(zonemap_path), "%s.zmap", filename);
+        ema_zonemap_init(&zonemap, opts.zone_size);
+        int loaded = ema_zonemap_load(&zonemap, zonemap_path, filename);
+        if (loaded == -1) {
+            return 1;
+        }
+        printf("Zone map: %s (%s, %zu-byte zones)\n\n", zonemap_path, loaded == 0 ? "loaded" : "will be built",
+               opts.zone_size);
+        cfg.zonemap = &zonemap;
+    }
+
+    ema_rules_t rules;
+    if (opts.rules_path != NULL) {
+        if (ema_rules_load(opts.rules_path, &rules) == -1) {
+            return 1;
+        }
+        cfg.rules = &rules;
+        printf("Rules: %s (%zu pairs applied in one pass)\n\n", opts.rules_path, rules.count);
+    }
+    if (opts.reset_from != NULL) {
+        printf("Reset: from %s before every iteration\n\n", opts.reset_from);
+    }
+
+    if (opts.autotune && run_autotune_mode(filename, &cfg, &opts) == -1) {
+        return 1;
+    }
+
+    int first_engine = opts.compare ? 0 : (int)cfg.engine;
+    int last_engine = opts.compare ? EMA_ENGINE_COUNT - 1 : (int)cfg.engine;
+
+    // Конфигурации: движок x потоки, для uring ещё и x глубина очереди
+    ema_config_t variants[EMA_ENGINE_COUNT * MAX_THREAD_COUNTS * MAX_QUEUE_DEPTHS];
+    int n_runs = 0;
+    for (int e = first_engine; e <= last_engine; e++) {
+        for (int t = 0; t < opts.n_thread_counts; t++) {
+            if (e == EMA_ENGINE_URING && cfg.pattern != EMA_PATTERN_NONE) {
+                continue;
+            }
+            int n_qd = (e == EMA_ENGINE_URING) ? opts.n_queue_depths : 1;
+            for (int q = 0; q < n_qd; q++) {
+                ema_config_t *v = &variants[n_runs++];
+                *v = cfg;
+                v->engine = (ema_engine_t)e;
+                v->threads = opts.thread_counts[t];
+                v->queue_depth = (e == EMA_ENGINE_URING) ? opts.queue_depths[q] : 0;
+                v->direct = (e == EMA_ENGINE_MMAP) ? 0 : cfg.direct;
+            }
+        }
+    }
+    ema_run_t runs[EMA_ENGINE_COUNT * MAX_THREAD_COUNTS * MAX_QUEUE_DEPTHS];
+
+    ema_latency_t *latency = NULL;
+    FILE *dump = NULL;
+    if (opts.use_latency) {
+        latency = malloc(sizeof(ema_latency_t));
+        if (latency == NULL) {
+            perror("malloc");
+            return 1;
+        }
+    }
+    if (opts.latency_dump != NULL) {
+        dump = fopen(opts.latency_dump, "w");
+        if (dump == NULL) {
+            perror(opts.latency_dump);
+            return 1;
+        }
+        fprintf(dump, "run,op,low_ns,high_ns,count\n");
     }
     
-    long long end_time = get_time_us();
-    long long elapsed = end_time - start_time;
-    
-    // Статистика
-    printf("\n");
-    printf("Results:\n");
-    printf("========\n");
-    printf("Total iterations: %d\n", iterations);
-    printf("Total matches found and replaced: %llu\n", total_matches);
-    printf("Total bytes read: %llu (%.2f MB)\n", 
-           total_bytes, (double)total_bytes / (1024.0 * 1024.0));
-    printf("Execution time: %lld.%06lld seconds\n", 
-           elapsed / 1000000, elapsed % 1000000);
-    printf("Average time per iteration: %.6f seconds\n", 
-           (double)elapsed / iterations / 1000000.0);
-    printf("Read throughput: %.2f MB/s\n", 
-           (double)total_bytes / (elapsed / 1000000.0) / (1024.0 * 1024.0));
+    // Каждая конфигурация начинается с одного и того же содержимого, иначе
+    // сверка совпадений и ускорение сравнивают разные нагрузки: файл
+    // восстанавливается из снимка, снятого до первой, буфер в памяти
+    // перечитывается из файла. С шаблоном файл восстанавливается перед
+    // каждой итерацией и так.
+    char snapshot[4096] = "";
+    if (n_runs > 1 && !opts.in_memory && opts.reset_from == NULL &&
+        ema_snapshot_create(filename, snapshot, sizeof(snapshot)) == -1) {
+        return 1;
+    }
+    int status = 0;
+    for (int r = 0; r < n_runs && status == 0; r++) {
+        ema_run_t *run = &runs[r];
+        cfg = variants[r];
+        ema_reset_t method;
+        if (r > 0 && ((opts.in_memory && ema_memory_reload(filename, &memory) == -1) ||
+                      (snapshot[0] != '\0' && ema_reset_file(snapshot, filename, &method) == -1))) {
+            status = 1;
+            break;
+        }
+        if (latency != NULL) {
+            memset(latency, 0, sizeof(*latency));
+            cfg.latency = latency;
+        }
+        if (n_runs > 1) {
+            printf("--- Engine: %s, threads: %d", engine_label(&cfg), cfg.threads);
+            if (cfg.engine == EMA_ENGINE_URING) {
+                printf(", qd: %d", cfg.queue_depth);
+            }
+            printf(" ---\n");
+        }
+
+        // Счётчики наследуются рабочими потоками многопоточного прохода
+        perf_counters_t counters;
+        if (opts.use_perf) {
+            perf_counters_open(&counters, 1);
+            perf_counters_start(&counters);
+        }
+
+        // Выполняем поиск и замену
+        if (run_iterations(filename, &cfg, opts.cache, opts.reset_from, opts.use_index ? &index : NULL, index_path,
+                           iterations, run) == -1) {
+            status = 1;
+            break;
+        }
+
+        if (opts.use_perf) {
+            perf_counters_stop(&counters);
+        }
+        
+        print_run(run, &opts);
+        if (dump != NULL) {
+            char label[64];
+            snprintf(label, sizeof(label), "%s/t%d", engine_label(&cfg), cfg.threads);
+            if (cfg.engine == EMA_ENGINE_URING) {
+                snprintf(label + strlen(label), sizeof(label) - strlen(label), "/qd%d", cfg.queue_depth);
+            }
+            if (ema_latency_dump(latency, label, dump) == -1) {
+                status = 1;
+            }
+        }
+        if (opts.use_perf) {
+            perf_counters_report(&counters, run->total_bytes);
+            perf_counters_close(&counters);
+        }
+        printf("\n");
+    }
+    if (snapshot[0] != '\0') {
+        unlink(snapshot);
+    }
+    if (status != 0) {
+        return status;
+    }
+
+    if (n_runs > 1) {
+        print_comparison(runs, n_runs);
+    }
+    if (dump != NULL && fclose(dump) != 0) {
+        perror(opts.latency_dump);
+        return 1;
+    }
+    free(latency);
+    if (opts.in_memory) {
+        ema_memory_free(&memory);
+    }
+    if (cfg.rules != NULL) {
+        ema_rules_free(&rules);
+    }
+    if (opts.use_index) {
+        ema_index_free(&index);
+    }
+    if (opts.use_zonemap) {
+        ema_zonemap_free(&zonemap);
+    }
     
     return 0;
 }
@@ -0,0 +1,161 @@
+#define _GNU_SOURCE
+#include "ema.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+// Восстановление файла данных из шаблона перед итерацией: каждая
+// итерация видит одно и то же содержимое. Быстрее всего reflink
+// (FICLONE: файл делит экстенты шаблона, копирования нет вовсе); где ФС
+// его не умеет - copy_file_range (копия внутри ядра), а если и его нет
+// между этими файлами - обычные read/write. Копируются только участки
+// данных шаблона, дыры разреженного шаблона остаются дырами.
+
+#define RESET_COPY_CHUNK (MAX_BLOCK_SIZE / 16)
+
+static const char *reset_names[EMA_RESET_COUNT] = {
+    [EMA_RESET_REFLINK] = "reflink",
+    [EMA_RESET_COPY_RANGE] = "copy_file_range",
+    [EMA_RESET_RW] = "read/write",
+};
+
+const char *ema_reset_name(ema_reset_t method) {
+    return method < EMA_RESET_COUNT ? reset_names[method] : "?";
+}
+
+// Ошибки, означающие "этим способом между этими файлами нельзя"
+static int unsupported(int err) {
+    return err == EOPNOTSUPP || err == ENOTTY || err == EXDEV || err == EINVAL || err == ENOSYS;
+}
+
+static int copy_rw(int src, int dst, off_t offset, off_t end) {
+    char *buffer = ema_alloc_block(RESET_COPY_CHUNK);
+    if (buffer == NULL) {
+        return -1;
+    }
+    int status = 0;
+    while (offset < end) {
+        size_t want = end - offset < RESET_COPY_CHUNK ? (size_t)(end - offset) : RESET_COPY_CHUNK;
+        ssize_t bytes = pread(src, buffer, want, offset);
+        if (bytes <= 0) {
+            if (bytes == -1) {
+                perror("pread");
+                status = -1;
+            }
+            break;
+        }
+        if (pwrite(dst, buffer, bytes, offset) != bytes) {
+            perror("pwrite");
+            status = -1;
+            break;
+        }
+        offset += bytes;
+    }
+    free(buffer);
+    return status;
+}
+
+// Копия участка [offset, end); при первом отказе copy_file_range
+// переходит на read/write
+static int copy_extent(int src, int dst, off_t offset, off_t end, ema_reset_t *method) {
+    while (offset < end && *method == EMA_RESET_COPY_RANGE) {
+        loff_t in = offset, out = offset;
+        ssize_t copied = copy_file_range(src, &in, dst, &out, end - offset, 0);
+        if (copied == -1) {
+            if (!unsupported(errno)) {
+                perror("copy_file_range");
+                return -1;
+            }
+            *method = EMA_RESET_RW;
+            break;
+        }
+        if (copied == 0) {
+            return 0;  // Шаблон оказался короче
+        }
+        offset += copied;
+    }
+    return offset < end ? copy_rw(src, dst, offset, end) : 0;
+}
+
+int ema_reset_file(const char *template_path, const char *filename, ema_reset_t *method) {
+    int src = open(template_path, O_RDONLY);
+    if (src == -1) {
+        perror(template_path);
+        return -1;
+    }
+    int dst = open(filename, O_WRONLY | O_CREAT, 0644);
+    if (dst == -1) {
+        perror(filename);
+        close(src);
+        return -1;
+    }
+
+    int status = -1;
+    struct stat st;
+    if (fstat(src, &st) == -1) {
+        perror("fstat");
+        goto out;
+    }
+    if (ioctl(dst, FICLONE, src) == 0) {
+        *method = EMA_RESET_REFLINK;
+        status = 0;
+        goto out;
+    }
+    if (!unsupported(errno)) {
+        perror("ioctl FICLONE");
+        goto out;
+    }
+
+    // Старое содержимое отбрасывается целиком, размер задаётся сразу:
+    // непрочитанные дыры шаблона остаются дырами
+    if (ftruncate(dst, 0) == -1 || ftruncate(dst, st.st_size) == -1) {
+        perror("ftruncate");
+        goto out;
+    }
+    *method = EMA_RESET_COPY_RANGE;
+    off_t position = 0;
+    while (position < st.st_size) {
+        off_t data = lseek(src, position, SEEK_DATA);
+        if (data == -1) {
+            if (errno == ENXIO) {
+                break;  // Дальше только дыра
+            }
+            perror("lseek SEEK_DATA");
+            goto out;
+        }
+        off_t hole = lseek(src, data, SEEK_HOLE);
+        if (hole == -1) {
+            perror("lseek SEEK_HOLE");
+            goto out;
+        }
+        if (copy_extent(src, dst, data, hole, method) == -1) {
+            goto out;
+        }
+        position = hole;
+    }
+    status = 0;
+
+out:
+    if (close(dst) == -1 && status == 0) {
+        perror("close");
+        status = -1;
+    }
+    close(src);
+    return status;
+}
+
+int ema_snapshot_create(const char *filename, char *path, size_t size) {
+    snprintf(path, size, "%s.snapshot", filename);
+    ema_reset_t method;
+    if (ema_reset_file(filename, path, &method) == -1) {
+        unlink(path);
+        return -1;
+    }
+    return 0;
+}
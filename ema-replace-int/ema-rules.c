@@ -0,0 +1,209 @@
+#define _GNU_SOURCE
+#include "ema.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+// Таблица правил old -> new для замены многих значений за один проход.
+//
+// Большинство int в данных не совпадает ни с одним правилом, поэтому
+// перед хэш-таблицей стоит битовая карта по младшим битам значения: не
+// меньше 8 бит на правило, то есть при заполнении 1/8 ложных срабатываний
+// ~12%.
+// Сама таблица - открытая адресация с линейным пробированием и
+// заполнением не выше 1/2.
+
+#define RULES_MIN_TABLE_BITS 4
+#define RULES_MIN_FILTER_BITS 12
+#define RULES_MAX_FILTER_BITS 26
+
+static unsigned ceil_log2(size_t n) {
+    unsigned bits = 0;
+    while (((size_t)1 << bits) < n) {
+        bits++;
+    }
+    return bits;
+}
+
+static inline size_t rule_hash(const ema_rules_t *rules, int key) {
+    return ((uint32_t)key * 0x9E3779B1u) >> (32 - rules->table_bits);
+}
+
+static inline int filter_test(const ema_rules_t *rules, int key) {
+    uint32_t bit = (uint32_t)key & rules->filter_mask;
+    return (rules->filter[bit >> 6] >> (bit & 63)) & 1;
+}
+
+int ema_rules_init(ema_rules_t *rules, size_t capacity) {
+    memset(rules, 0, sizeof(*rules));
+    rules->table_bits = ceil_log2(capacity * 2);
+    if (rules->table_bits < RULES_MIN_TABLE_BITS) {
+        rules->table_bits = RULES_MIN_TABLE_BITS;
+    }
+    unsigned filter_bits = ceil_log2(capacity * 8);
+    if (filter_bits < RULES_MIN_FILTER_BITS) {
+        filter_bits = RULES_MIN_FILTER_BITS;
+    }
+    if (filter_bits > RULES_MAX_FILTER_BITS) {
+        filter_bits = RULES_MAX_FILTER_BITS;
+    }
+    rules->filter_mask = ((uint32_t)1 << filter_bits) - 1;
+
+    size_t slots = (size_t)1 << rules->table_bits;
+    rules->capacity = slots / 2;
+    rules->slots = calloc(slots, sizeof(ema_rule_slot_t));
+    rules->occupied = calloc((slots + 63) / 64, sizeof(uint64_t));
+    rules->filter = calloc(((size_t)1 << filter_bits) / 64, sizeof(uint64_t));
+    if (rules->slots == NULL || rules->occupied == NULL || rules->filter == NULL) {
+        perror("calloc");
+        ema_rules_free(rules);
+        return -1;
+    }
+    return 0;
+}
+
+void ema_rules_free(ema_rules_t *rules) {
+    free(rules->slots);
+    free(rules->occupied);
+    free(rules->filter);
+    memset(rules, 0, sizeof(*rules));
+}
+
+int ema_rules_add(ema_rules_t *rules, int old_value, int new_value) {
+    if (rules->count == rules->capacity) {
+        return -1;
+    }
+    size_t mask = ((size_t)1 << rules->table_bits) - 1;
+    size_t h = rule_hash(rules, old_value);
+    while ((rules->occupied[h >> 6] >> (h & 63)) & 1) {
+        if (rules->slots[h].key == old_value) {
+            return 1;  // Правило для этого значения уже есть
+        }
+        h = (h + 1) & mask;
+    }
+    rules->occupied[h >> 6] |= (uint64_t)1 << (h & 63);
+    rules->slots[h].key = old_value;
+    rules->slots[h].value = new_value;
+    uint32_t bit = (uint32_t)old_value & rules->filter_mask;
+    rules->filter[bit >> 6] |= (uint64_t)1 << (bit & 63);
+    rules->count++;
+    return 0;
+}
+
+// Файл правил: по паре "old new" в строке, '#' - комментарий до конца
+// строки. Правила применяются одновременно: цепочка a->b, b->c за
+// один проход превращает a в b, а не в c.
+int ema_rules_load(const char *path, ema_rules_t *rules) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    int *pairs = NULL;
+    size_t n = 0, allocated = 0;
+    // getline: строка любой длины читается целиком, длинный комментарий
+    // не разрезается на продолжение с мнимым правилом
+    char *line = NULL;
+    size_t len = 0;
+    int line_no = 0;
+    int status = -1;
+    while (getline(&line, &len, f) != -1) {
+        line_no++;
+        char *hash = strchr(line, '#');
+        if (hash != NULL) {
+            *hash = '\0';
+        }
+        char *p = line;
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (*p == '\n' || *p == '\r' || *p == '\0') {
+            continue;
+        }
+
+        char *end;
+        errno = 0;
+        long old_value = strtol(p, &end, 10);
+        char *after_old = end;
+        long new_value = strtol(after_old, &end, 10);
+        while (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n') {
+            end++;
+        }
+        if (after_old == p || end == after_old || *end != '\0' || errno != 0 ||
+            old_value < INT_MIN || old_value > INT_MAX || new_value < INT_MIN || new_value > INT_MAX) {
+            fprintf(stderr, "%s:%d: expected '<old> <new>' integer pair\n", path, line_no);
+            goto out;
+        }
+        if (old_value == new_value) {
+            continue;
+        }
+        if (n == allocated) {
+            allocated = allocated ? allocated * 2 : 1024;
+            int *grown = realloc(pairs, allocated * 2 * sizeof(int));
+            if (grown == NULL) {
+                perror("realloc");
+                goto out;
+            }
+            pairs = grown;
+        }
+        pairs[2 * n] = (int)old_value;
+        pairs[2 * n + 1] = (int)new_value;
+        n++;
+    }
+
+    if (ema_rules_init(rules, n) == -1) {
+        goto out;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (ema_rules_add(rules, pairs[2 * i], pairs[2 * i + 1]) != 0) {
+            fprintf(stderr, "%s: duplicate rule for %d\n", path, pairs[2 * i]);
+            ema_rules_free(rules);
+            goto out;
+        }
+    }
+    status = 0;
+
+out:
+    free(line);
+    free(pairs);
+    fclose(f);
+    return status;
+}
+
+size_t ema_rules_scan(const ema_rules_t *rules, int *data, size_t count) {
+    size_t mask = ((size_t)1 << rules->table_bits) - 1;
+    size_t matches = 0;
+    for (size_t i = 0; i < count; i++) {
+        int v = data[i];
+        if (!filter_test(rules, v)) {
+            continue;
+        }
+        size_t h = rule_hash(rules, v);
+        while ((rules->occupied[h >> 6] >> (h & 63)) & 1) {
+            if (rules->slots[h].key == v) {
+                data[i] = rules->slots[h].value;
+                matches++;
+                break;
+            }
+            h = (h + 1) & mask;
+        }
+    }
+    return matches;
+}
+
+size_t ema_scan_block(const ema_config_t *cfg, ema_scan_fn scan, void *data, size_t count, off_t offset) {
+    size_t matches = (cfg->rules != NULL)
+        ? ema_rules_scan(cfg->rules, (int *)data, count)
+        : scan(data, count, cfg->search_value, cfg->replace_value);
+    if (cfg->index != NULL) {
+        ema_index_record(cfg->index, (const int *)data, count, offset);
+    }
+    if (cfg->zonemap != NULL) {
+        ema_zonemap_record(cfg->zonemap, (const int *)data, count, offset);
+    }
+    return matches;
+}
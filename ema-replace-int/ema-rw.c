@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+#include "ema.h"
+#include "instrument.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define RW_MAX_DIRTY_RANGES 256
+
+// Поиск и замена в байтах [start, end) уже открытого файла; end < 0 -
+// до конца файла. Блоки читаются pread() по явному смещению, а грязные
+// участки блока (cfg->dirty) пишутся обратно по pwrite() на участок -
+// без lseek до и после записи.
+// С O_DIRECT длины запросов выровнены (ema_io_length), а короткое
+// чтение означает конец файла. С cfg->skip_holes читаются только участки
+// данных, дыры перескакиваются по SEEK_DATA; с годной картой зон так же
+// перескакиваются зоны, которые не могут содержать search_value.
+int ema_rw_range(int fd, off_t start, off_t end, int *buffer, const ema_config_t *cfg, ema_stats_t *stats) {
+    size_t block_size = cfg->block_size ? cfg->block_size : BUFFER_SIZE;
+    size_t elem = ema_type_size(cfg->type);
+    ema_scan_fn scan = ema_kernel_fn(cfg->kernel, cfg->type, cfg->swap);
+    off_t position = start;
+    ema_range_t ranges[RW_MAX_DIRTY_RANGES];
+    ema_sync_window_t window = { start, start };
+    int skip_holes = cfg->skip_holes && ema_holes_skippable(cfg);
+    off_t data_end = position;  // skip_holes: конец текущего участка данных
+    const ema_zonemap_t *zones = ema_zonemap_prunes(cfg) ? cfg->zonemap : NULL;
+    off_t zone_end = position;  // zones: конец текущей серии зон-кандидатов
+    
+    while (end < 0 || position < end) {
+        if (skip_holes && position >= data_end) {
+            off_t data_start;
+            if (ema_next_data(fd, position, cfg, &data_start, &data_end, stats) == -1) {
+                return -1;
+            }
+            if (end >= 0 && data_start > end) {
+                data_start = end;
+            }
+            stats->bytes_skipped += data_start - position;
+            position = data_start;
+            if ((end >= 0 && position >= end) || position >= data_end) {
+                break;  // Дальше только дыра
+            }
+        }
+        if (zones != NULL && position >= zone_end) {
+            off_t zone_start = ema_zonemap_next(zones, cfg->search_value, position, &zone_end);
+            if (end >= 0 && zone_start > end) {
+                zone_start = end;
+            }
+            stats->bytes_pruned += zone_start - position;
+            position = zone_start;
+            if ((end >= 0 && position >= end) || position >= zone_end) {
+                break;  // Дальше нет зон с search_value
+            }
+        }
+
+        size_t want = block_size;
+        if (end >= 0 && (off_t)want > end - position) {
+            want = end - position;
+        }
+        if (skip_holes && (off_t)want > data_end - position) {
+            want = data_end - position;
+        }
+        if (zones != NULL && (off_t)want > zone_end - position) {
+            want = zone_end - position;
+        }
+
+        // Читаем блок данных
+        unsigned long long op_start = cfg->latency ? get_time_ns() : 0;
+        ssize_t bytes = pread(fd, buffer, ema_io_length(want, cfg), position);
+        ema_latency_record(cfg->latency, EMA_OP_READ, op_start);
+        stats->read_calls++;
+        if (bytes == -1) {
+            perror("pread");
+            return -1;
+        }
+        
+        if (bytes == 0) {
+            break;  // Конец файла
+        }
+        
+        size_t num_elems = bytes / elem;
+        // Короткое чтение может оборвать элемент: его хвост перечитаем со
+        // следующим блоком. Хвост файла короче элемента просто пропускается.
+        ssize_t consumed = num_elems > 0 ? (ssize_t)(num_elems * elem) : bytes;
+        stats->bytes_read += consumed;
+        
+        // Ищем и заменяем значения
+        size_t n_ranges;
+        size_t found_in_block = ema_scan_dirty(cfg, scan, buffer, consumed, position,
+                                               ranges, RW_MAX_DIRTY_RANGES, &n_ranges);
+        stats->matches += found_in_block;
+        
+        // Записываем обратно изменённые участки
+        for (size_t r = 0; r < n_ranges; r++) {
+            size_t size = ranges[r].end - ranges[r].begin;
+            ssize_t length = ema_io_length(size, cfg);
+            op_start = cfg->latency || cfg->sync != EMA_SYNC_NONE ? get_time_ns() : 0;
+            ssize_t written = pwrite(fd, (char *)buffer + ranges[r].begin, length,
+                                     position + ranges[r].begin);
+            if (cfg->sync != EMA_SYNC_NONE) {
+                stats->write_ns += get_time_ns() - op_start;
+            }
+            ema_latency_record(cfg->latency, EMA_OP_WRITE, op_start);
+            stats->write_calls++;
+            if (written == -1) {
+                perror("pwrite");
+                return -1;
+            }
+            
+            if (written != length) {
+                fprintf(stderr, "Error: incomplete write\n");
+                return -1;
+            }
+            stats->bytes_written += size;
+            if (ema_sync_written(fd, position + ranges[r].begin, size, cfg, &window, stats) == -1) {
+                return -1;
+            }
+
+            // Дополненный хвост O_DIRECT удлинил файл - обрезаем обратно
+            if (length != (ssize_t)size) {
+                stats->other_calls++;
+                if (ftruncate(fd, position + bytes) == -1) {
+                    perror("ftruncate");
+                    return -1;
+                }
+            }
+        }
+        
+        position += consumed;
+        if (cfg->direct && (size_t)bytes < ema_io_length(want, cfg)) {
+            break;  // Хвост файла: следующее смещение уже не выровнено
+        }
+    }
+    
+    return 0;
+}
+
+// Поиск и замена значения в файле
+int replace_in_file(const char *filename, const ema_config_t *cfg, ema_stats_t *stats) {
+    int fd = ema_open_data(filename, cfg, stats);
+    if (fd == -1) {
+        return -1;
+    }
+    
+    int *buffer = ema_alloc_block(cfg->block_size ? cfg->block_size : BUFFER_SIZE);
+    if (buffer == NULL) {
+        close(fd);
+        return -1;
+    }
+    
+    int status = ema_rw_range(fd, 0, -1, buffer, cfg, stats);
+    
+    free(buffer);
+    close(fd);
+    stats->other_calls++;
+    return status;
+}
@@ -0,0 +1,64 @@
+#define _GNU_SOURCE
+#include "ema.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+// Пропуск дыр разреженного файла. Дыра читается как нули и ФС знает
+// её границы (lseek SEEK_DATA/SEEK_HOLE), поэтому читать её незачем,
+// если ноль ничего не заменяет. ФС без поддержки дыр отвечают, что весь
+// файл - данные, и проход идёт как обычно.
+
+// Можно ли пропускать дыры: нулевой элемент не совпадает ни с искомым
+// значением, ни с правилом и не попадает в индекс. Проверяется тем же
+// ядром, что и сканирует, поэтому для f32/f64 -0 тоже считается нулём.
+int ema_holes_skippable(const ema_config_t *cfg) {
+    uint64_t zero = 0;
+    if (cfg->index != NULL && ema_index_find(cfg->index, 0) >= 0) {
+        return 0;
+    }
+    if (cfg->rules != NULL) {
+        return ema_rules_scan(cfg->rules, (int *)&zero, 1) == 0;
+    }
+    ema_scan_fn scan = ema_kernel_fn(cfg->kernel, cfg->type, cfg->swap);
+    return scan(&zero, 1, cfg->search_value, cfg->replace_value) == 0;
+}
+
+// Участок данных [*data_start, *data_end), начинающийся не раньше
+// position. Если дальше только дыра, оба равны размеру файла. С O_DIRECT
+// границы расширяются до DIRECT_ALIGN: ФС с мелким блоком может начать
+// данные с невыровненного смещения.
+int ema_next_data(int fd, off_t position, const ema_config_t *cfg, off_t *data_start, off_t *data_end,
+                  ema_stats_t *stats) {
+    stats->other_calls++;
+    off_t data = lseek(fd, position, SEEK_DATA);
+    if (data == -1) {
+        if (errno != ENXIO) {
+            perror("lseek SEEK_DATA");
+            return -1;
+        }
+        stats->other_calls++;
+        data = lseek(fd, 0, SEEK_END);
+        if (data == -1) {
+            perror("lseek SEEK_END");
+            return -1;
+        }
+        *data_start = *data_end = data > position ? data : position;
+        return 0;
+    }
+    stats->other_calls++;
+    off_t hole = lseek(fd, data, SEEK_HOLE);
+    if (hole == -1) {
+        perror("lseek SEEK_HOLE");
+        return -1;
+    }
+    if (cfg->direct) {
+        data = data / DIRECT_ALIGN * DIRECT_ALIGN;
+        hole = (hole + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+    }
+    *data_start = data > position ? data : position;
+    *data_end = hole;
+    return 0;
+}
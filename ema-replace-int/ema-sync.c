@@ -0,0 +1,96 @@
+#define _GNU_SOURCE
+#include "ema.h"
+#include "instrument.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Политики долговечности записанных замен:
+//   end       - один fdatasync после прохода: всё записанное за проход
+//               ждёт диска разом;
+//   per-block - файл открыт с O_DSYNC, каждая запись возвращается только
+//               после попадания на диск, поэтому её время - это и время
+//               синхронизации (отдельно не отделить);
+//   range     - после каждой записи sync_file_range(WRITE) запускает
+//               обратную запись участка, а участки, отставшие от последней
+//               записи больше чем на окно, дожидаются диска. Грязных
+//               страниц в памяти остаётся не больше окна, и финальный
+//               fdatasync (метаданные и кэш устройства) почти ничего не ждёт.
+
+static const char *sync_names[EMA_SYNC_COUNT] = {
+    [EMA_SYNC_NONE] = "none",
+    [EMA_SYNC_END] = "end",
+    [EMA_SYNC_PER_BLOCK] = "per-block",
+    [EMA_SYNC_RANGE] = "range",
+};
+
+const char *ema_sync_name(ema_sync_t sync) {
+    return sync < EMA_SYNC_COUNT ? sync_names[sync] : "?";
+}
+
+int ema_sync_parse(const char *name, ema_sync_t *sync) {
+    for (int i = 0; i < EMA_SYNC_COUNT; i++) {
+        if (strcmp(name, sync_names[i]) == 0) {
+            *sync = (ema_sync_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int ema_sync_open_flags(const ema_config_t *cfg) {
+    return cfg->sync == EMA_SYNC_PER_BLOCK ? O_DSYNC : 0;
+}
+
+// fdatasync сбрасывает грязные страницы файла через любой его
+// дескриптор, поэтому годится после любого движка, включая mmap
+int ema_sync_pass_end(const char *filename, const ema_config_t *cfg, ema_stats_t *stats) {
+    if (cfg->sync != EMA_SYNC_END && cfg->sync != EMA_SYNC_RANGE) {
+        return 0;
+    }
+    int fd = open(filename, O_RDONLY);
+    stats->other_calls++;
+    if (fd == -1) {
+        perror("open");
+        return -1;
+    }
+    unsigned long long start = get_time_ns();
+    int status = fdatasync(fd);
+    stats->sync_ns += get_time_ns() - start;
+    stats->other_calls += 2;
+    if (status == -1) {
+        perror("fdatasync");
+    }
+    close(fd);
+    return status;
+}
+
+int ema_sync_written(int fd, off_t offset, size_t len, const ema_config_t *cfg,
+                     ema_sync_window_t *window, ema_stats_t *stats) {
+    if (cfg->sync != EMA_SYNC_RANGE) {
+        return 0;
+    }
+    unsigned long long start = get_time_ns();
+    stats->other_calls++;
+    if (sync_file_range(fd, offset, len, SYNC_FILE_RANGE_WRITE) == -1) {
+        perror("sync_file_range");
+        return -1;
+    }
+    if (window->written < offset + (off_t)len) {
+        window->written = offset + (off_t)len;
+    }
+    off_t limit = window->written - (off_t)cfg->sync_window;
+    if (limit > window->waited) {
+        stats->other_calls++;
+        if (sync_file_range(fd, window->waited, limit - window->waited,
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER) == -1) {
+            perror("sync_file_range");
+            return -1;
+        }
+        window->waited = limit;
+    }
+    stats->sync_ns += get_time_ns() - start;
+    return 0;
+}
@@ -0,0 +1,148 @@
+#define _GNU_SOURCE
+#include "ema.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+// Типы элементов файла, порядок байтов и разбор значений по типу
+
+static const struct {
+    const char *name;
+    size_t size;
+    int is_signed;
+    int is_float;
+} types[EMA_TYPE_COUNT] = {
+    [EMA_TYPE_I8]  = { "i8", 1, 1, 0 },
+    [EMA_TYPE_I16] = { "i16", 2, 1, 0 },
+    [EMA_TYPE_I32] = { "i32", 4, 1, 0 },
+    [EMA_TYPE_I64] = { "i64", 8, 1, 0 },
+    [EMA_TYPE_U8]  = { "u8", 1, 0, 0 },
+    [EMA_TYPE_U16] = { "u16", 2, 0, 0 },
+    [EMA_TYPE_U32] = { "u32", 4, 0, 0 },
+    [EMA_TYPE_U64] = { "u64", 8, 0, 0 },
+    [EMA_TYPE_F32] = { "f32", 4, 1, 1 },
+    [EMA_TYPE_F64] = { "f64", 8, 1, 1 },
+};
+
+static const char *endian_names[EMA_ENDIAN_COUNT] = {
+    [EMA_ENDIAN_NATIVE] = "native",
+    [EMA_ENDIAN_LITTLE] = "little",
+    [EMA_ENDIAN_BIG] = "big",
+};
+
+const char *ema_type_name(ema_type_t type) {
+    return type < EMA_TYPE_COUNT ? types[type].name : "?";
+}
+
+int ema_type_parse(const char *name, ema_type_t *type) {
+    for (int i = 0; i < EMA_TYPE_COUNT; i++) {
+        if (strcmp(name, types[i].name) == 0) {
+            *type = (ema_type_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+size_t ema_type_size(ema_type_t type) {
+    return type < EMA_TYPE_COUNT ? types[type].size : sizeof(int);
+}
+
+const char *ema_endian_name(ema_endian_t endian) {
+    return endian < EMA_ENDIAN_COUNT ? endian_names[endian] : "?";
+}
+
+int ema_endian_parse(const char *name, ema_endian_t *endian) {
+    for (int i = 0; i < EMA_ENDIAN_COUNT; i++) {
+        if (strcmp(name, endian_names[i]) == 0) {
+            *endian = (ema_endian_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int ema_endian_swap(ema_endian_t endian) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return endian == EMA_ENDIAN_LITTLE;
+#else
+    return endian == EMA_ENDIAN_BIG;
+#endif
+}
+
+// Разбор десятичного (или 0x...) значения с проверкой диапазона типа
+int ema_value_parse(const char *str, ema_type_t type, ema_value_t *value) {
+    char *end;
+    errno = 0;
+    if (types[type].is_float) {
+        double d = strtod(str, &end);
+        if (*str == '\0' || *end != '\0' || errno == ERANGE) {
+            return -1;
+        }
+        if (type == EMA_TYPE_F32) {
+            float f = (float)d;
+            uint32_t bits;
+            memcpy(&bits, &f, sizeof(bits));
+            *value = bits;
+        } else {
+            memcpy(value, &d, sizeof(*value));
+        }
+        return 0;
+    }
+
+    unsigned bits = types[type].size * 8;
+    if (types[type].is_signed) {
+        long long v = strtoll(str, &end, 0);
+        if (*str == '\0' || *end != '\0' || errno == ERANGE) {
+            return -1;
+        }
+        if (bits < 64 && (v < -(1LL << (bits - 1)) || v > (1LL << (bits - 1)) - 1)) {
+            return -1;
+        }
+        *value = (ema_value_t)v & (bits < 64 ? (1ULL << bits) - 1 : ~0ULL);
+        return 0;
+    }
+    if (*str == '-') {
+        return -1;
+    }
+    unsigned long long v = strtoull(str, &end, 0);
+    if (*str == '\0' || *end != '\0' || errno == ERANGE || (bits < 64 && v >> bits != 0)) {
+        return -1;
+    }
+    *value = v;
+    return 0;
+}
+
+void ema_value_format(ema_value_t value, ema_type_t type, char *buf, size_t size) {
+    unsigned bits = ema_type_size(type) * 8;
+    switch (type) {
+        case EMA_TYPE_F32: {
+            uint32_t raw = (uint32_t)value;
+            float f;
+            memcpy(&f, &raw, sizeof(f));
+            snprintf(buf, size, "%.9g", f);
+            return;
+        }
+        case EMA_TYPE_F64: {
+            double d;
+            memcpy(&d, &value, sizeof(d));
+            snprintf(buf, size, "%.17g", d);
+            return;
+        }
+        case EMA_TYPE_I8:
+        case EMA_TYPE_I16:
+        case EMA_TYPE_I32:
+        case EMA_TYPE_I64: {
+            // Расширение знака из младших bits бит
+            int64_t v = bits < 64 ? (int64_t)(value << (64 - bits)) >> (64 - bits) : (int64_t)value;
+            snprintf(buf, size, "%" PRId64, v);
+            return;
+        }
+        default:
+            snprintf(buf, size, "%" PRIu64, value);
+            return;
+    }
+}
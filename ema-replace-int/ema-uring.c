@@ -0,0 +1,461 @@
+#define _GNU_SOURCE
+#include "ema.h"
+#include "instrument.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+// Асинхронный движок на io_uring без liburing: кольца отображаются и
+// обслуживаются вручную через io_uring_setup/enter/register.
+//
+// В полёте держится до qd чтений в зарегистрированные буферы; готовые
+// блоки сканируются по мере завершения, а грязные сразу уходят на
+// асинхронную запись из того же буфера. Файл тоже зарегистрирован
+// (IOSQE_FIXED_FILE), чтобы ядро не брало ссылку на него на каждую операцию.
+// С O_DIRECT запросы дополняются до DIRECT_ALIGN, как в read/write движке.
+// Из грязного блока пишутся только изменённые участки (cfg->dirty), каждый
+// отдельной записью; user_data несёт номер слота и номер участка.
+// При --sync range завершившаяся запись сразу отдаётся окну sync_file_range.
+
+#define URING_DEFAULT_QD 16
+#define URING_WRITES_PER_SLOT 32  // грязных участков блока, пишущихся раздельно
+
+typedef struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+    unsigned to_submit;
+} uring_t;
+
+// Состояние буфера-слота
+enum { SLOT_FREE, SLOT_READING, SLOT_WRITING };
+
+typedef struct {
+    int state;
+    off_t offset;       // смещение блока в файле
+    size_t len;         // ожидаемая длина блока
+    size_t filled;      // прочитано (короткие чтения дочитываются)
+    char *buf;
+    ema_range_t ranges[URING_WRITES_PER_SLOT];
+    unsigned pending;   // незавершённых записей участков
+    unsigned long long issued_ns;  // cfg->latency: постановка текущих запросов в очередь
+} uring_slot_t;
+
+static int uring_setup(uring_t *ring, unsigned entries, ema_stats_t *stats) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+    stats->other_calls++;
+    if (ring->fd < 0) {
+        perror("io_uring_setup");
+        return -1;
+    }
+
+    ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_len > ring->sq_len) {
+            ring->sq_len = ring->cq_len;
+        }
+        ring->cq_len = ring->sq_len;
+    }
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        perror("mmap sq ring");
+        close(ring->fd);
+        return -1;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            perror("mmap cq ring");
+            munmap(ring->sq_ptr, ring->sq_len);
+            close(ring->fd);
+            return -1;
+        }
+    }
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        perror("mmap sqes");
+        if (ring->cq_ptr != ring->sq_ptr) {
+            munmap(ring->cq_ptr, ring->cq_len);
+        }
+        munmap(ring->sq_ptr, ring->sq_len);
+        close(ring->fd);
+        return -1;
+    }
+    stats->other_calls += (ring->cq_ptr != ring->sq_ptr) ? 3 : 2;
+
+    char *sq = ring->sq_ptr;
+    char *cq = ring->cq_ptr;
+    ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+static void uring_teardown(uring_t *ring) {
+    munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_len);
+    }
+    munmap(ring->sq_ptr, ring->sq_len);
+    close(ring->fd);
+}
+
+// Следующий свободный SQE. Кольцо создаётся на qd * URING_WRITES_PER_SLOT
+// записей, а в полёте не бывает больше операций, поэтому место есть всегда.
+static struct io_uring_sqe *uring_get_sqe(uring_t *ring) {
+    unsigned tail = *ring->sq_tail + ring->to_submit;
+    unsigned idx = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+    ring->sq_array[idx] = idx;
+    ring->to_submit++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// Публикует накопленные SQE и ждёт хотя бы wait завершений
+static int uring_submit_and_wait(uring_t *ring, unsigned wait, ema_stats_t *stats) {
+    unsigned submit = ring->to_submit;
+    if (submit > 0) {
+        __atomic_store_n(ring->sq_tail, *ring->sq_tail + submit, __ATOMIC_RELEASE);
+        ring->to_submit = 0;
+    }
+    while (1) {
+        int ret = syscall(__NR_io_uring_enter, ring->fd, submit, wait,
+                          wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        stats->other_calls++;
+        if (ret >= 0) {
+            return 0;
+        }
+        if (errno != EINTR) {
+            perror("io_uring_enter");
+            return -1;
+        }
+        submit = 0;
+    }
+}
+
+static struct io_uring_sqe *prep_fixed(uring_t *ring, int op, unsigned slot_idx) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    sqe->opcode = op;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = 0;  // индекс в таблице зарегистрированных файлов
+    sqe->buf_index = slot_idx;
+    sqe->user_data = slot_idx;
+    return sqe;
+}
+
+static void prep_read(uring_t *ring, uring_slot_t *slot, unsigned slot_idx, const ema_config_t *cfg) {
+    struct io_uring_sqe *sqe = prep_fixed(ring, IORING_OP_READ_FIXED, slot_idx);
+    sqe->addr = (unsigned long)(slot->buf + slot->filled);
+    sqe->len = ema_io_length(slot->len - slot->filled, cfg);
+    sqe->off = slot->offset + slot->filled;
+}
+
+static void prep_write(uring_t *ring, uring_slot_t *slot, unsigned slot_idx, unsigned range,
+                       const ema_config_t *cfg) {
+    struct io_uring_sqe *sqe = prep_fixed(ring, IORING_OP_WRITE_FIXED, slot_idx);
+    sqe->addr = (unsigned long)(slot->buf + slot->ranges[range].begin);
+    sqe->len = ema_io_length(slot->ranges[range].end - slot->ranges[range].begin, cfg);
+    sqe->off = slot->offset + slot->ranges[range].begin;
+    sqe->user_data |= (unsigned long long)range << 32;
+}
+
+// Кольцо со слотами и зарегистрированными буферами не зависит от файла:
+// его можно создать один раз и прогнать через него много файлов,
+// подменяя зарегистрированный файл (пакетный режим)
+struct ema_uring {
+    uring_t ring;
+    unsigned qd;
+    size_t block_size;
+    uring_slot_t *slots;
+    struct iovec *iov;
+    char *arena;
+    int file_registered;
+};
+
+ema_uring_t *ema_uring_create(const ema_config_t *cfg, ema_stats_t *stats) {
+    ema_uring_t *u = calloc(1, sizeof(*u));
+    if (u == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+    u->qd = cfg->queue_depth > 0 ? (unsigned)cfg->queue_depth : URING_DEFAULT_QD;
+    u->block_size = cfg->block_size ? cfg->block_size : BUFFER_SIZE;
+
+    // На каждый слот в полёте может быть до URING_WRITES_PER_SLOT записей
+    if (uring_setup(&u->ring, u->qd * URING_WRITES_PER_SLOT, stats) == -1) {
+        free(u);
+        return NULL;
+    }
+
+    u->slots = calloc(u->qd, sizeof(uring_slot_t));
+    u->iov = calloc(u->qd, sizeof(struct iovec));
+    u->arena = ema_alloc_block(u->block_size * u->qd);
+    if (u->slots == NULL || u->iov == NULL || u->arena == NULL) {
+        perror("malloc");
+        ema_uring_destroy(u, stats);
+        return NULL;
+    }
+    for (unsigned i = 0; i < u->qd; i++) {
+        u->slots[i].buf = u->arena + i * u->block_size;
+        u->iov[i].iov_base = u->slots[i].buf;
+        u->iov[i].iov_len = u->block_size;
+    }
+
+    // Регистрация буферов: ядро один раз закрепляет страницы
+    stats->other_calls++;
+    if (syscall(__NR_io_uring_register, u->ring.fd, IORING_REGISTER_BUFFERS, u->iov, u->qd) < 0) {
+        perror("io_uring_register buffers");
+        ema_uring_destroy(u, stats);
+        return NULL;
+    }
+    return u;
+}
+
+void ema_uring_destroy(ema_uring_t *u, ema_stats_t *stats) {
+    if (u == NULL) {
+        return;
+    }
+    free(u->arena);
+    free(u->iov);
+    free(u->slots);
+    uring_teardown(&u->ring);
+    stats->other_calls++;
+    free(u);
+}
+
+// Первый файл регистрируется, следующие подменяют его в той же ячейке
+// таблицы (IORING_REGISTER_FILES_UPDATE) - кольцо и буферы остаются
+int ema_uring_attach(ema_uring_t *u, int fd, ema_stats_t *stats) {
+    stats->other_calls++;
+    if (!u->file_registered) {
+        if (syscall(__NR_io_uring_register, u->ring.fd, IORING_REGISTER_FILES, &fd, 1) < 0) {
+            perror("io_uring_register files");
+            return -1;
+        }
+        u->file_registered = 1;
+        return 0;
+    }
+    struct io_uring_files_update update;
+    memset(&update, 0, sizeof(update));
+    update.fds = (unsigned long)&fd;
+    if (syscall(__NR_io_uring_register, u->ring.fd, IORING_REGISTER_FILES_UPDATE, &update, 1) < 0) {
+        perror("io_uring_register files update");
+        return -1;
+    }
+    return 0;
+}
+
+// Поиск и замена в байтах [start, end) файла fd, подключённого к кольцу
+int ema_uring_run(ema_uring_t *u, int fd, off_t start, off_t end, const ema_config_t *cfg, ema_stats_t *stats) {
+    ema_scan_fn scan = ema_kernel_fn(cfg->kernel, cfg->type, cfg->swap);
+    int padded_tail = 0;
+    ema_sync_window_t window = { start, start };
+    for (unsigned i = 0; i < u->qd; i++) {
+        u->slots[i].state = SLOT_FREE;
+    }
+
+    int skip_holes = cfg->skip_holes && ema_holes_skippable(cfg);
+    off_t data_end = start;     // skip_holes: конец текущего участка данных
+    const ema_zonemap_t *zones = ema_zonemap_prunes(cfg) ? cfg->zonemap : NULL;
+    off_t zone_end = start;     // zones: конец текущей серии зон-кандидатов
+
+    off_t next = start;
+    unsigned inflight = 0;
+    while (next < end || inflight > 0) {
+        // Заполняем очередь чтениями до глубины qd; дыры и отсечённые
+        // картой зоны перескакиваем
+        for (unsigned i = 0; i < u->qd && next < end; i++) {
+            if (u->slots[i].state != SLOT_FREE) {
+                continue;
+            }
+            if (skip_holes && next >= data_end) {
+                off_t data_start;
+                if (ema_next_data(fd, next, cfg, &data_start, &data_end, stats) == -1) {
+                    return -1;
+                }
+                if (data_start > end) {
+                    data_start = end;
+                }
+                stats->bytes_skipped += data_start - next;
+                next = data_start;
+                if (next >= end || next >= data_end) {
+                    next = end;  // Дальше только дыра
+                    break;
+                }
+            }
+            if (zones != NULL && next >= zone_end) {
+                off_t zone_start = ema_zonemap_next(zones, cfg->search_value, next, &zone_end);
+                if (zone_start > end) {
+                    zone_start = end;
+                }
+                stats->bytes_pruned += zone_start - next;
+                next = zone_start;
+                if (next >= end || next >= zone_end) {
+                    next = end;  // Дальше нет зон с search_value
+                    break;
+                }
+            }
+            u->slots[i].state = SLOT_READING;
+            u->slots[i].offset = next;
+            u->slots[i].len = (off_t)u->block_size < end - next ? u->block_size : (size_t)(end - next);
+            if (skip_holes && (off_t)u->slots[i].len > data_end - next) {
+                u->slots[i].len = data_end - next;
+            }
+            if (zones != NULL && (off_t)u->slots[i].len > zone_end - next) {
+                u->slots[i].len = zone_end - next;
+            }
+            u->slots[i].filled = 0;
+            u->slots[i].issued_ns = cfg->latency ? get_time_ns() : 0;
+            prep_read(&u->ring, &u->slots[i], i, cfg);
+            next += u->slots[i].len;
+            inflight++;
+        }
+        if (inflight == 0) {
+            break;  // Остаток диапазона оказался дырой или отсечён
+        }
+
+        if (uring_submit_and_wait(&u->ring, 1, stats) == -1) {
+            return -1;
+        }
+
+        // Разбираем все готовые завершения
+        unsigned head = *u->ring.cq_head;
+        unsigned tail = __atomic_load_n(u->ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &u->ring.cqes[head & *u->ring.cq_mask];
+            unsigned idx = (unsigned)(cqe->user_data & 0xffffffffu);
+            unsigned range = (unsigned)(cqe->user_data >> 32);
+            uring_slot_t *slot = &u->slots[idx];
+            int res = cqe->res;
+
+            if (res < 0) {
+                fprintf(stderr, "io_uring %s: %s\n",
+                        slot->state == SLOT_READING ? "read" : "write", strerror(-res));
+                __atomic_store_n(u->ring.cq_head, head + 1, __ATOMIC_RELEASE);
+                return -1;
+            }
+
+            if (slot->state == SLOT_WRITING) {
+                size_t size = slot->ranges[range].end - slot->ranges[range].begin;
+                if ((size_t)res != ema_io_length(size, cfg)) {
+                    fprintf(stderr, "Error: incomplete write\n");
+                    __atomic_store_n(u->ring.cq_head, head + 1, __ATOMIC_RELEASE);
+                    return -1;
+                }
+                stats->bytes_written += size;
+                ema_latency_record(cfg->latency, EMA_OP_WRITE, slot->issued_ns);
+                if (ema_sync_written(fd, slot->offset + slot->ranges[range].begin, size, cfg,
+                                     &window, stats) == -1) {
+                    __atomic_store_n(u->ring.cq_head, head + 1, __ATOMIC_RELEASE);
+                    return -1;
+                }
+                padded_tail |= (size_t)res != size;
+                if (--slot->pending == 0) {
+                    slot->state = SLOT_FREE;
+                    inflight--;
+                }
+                continue;
+            }
+
+            // Завершилось чтение: короткое дочитываем, на EOF обрезаем блок.
+            // Задержка чтения - от постановки до разбора завершения.
+            ema_latency_record(cfg->latency, EMA_OP_READ, slot->issued_ns);
+            slot->filled += res;
+            slot->issued_ns = cfg->latency ? get_time_ns() : 0;
+            if (res > 0 && slot->filled < slot->len) {
+                prep_read(&u->ring, slot, idx, cfg);
+                continue;
+            }
+            slot->len = slot->filled;
+            stats->bytes_read += slot->len;
+
+            size_t n_ranges;
+            size_t found = ema_scan_dirty(cfg, scan, (int *)slot->buf, slot->len, slot->offset,
+                                          slot->ranges, URING_WRITES_PER_SLOT, &n_ranges);
+            stats->matches += found;
+            if (n_ranges > 0) {
+                // Записи грязных участков уходят асинхронно из того же буфера
+                slot->state = SLOT_WRITING;
+                slot->pending = n_ranges;
+                slot->issued_ns = cfg->latency ? get_time_ns() : 0;
+                for (unsigned r = 0; r < n_ranges; r++) {
+                    prep_write(&u->ring, slot, idx, r, cfg);
+                }
+            } else {
+                slot->state = SLOT_FREE;
+                inflight--;
+            }
+        }
+        __atomic_store_n(u->ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+    // Дополненный хвост O_DIRECT удлинил файл - обрезаем обратно
+    if (padded_tail) {
+        stats->other_calls++;
+        if (ftruncate(fd, end) == -1) {
+            perror("ftruncate");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Поиск и замена в байтах [start, end) файла через собственное кольцо
+int ema_uring_range(int fd, off_t start, off_t end, const ema_config_t *cfg, ema_stats_t *stats) {
+    ema_uring_t *u = ema_uring_create(cfg, stats);
+    if (u == NULL) {
+        return -1;
+    }
+    int status = ema_uring_attach(u, fd, stats);
+    if (status == 0) {
+        status = ema_uring_run(u, fd, start, end, cfg, stats);
+    }
+    ema_uring_destroy(u, stats);
+    return status;
+}
+
+int replace_in_file_uring(const char *filename, const ema_config_t *cfg, ema_stats_t *stats) {
+    int fd = ema_open_data(filename, cfg, stats);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat st;
+    stats->other_calls++;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        close(fd);
+        return -1;
+    }
+    int status = ema_uring_range(fd, 0, st.st_size, cfg, stats);
+    close(fd);
+    stats->other_calls++;
+    return status;
+}
@@ -0,0 +1,289 @@
+#define _GNU_SOURCE
+#include "ema.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Карта зон, хранимая рядом с файлом (<file>.zmap): лёгкая замена индекса
+// смещений для повторных поисков по мало меняющемуся файлу.
+//
+// Файл делится на зоны по zone_size байт. Сводка зоны - min/max её int'ов
+// и битовая карта по младшим log2(EMA_ZONE_FILTER_BITS) битам значений:
+// для значений из узкого диапазона (zipf, few) она точна, для широкого
+// работает как фильтр Блума с одной хэш-функцией. Зону, сводка которой
+// исключает search_value, проход не читает вовсе.
+//
+// Сводки собирает любой полный проход по состоянию после замены. Проход
+// с отсечением пересобирает прочитанные зоны, а у пропущенных оставляет
+// прежние сводки: в них ничего не менялось. Карта действительна, пока
+// размер и mtime файла совпадают с сохранёнными.
+//
+// Формат: заголовок ema_zonemap_header_t, затем n_zones сводок ema_zone_t.
+
+#define ZONEMAP_MAGIC "EMAZMP1"
+
+typedef struct {
+    char magic[8];
+    uint64_t file_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t zone_size;
+    uint64_t n_zones;
+} ema_zonemap_header_t;
+
+static const ema_zone_t empty_zone = { .min = INT32_MAX, .max = INT32_MIN };
+
+void ema_zonemap_init(ema_zonemap_t *zm, size_t zone_size) {
+    memset(zm, 0, sizeof(*zm));
+    zm->zone_size = zone_size;
+}
+
+void ema_zonemap_free(ema_zonemap_t *zm) {
+    free(zm->zones);
+    free(zm->next);
+    memset(zm, 0, sizeof(*zm));
+}
+
+static int zonemap_resize(ema_zonemap_t *zm, unsigned long long file_size) {
+    size_t n_zones = (file_size + zm->zone_size - 1) / zm->zone_size;
+    if (zm->zones != NULL && n_zones == zm->n_zones) {
+        return 0;
+    }
+    free(zm->zones);
+    free(zm->next);
+    zm->n_zones = n_zones;
+    zm->zones = malloc((n_zones ? n_zones : 1) * sizeof(ema_zone_t));
+    zm->next = malloc((n_zones ? n_zones : 1) * sizeof(ema_zone_t));
+    if (zm->zones == NULL || zm->next == NULL) {
+        perror("malloc");
+        free(zm->zones);
+        free(zm->next);
+        zm->zones = zm->next = NULL;
+        zm->n_zones = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// Карта соответствует файлу, если не изменились размер и mtime
+static int zonemap_current(const ema_zonemap_t *zm, const struct stat *st) {
+    return zm->valid && (off_t)zm->file_size == st->st_size && zm->mtime_sec == st->st_mtim.tv_sec &&
+           zm->mtime_nsec == st->st_mtim.tv_nsec;
+}
+
+int ema_zonemap_begin(ema_zonemap_t *zm, const char *filename) {
+    struct stat st;
+    if (stat(filename, &st) == -1) {
+        perror("stat");
+        return -1;
+    }
+    if (!zonemap_current(zm, &st)) {
+        zm->valid = 0;
+    }
+    if (zonemap_resize(zm, st.st_size) == -1) {
+        zm->valid = 0;
+        return -1;
+    }
+    zm->file_size = st.st_size;
+    for (size_t z = 0; z < zm->n_zones; z++) {
+        zm->next[z] = empty_zone;
+    }
+    return 0;
+}
+
+static inline int zone_may_contain(const ema_zone_t *zone, int32_t value) {
+    uint32_t bit = (uint32_t)value & (EMA_ZONE_FILTER_BITS - 1);
+    return value >= zone->min && value <= zone->max && ((zone->filter[bit >> 6] >> (bit & 63)) & 1);
+}
+
+int ema_zonemap_prunes(const ema_config_t *cfg) {
+    return cfg->zonemap != NULL && cfg->zonemap->valid && cfg->rules == NULL;
+}
+
+off_t ema_zonemap_next(const ema_zonemap_t *zm, ema_value_t value, off_t position, off_t *run_end) {
+    int32_t v = (int32_t)value;
+    size_t z = position / zm->zone_size;
+    while (z < zm->n_zones && !zone_may_contain(&zm->zones[z], v)) {
+        z++;
+    }
+    if (z >= zm->n_zones) {
+        *run_end = zm->file_size;
+        return (off_t)zm->file_size > position ? (off_t)zm->file_size : position;
+    }
+    off_t start = (off_t)(z * zm->zone_size);
+    while (z < zm->n_zones && zone_may_contain(&zm->zones[z], v)) {
+        z++;
+    }
+    off_t end = (off_t)(z * zm->zone_size);
+    *run_end = end < (off_t)zm->file_size ? end : (off_t)zm->file_size;
+    return start > position ? start : position;
+}
+
+static void atomic_min(int32_t *p, int32_t value) {
+    int32_t current = __atomic_load_n(p, __ATOMIC_RELAXED);
+    while (value < current &&
+           !__atomic_compare_exchange_n(p, &current, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void atomic_max(int32_t *p, int32_t value) {
+    int32_t current = __atomic_load_n(p, __ATOMIC_RELAXED);
+    while (value > current &&
+           !__atomic_compare_exchange_n(p, &current, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Сводка блока data[0..count) по смещению offset. Блок может задевать
+// несколько зон, а зона - делиться между потоками, поэтому каждый участок
+// сводится локально и сливается в зону атомарно.
+void ema_zonemap_record(ema_zonemap_t *zm, const int *data, size_t count, off_t offset) {
+    size_t i = 0;
+    while (i < count) {
+        size_t position = offset + i * sizeof(int);
+        size_t z = position / zm->zone_size;
+        if (z >= zm->n_zones) {
+            return;
+        }
+        size_t n = ((z + 1) * zm->zone_size - position) / sizeof(int);
+        n = n < count - i ? n : count - i;
+
+        ema_zone_t local = empty_zone;
+        for (size_t j = i; j < i + n; j++) {
+            int32_t v = data[j];
+            uint32_t bit = (uint32_t)v & (EMA_ZONE_FILTER_BITS - 1);
+            local.min = v < local.min ? v : local.min;
+            local.max = v > local.max ? v : local.max;
+            local.filter[bit >> 6] |= 1ULL << (bit & 63);
+        }
+        ema_zone_t *zone = &zm->next[z];
+        atomic_min(&zone->min, local.min);
+        atomic_max(&zone->max, local.max);
+        for (int w = 0; w < EMA_ZONE_FILTER_BITS / 64; w++) {
+            if (local.filter[w] != 0) {
+                __atomic_fetch_or(&zone->filter[w], local.filter[w], __ATOMIC_RELAXED);
+            }
+        }
+        i += n;
+    }
+}
+
+// Завершение прохода: пропущенные зоны сохраняют прежние сводки, карта
+// привязывается к новым размеру и mtime файла
+int ema_zonemap_finish(ema_zonemap_t *zm, const char *filename) {
+    for (size_t z = 0; z < zm->n_zones; z++) {
+        if (zm->valid && zm->next[z].min > zm->next[z].max) {
+            zm->next[z] = zm->zones[z];
+        }
+    }
+    ema_zone_t *built = zm->next;
+    zm->next = zm->zones;
+    zm->zones = built;
+
+    struct stat st;
+    if (stat(filename, &st) == -1) {
+        perror("stat");
+        zm->valid = 0;
+        return -1;
+    }
+    zm->file_size = st.st_size;
+    zm->mtime_sec = st.st_mtim.tv_sec;
+    zm->mtime_nsec = st.st_mtim.tv_nsec;
+    zm->valid = 1;
+    return 0;
+}
+
+int ema_zonemap_save(const ema_zonemap_t *zm, const char *path) {
+    // Как и индекс: временный файл и переименование
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL) {
+        perror(tmp);
+        return -1;
+    }
+
+    ema_zonemap_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ZONEMAP_MAGIC, sizeof(header.magic));
+    header.file_size = zm->file_size;
+    header.mtime_sec = zm->mtime_sec;
+    header.mtime_nsec = zm->mtime_nsec;
+    header.zone_size = zm->zone_size;
+    header.n_zones = zm->n_zones;
+    int status = fwrite(&header, sizeof(header), 1, f) == 1 ? 0 : -1;
+    if (status == 0 && zm->n_zones > 0 && fwrite(zm->zones, sizeof(ema_zone_t), zm->n_zones, f) != zm->n_zones) {
+        status = -1;
+    }
+    if (fclose(f) != 0) {
+        status = -1;
+    }
+    if (status == 0 && rename(tmp, path) == -1) {
+        status = -1;
+    }
+    if (status == -1) {
+        perror(path);
+        unlink(tmp);
+    }
+    return status;
+}
+
+// Загрузка карты с диска. 0 - карта годна для файла, 1 - её нет, она
+// устарела или построена для другого размера зоны (нужен полный проход),
+// -1 - ошибка.
+int ema_zonemap_load(ema_zonemap_t *zm, const char *path, const char *filename) {
+    zm->valid = 0;
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        if (errno == ENOENT) {
+            return 1;
+        }
+        perror(path);
+        return -1;
+    }
+
+    int status = 1;
+    ema_zonemap_header_t header;
+    struct stat st;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, ZONEMAP_MAGIC, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "%s: not a zone map, rebuilding\n", path);
+        goto out;
+    }
+    if (header.zone_size != zm->zone_size) {
+        fprintf(stderr, "%s: built for %llu-byte zones, rebuilding\n", path, (unsigned long long)header.zone_size);
+        goto out;
+    }
+    if (stat(filename, &st) == -1) {
+        perror("stat");
+        status = -1;
+        goto out;
+    }
+    if (zonemap_resize(zm, header.file_size) == -1) {
+        status = -1;
+        goto out;
+    }
+    if (header.n_zones != zm->n_zones ||
+        (zm->n_zones > 0 && fread(zm->zones, sizeof(ema_zone_t), zm->n_zones, f) != zm->n_zones)) {
+        fprintf(stderr, "%s: truncated zone map, rebuilding\n", path);
+        goto out;
+    }
+    zm->file_size = header.file_size;
+    zm->mtime_sec = header.mtime_sec;
+    zm->mtime_nsec = header.mtime_nsec;
+    zm->valid = 1;
+    if (zonemap_current(zm, &st)) {
+        status = 0;
+    } else {
+        fprintf(stderr, "%s: file size or mtime changed, rebuilding\n", path);
+        zm->valid = 0;
+    }
+
+out:
+    fclose(f);
+    return status;
+}
@@ -0,0 +1,504 @@
+#ifndef EMA_REPLACE_INT_EMA_H
+#define EMA_REPLACE_INT_EMA_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#define BUFFER_SIZE (4096)  // Размер буфера для чтения по умолчанию
+#define MIN_BLOCK_SIZE (4096LL)
+#define MAX_BLOCK_SIZE (64LL * 1024 * 1024)
+#define DIRECT_ALIGN (4096)  // выравнивание смещений и длин для O_DIRECT
+#define EMA_DIRTY_PAGE_SIZE (4096)  // страница учёта изменённых участков
+
+// Способ доступа к файлу при поиске и замене
+typedef enum {
+    EMA_ENGINE_RW,      // read() блоками + lseek/write грязных блоков
+    EMA_ENGINE_MMAP,    // MAP_SHARED отображение, замена на месте
+    EMA_ENGINE_URING,   // io_uring: qd чтений в полёте, асинхронная запись
+    EMA_ENGINE_COUNT
+} ema_engine_t;
+
+// Шаблон доступа нагрузки по запросам (ema-pattern.c)
+typedef enum {
+    EMA_PATTERN_NONE,   // обычный проход по всему файлу
+    EMA_PATTERN_SEQ,
+    EMA_PATTERN_RANDOM,
+    EMA_PATTERN_STRIDED,
+    EMA_PATTERN_ZIPF,   // ранги zipf(1.0), разбросанные по файлу
+    EMA_PATTERN_HOTCOLD,  // 90% операций в горячих 10% файла
+    EMA_PATTERN_COUNT
+} ema_pattern_t;
+
+// Гранулярность записи изменённых участков блока
+typedef enum {
+    EMA_DIRTY_BLOCK,    // весь блок, если в нём есть замена
+    EMA_DIRTY_PAGE,     // только изменённые страницы по EMA_DIRTY_PAGE_SIZE
+    EMA_DIRTY_INT,      // только изменённые элементы (int или --type)
+    EMA_DIRTY_COUNT
+} ema_dirty_t;
+
+// Способ восстановления файла из шаблона (ema-reset.c)
+typedef enum {
+    EMA_RESET_REFLINK,      // FICLONE: общие экстенты, без копирования
+    EMA_RESET_COPY_RANGE,   // copy_file_range: копия внутри ядра
+    EMA_RESET_RW,           // read/write через пользовательский буфер
+    EMA_RESET_COUNT
+} ema_reset_t;
+
+// Политика долговечности записанного (ema-sync.c)
+typedef enum {
+    EMA_SYNC_NONE,      // запись остаётся в page cache
+    EMA_SYNC_END,       // fdatasync в конце каждого прохода
+    EMA_SYNC_PER_BLOCK, // O_DSYNC: каждая запись возвращается уже на диске
+    EMA_SYNC_RANGE,     // sync_file_range скользящим окном + fdatasync в конце
+    EMA_SYNC_COUNT
+} ema_sync_t;
+
+#define EMA_SYNC_DEFAULT_WINDOW (8 * 1024 * 1024)
+
+// Скользящее окно sync_file_range одного последовательного прохода:
+// записанное до waited уже дождалось диска, written - конец самой
+// дальней записи. В начале прохода оба равны началу диапазона.
+typedef struct {
+    off_t waited;
+    off_t written;
+} ema_sync_window_t;
+
+// Участок [begin, end) байт внутри блока
+typedef struct {
+    size_t begin;
+    size_t end;
+} ema_range_t;
+
+// Ядро сканирования буфера int'ов
+typedef enum {
+    EMA_KERNEL_AUTO,    // лучшее из поддерживаемых CPU
+    EMA_KERNEL_SCALAR,  // эталонный цикл по одному int
+    EMA_KERNEL_SSE41,
+    EMA_KERNEL_AVX2,
+    EMA_KERNEL_AVX512,
+    EMA_KERNEL_COUNT
+} ema_kernel_t;
+
+// Тип элементов файла
+typedef enum {
+    EMA_TYPE_I8,
+    EMA_TYPE_I16,
+    EMA_TYPE_I32,
+    EMA_TYPE_I64,
+    EMA_TYPE_U8,
+    EMA_TYPE_U16,
+    EMA_TYPE_U32,
+    EMA_TYPE_U64,
+    EMA_TYPE_F32,
+    EMA_TYPE_F64,
+    EMA_TYPE_COUNT
+} ema_type_t;
+
+// Порядок байтов элементов в файле
+typedef enum {
+    EMA_ENDIAN_NATIVE,
+    EMA_ENDIAN_LITTLE,
+    EMA_ENDIAN_BIG,
+    EMA_ENDIAN_COUNT
+} ema_endian_t;
+
+// Значение элемента: его биты в порядке байтов CPU в младших байтах
+// (для f32/f64 - биты float/double)
+typedef uint64_t ema_value_t;
+
+// Заменяет search_value на replace_value в count элементах data,
+// возвращает число замен
+typedef size_t (*ema_scan_fn)(void *data, size_t count, ema_value_t search_value, ema_value_t replace_value);
+
+// Считает элементы data, равные value, ничего не меняя
+typedef size_t (*ema_count_fn)(const void *data, size_t count, ema_value_t value);
+
+typedef struct {
+    int key;
+    int value;
+} ema_rule_slot_t;
+
+// Набор правил old -> new, применяемых за один проход (ema-rules.c)
+typedef struct {
+    size_t count;
+    size_t capacity;        // предел правил при заполнении таблицы 1/2
+    unsigned table_bits;    // log2 числа слотов хэш-таблицы
+    ema_rule_slot_t *slots;
+    uint64_t *occupied;     // бит занятости на слот
+    uint32_t filter_mask;   // младшие биты значения, индексирующие filter
+    uint64_t *filter;       // бит на младшие биты каждого old
+} ema_rules_t;
+
+#define EMA_INDEX_MAX_VALUES 16
+
+// Отсортированные смещения горячих значений в файле (ema-index.c)
+typedef struct {
+    int values[EMA_INDEX_MAX_VALUES];
+    int n_values;
+    off_t *offsets[EMA_INDEX_MAX_VALUES];
+    size_t count[EMA_INDEX_MAX_VALUES];
+    size_t allocated[EMA_INDEX_MAX_VALUES];
+    pthread_mutex_t lock;   // потоки прохода пишут смещения параллельно
+    int failed;             // не хватило памяти при построении
+    int valid;              // списки соответствуют файлу с размером и mtime ниже
+    unsigned long long file_size;
+    long long mtime_sec;
+    long long mtime_nsec;
+} ema_index_t;
+
+#define EMA_ZONE_DEFAULT_SIZE (64 * 1024)
+#define EMA_ZONE_FILTER_BITS 1024
+
+// Сводка зоны файла: min/max int'ов и битовая карта по младшим битам
+// значений (ema-zonemap.c)
+typedef struct {
+    int32_t min;            // min > max - в зоне ничего не встретилось
+    int32_t max;
+    uint64_t filter[EMA_ZONE_FILTER_BITS / 64];
+} ema_zone_t;
+
+// Карта зон файла: по сводкам проход пропускает зоны без search_value
+typedef struct {
+    size_t zone_size;
+    size_t n_zones;
+    ema_zone_t *zones;      // сводки, по которым отсекает проход (при valid)
+    ema_zone_t *next;       // сводки, собираемые текущим проходом
+    int valid;              // zones соответствуют файлу с размером и mtime ниже
+    unsigned long long file_size;
+    long long mtime_sec;
+    long long mtime_nsec;
+} ema_zonemap_t;
+
+#define EMA_COUNT_MAX_VALUES 64
+#define EMA_TOP_MAX 1024
+
+// Корзины распределения значений по порядку величины: отрицательные от
+// больших по модулю к малым, ноль, положительные, NaN. Порядок e - целая
+// часть log2 модуля, для плавающих ограничен диапазоном -64..63.
+#define EMA_MAGNITUDE_EXPONENTS 128
+#define EMA_BUCKET_ZERO EMA_MAGNITUDE_EXPONENTS
+#define EMA_BUCKET_NAN (2 * EMA_MAGNITUDE_EXPONENTS + 1)
+#define EMA_VALUE_BUCKETS (2 * EMA_MAGNITUDE_EXPONENTS + 2)
+
+typedef enum {
+    EMA_ANALYZE_COUNT,      // число вхождений каждого из заданных значений
+    EMA_ANALYZE_HISTOGRAM,  // самые частые значения и распределение по порядку
+} ema_analyze_t;
+
+typedef struct {
+    ema_value_t value;
+    unsigned long long count;
+} ema_value_count_t;
+
+// Анализ файла без записи (ema-analyze.c): на входе режим и значения
+// или top_k, на выходе счётчики одного прохода
+typedef struct {
+    ema_analyze_t mode;
+    ema_value_t values[EMA_COUNT_MAX_VALUES];
+    unsigned long long counts[EMA_COUNT_MAX_VALUES];
+    int n_values;
+    int top_k;
+    ema_value_count_t top[EMA_TOP_MAX];
+    int n_top;
+    unsigned long long max_error;   // счётчики top занижены не больше чем на это (0 - точные)
+    unsigned long long buckets[EMA_VALUE_BUCKETS];
+    unsigned long long elements;
+} ema_analysis_t;
+
+// Тип операции для гистограмм задержек
+typedef enum {
+    EMA_OP_READ,        // pread или чтение uring от отправки до завершения
+    EMA_OP_WRITE,
+    EMA_OP_FAULT,       // mmap: окно обращения к странице (сканирование с промахами)
+    EMA_OP_COUNT
+} ema_op_t;
+
+// Лог-линейная гистограмма задержек в наносекундах (как HDR Histogram):
+// на каждую степень двойки 2^EMA_LATENCY_SUB_BITS корзин одной ширины,
+// поэтому запись - O(1), а относительная ошибка не больше 1/32
+#define EMA_LATENCY_SUB_BITS 5
+#define EMA_LATENCY_BUCKETS ((65 - EMA_LATENCY_SUB_BITS) << EMA_LATENCY_SUB_BITS)
+
+typedef struct {
+    unsigned long long counts[EMA_LATENCY_BUCKETS];
+    unsigned long long total;
+    unsigned long long max;
+} ema_histogram_t;
+
+// Гистограммы по типам операций; потоки пишут в них атомарно
+typedef struct {
+    ema_histogram_t ops[EMA_OP_COUNT];
+} ema_latency_t;
+
+// Чем подкреплён буфер режима в памяти
+typedef enum {
+    EMA_HUGE_NONE,      // обычные 4K страницы
+    EMA_HUGE_THP,       // MADV_HUGEPAGE, ядро собирает huge pages само
+    EMA_HUGE_HUGETLB,   // MAP_HUGETLB из зарезервированного пула
+} ema_huge_t;
+
+// Копия файла данных в анонимной памяти (ema-memory.c)
+typedef struct {
+    int *data;
+    size_t size;            // байт данных
+    size_t mapped;          // размер отображения, кратный huge page
+    ema_huge_t huge;
+    long long huge_bytes;   // фактически в huge pages по smaps, -1 - неизвестно
+    int numa_node;          // -1 - без привязки
+} ema_memory_t;
+
+// Параметры одного прохода поиска и замены
+typedef struct {
+    ema_engine_t engine;
+    ema_value_t search_value;
+    ema_value_t replace_value;
+    ema_type_t type;
+    int swap;           // порядок байтов файла отличается от порядка CPU
+    size_t block_size;  // размер блока read/write движка
+    ema_kernel_t kernel;
+    int mmap_populate;  // MAP_POPULATE: заранее подгрузить все страницы
+    int mmap_sync;      // msync(MS_SYNC) в конце прохода
+    int threads;        // число потоков, делящих файл на диапазоны
+    int queue_depth;    // uring: число блоков в полёте
+    int direct;         // rw, uring: O_DIRECT в обход page cache
+    const ema_rules_t *rules;  // не NULL: вместо пары search/replace
+    ema_index_t *index;        // не NULL: проход строит индекс смещений
+    ema_dirty_t dirty;  // rw, uring: что писать обратно из грязного блока
+    ema_pattern_t pattern;     // не NONE: вместо прохода - ops запросов
+    size_t request_size;
+    unsigned long long ops;    // 0 - по числу запросов, помещающихся в файл
+    double write_ratio;        // доля операций read-modify-write
+    size_t stride;             // strided: шаг между запросами в байтах
+    unsigned long long seed;   // последовательность запросов прохода
+    ema_latency_t *latency;    // не NULL: время каждой операции ввода-вывода
+    const ema_memory_t *memory;  // не NULL: проход по буферу в памяти вместо файла
+    ema_sync_t sync;
+    size_t sync_window;        // EMA_SYNC_RANGE: байт записи в полёте до ожидания
+    int skip_holes;            // rw, uring: не читать дыры разреженного файла (ema-sparse.c)
+    ema_zonemap_t *zonemap;    // не NULL: проход собирает сводки зон и отсекает по ним
+} ema_config_t;
+
+// Счётчики одного прохода
+typedef struct {
+    unsigned long long matches;
+    unsigned long long bytes_read;
+    unsigned long long bytes_written;
+    unsigned long long read_calls;    // read/pread
+    unsigned long long write_calls;   // write/pwrite
+    unsigned long long other_calls;   // open, lseek, mmap, msync, ...
+    unsigned long long ops;           // запросы шаблона доступа
+    unsigned long long rmw_ops;       // из них read-modify-write
+    unsigned long long read_matches;  // совпадения в запросах только на чтение
+    unsigned long long write_ns;      // cfg->sync: время в pwrite (с O_DSYNC - вместе с синхронизацией)
+    unsigned long long sync_ns;       // время в fdatasync и sync_file_range
+    unsigned long long bytes_skipped; // cfg->skip_holes: байт дыр, не прочитанных вовсе
+    unsigned long long bytes_pruned;  // cfg->zonemap: байт зон, отброшенных по сводкам
+} ema_stats_t;
+
+const char *ema_engine_name(ema_engine_t engine);
+unsigned long long ema_stats_syscalls(const ema_stats_t *stats);
+void ema_stats_add(ema_stats_t *total, const ema_stats_t *part);
+int ema_engine_parse(const char *name, ema_engine_t *engine);
+
+// Ядра сканирования (ema-kernels.c): выбор во время выполнения по CPUID
+const char *ema_kernel_name(ema_kernel_t kernel);
+int ema_kernel_parse(const char *name, ema_kernel_t *kernel);
+int ema_kernel_supported(ema_kernel_t kernel);
+ema_kernel_t ema_kernel_resolve(ema_kernel_t kernel);
+ema_scan_fn ema_kernel_fn(ema_kernel_t kernel, ema_type_t type, int swap);
+ema_count_fn ema_count_kernel_fn(ema_kernel_t kernel, ema_type_t type, int swap);
+
+// Типы элементов и значения (ema-type.c)
+const char *ema_type_name(ema_type_t type);
+int ema_type_parse(const char *name, ema_type_t *type);
+size_t ema_type_size(ema_type_t type);
+const char *ema_endian_name(ema_endian_t endian);
+int ema_endian_parse(const char *name, ema_endian_t *endian);
+int ema_endian_swap(ema_endian_t endian);  // 1 - порядок отличается от CPU
+int ema_value_parse(const char *str, ema_type_t type, ema_value_t *value);
+void ema_value_format(ema_value_t value, ema_type_t type, char *buf, size_t size);
+
+int ema_rules_init(ema_rules_t *rules, size_t capacity);
+int ema_rules_add(ema_rules_t *rules, int old_value, int new_value);  // 1 - дубликат
+int ema_rules_load(const char *path, ema_rules_t *rules);
+void ema_rules_free(ema_rules_t *rules);
+size_t ema_rules_scan(const ema_rules_t *rules, int *data, size_t count);
+
+// Замена в блоке по cfg: набором правил или ядром scan. offset -
+// положение блока в файле для построения индекса.
+// Набор правил, индекс и карта зон работают только с i32 в порядке CPU.
+size_t ema_scan_block(const ema_config_t *cfg, ema_scan_fn scan, void *data, size_t count, off_t offset);
+
+// Замена в блоке из len байт с разбиением изменённого на не более чем
+// max_ranges слитых участков по cfg->dirty (ema-dirty.c)
+size_t ema_scan_dirty(const ema_config_t *cfg, ema_scan_fn scan, void *data, size_t len, off_t offset,
+                      ema_range_t *ranges, size_t max_ranges, size_t *n_ranges);
+const char *ema_dirty_name(ema_dirty_t dirty);
+int ema_dirty_parse(const char *name, ema_dirty_t *dirty);
+
+int ema_index_init(ema_index_t *index, const int *values, int n_values);
+void ema_index_free(ema_index_t *index);
+void ema_index_reset(ema_index_t *index);
+int ema_index_find(const ema_index_t *index, int value);
+void ema_index_record(ema_index_t *index, const int *data, size_t count, off_t offset);
+int ema_index_finish(ema_index_t *index, const char *filename);
+int ema_index_current(const ema_index_t *index, const char *filename);
+int ema_index_save(const ema_index_t *index, const char *path);
+int ema_index_load(ema_index_t *index, const char *path, const char *filename);
+int ema_index_patch(ema_index_t *index, const char *filename, const ema_config_t *cfg, ema_stats_t *stats);
+
+// Карта зон (ema-zonemap.c). Проход между ema_zonemap_begin и
+// ema_zonemap_finish собирает сводки через ema_scan_block.
+void ema_zonemap_init(ema_zonemap_t *zm, size_t zone_size);
+void ema_zonemap_free(ema_zonemap_t *zm);
+int ema_zonemap_load(ema_zonemap_t *zm, const char *path, const char *filename);
+int ema_zonemap_save(const ema_zonemap_t *zm, const char *path);
+int ema_zonemap_begin(ema_zonemap_t *zm, const char *filename);
+void ema_zonemap_record(ema_zonemap_t *zm, const int *data, size_t count, off_t offset);
+int ema_zonemap_finish(ema_zonemap_t *zm, const char *filename);
+// 1 - проход может пропускать зоны (карта годна, нет набора правил)
+int ema_zonemap_prunes(const ema_config_t *cfg);
+// Начало следующей серии зон, которые могут содержать value, не раньше
+// position; *run_end - её конец. Если таких нет - размер файла.
+off_t ema_zonemap_next(const ema_zonemap_t *zm, ema_value_t value, off_t position, off_t *run_end);
+
+// Долговечность записи (ema-sync.c)
+const char *ema_sync_name(ema_sync_t sync);
+int ema_sync_parse(const char *name, ema_sync_t *sync);
+// Флаги open() для политики: O_DSYNC при EMA_SYNC_PER_BLOCK
+int ema_sync_open_flags(const ema_config_t *cfg);
+// fdatasync файла в конце прохода при EMA_SYNC_END и EMA_SYNC_RANGE
+int ema_sync_pass_end(const char *filename, const ema_config_t *cfg, ema_stats_t *stats);
+// Учёт записанного участка окном EMA_SYNC_RANGE; без неё ничего не делает
+int ema_sync_written(int fd, off_t offset, size_t len, const ema_config_t *cfg,
+                     ema_sync_window_t *window, ema_stats_t *stats);
+
+// Дыры разреженного файла (ema-sparse.c)
+// 1 - нулевой элемент ничего не заменяет и дыры можно не читать
+int ema_holes_skippable(const ema_config_t *cfg);
+// Участок данных [*data_start, *data_end) не раньше position (SEEK_DATA/SEEK_HOLE)
+int ema_next_data(int fd, off_t position, const ema_config_t *cfg, off_t *data_start, off_t *data_end,
+                  ema_stats_t *stats);
+
+// Буфер блока, выровненный по странице; освобождается free()
+void *ema_alloc_block(size_t size);
+
+// Открытие файла данных на чтение и запись, с O_DIRECT при cfg->direct
+int ema_open_data(const char *filename, const ema_config_t *cfg, ema_stats_t *stats);
+
+// Длина запроса, округлённая вверх до DIRECT_ALIGN при cfg->direct
+size_t ema_io_length(size_t len, const ema_config_t *cfg);
+
+// Управление page cache между итерациями (ema-cache.c)
+int ema_drop_cache(const char *filename);
+int ema_warm_cache(const char *filename);
+
+// Восстановление файла из шаблона перед итерацией (ema-reset.c);
+// *method - способ, которым это удалось
+int ema_reset_file(const char *template_path, const char *filename, ema_reset_t *method);
+// Нетронутая копия файла рядом с ним (<file>.snapshot, тем же способом):
+// из неё восстанавливаются прогоны, которые должны видеть одно и то же
+// содержимое. Удаляет её вызывающий.
+int ema_snapshot_create(const char *filename, char *path, size_t size);
+const char *ema_reset_name(ema_reset_t method);
+
+// Профиль настройки, найденный --autotune (ema-profile.c): лучшие для
+// файла движок, размер блока, число потоков и глубина очереди
+typedef struct {
+    ema_engine_t engine;
+    size_t block_size;
+    int threads;
+    int queue_depth;
+    double mbps;        // пропускная способность на пробах
+} ema_profile_t;
+
+int ema_profile_save(const ema_profile_t *profile, const char *path, const char *filename);
+int ema_profile_load(ema_profile_t *profile, const char *path);
+
+// Один проход по файлу выбранным движком; -1 при ошибке
+int ema_run_pass(const char *filename, const ema_config_t *cfg, ema_stats_t *stats);
+
+// Движки (ema-rw.c, ema-mmap.c, ema-uring.c)
+int replace_in_file(const char *filename, const ema_config_t *cfg, ema_stats_t *stats);
+int replace_in_file_mmap(const char *filename, const ema_config_t *cfg, ema_stats_t *stats);
+int replace_in_file_uring(const char *filename, const ema_config_t *cfg, ema_stats_t *stats);
+
+// Части движков, из которых собираются многопоточные проходы
+int ema_rw_range(int fd, off_t start, off_t end, int *buffer, const ema_config_t *cfg, ema_stats_t *stats);
+int ema_uring_range(int fd, off_t start, off_t end, const ema_config_t *cfg, ema_stats_t *stats);
+// Кольцо uring, переиспользуемое для многих файлов (ema-uring.c). После
+// ошибки ema_uring_run в кольце могут остаться операции - его пересоздают.
+typedef struct ema_uring ema_uring_t;
+ema_uring_t *ema_uring_create(const ema_config_t *cfg, ema_stats_t *stats);
+int ema_uring_attach(ema_uring_t *u, int fd, ema_stats_t *stats);
+int ema_uring_run(ema_uring_t *u, int fd, off_t start, off_t end, const ema_config_t *cfg, ema_stats_t *stats);
+void ema_uring_destroy(ema_uring_t *u, ema_stats_t *stats);
+int *ema_map_file(const char *filename, const ema_config_t *cfg, size_t *size, ema_stats_t *stats);
+void ema_mmap_scan(void *data, size_t begin, size_t end, const ema_config_t *cfg, ema_stats_t *stats);
+int ema_unmap_file(int *data, size_t size, const ema_config_t *cfg, ema_stats_t *stats);
+
+// Нагрузка с шаблоном доступа cfg->pattern (ema-pattern.c)
+int ema_pattern_pass(const char *filename, const ema_config_t *cfg, ema_stats_t *stats);
+const char *ema_pattern_name(ema_pattern_t pattern);
+int ema_pattern_parse(const char *name, ema_pattern_t *pattern);
+
+// Гистограммы задержек (ema-latency.c)
+// Время операции от start_ns (get_time_ns() из instrument.h) до текущего
+// момента; ничего не делает при latency == NULL
+void ema_latency_record(ema_latency_t *latency, ema_op_t op, unsigned long long start_ns);
+void ema_latency_add(ema_latency_t *total, const ema_latency_t *part);
+// Запись значения в гистограмму; безопасна из нескольких потоков
+void ema_histogram_record(ema_histogram_t *hist, unsigned long long ns);
+const char *ema_op_name(ema_op_t op);
+// Значение, не превышаемое долей q записей (верхняя граница корзины)
+unsigned long long ema_histogram_quantile(const ema_histogram_t *hist, double q);
+// Строка "<op>: p50 ... max ..." для каждого типа с записями
+void ema_latency_print(const ema_latency_t *latency, const char *indent);
+// Непустые корзины строками "<label>,<op>,<low_ns>,<high_ns>,<count>"
+int ema_latency_dump(const ema_latency_t *latency, const char *label, FILE *out);
+
+// Режим в памяти (ema-memory.c): загрузка файла в анонимный буфер с
+// huge pages и, при numa_node >= 0, привязкой к узлу NUMA
+int ema_memory_load(const char *filename, int numa_node, ema_memory_t *memory);
+void ema_memory_free(ema_memory_t *memory);
+// Перечитать файл в уже выделенный буфер (вернуть исходное содержимое)
+int ema_memory_reload(const char *filename, ema_memory_t *memory);
+int ema_memory_pass(const ema_config_t *cfg, ema_stats_t *stats);
+const char *ema_huge_name(ema_huge_t huge);
+
+// Проход только на чтение (ema-analyze.c): rw, mmap или буфер в памяти,
+// в cfg->threads потоков
+int ema_analyze_pass(const char *filename, const ema_config_t *cfg, ema_analysis_t *analysis, ema_stats_t *stats);
+void ema_analysis_print(const ema_analysis_t *analysis, const ema_config_t *cfg);
+// Совпадают ли результаты двух проходов
+int ema_analysis_equal(const ema_analysis_t *a, const ema_analysis_t *b);
+
+// Файл пакетного режима и его итоги по всем итерациям (ema-batch.c)
+typedef struct {
+    char *path;
+    unsigned long long size;
+    ema_stats_t stats;
+    unsigned long long elapsed_ns;
+    int status;
+} ema_batch_file_t;
+
+typedef struct {
+    ema_batch_file_t *files;
+    size_t count;
+    ema_histogram_t latency;    // время обработки файла целиком, нс
+} ema_batch_t;
+
+// Список файлов: каталог (обычные файлы без скрытых), шаблон glob или
+// @<файл> со списком путей по одному на строку
+int ema_batch_collect(const char *source, ema_batch_t *batch);
+void ema_batch_free(ema_batch_t *batch);
+// Обработка файлов пулом из workers потоков; 0, если все файлы обработаны
+int ema_batch_run(ema_batch_t *batch, const ema_config_t *cfg, int workers, int iterations);
+
+// Проход в cfg->threads потоков по диапазонам файла (ema-parallel.c)
+int ema_run_parallel(const char *filename, const ema_config_t *cfg, ema_stats_t *stats);
+
+#endif